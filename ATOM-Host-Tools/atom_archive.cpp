@@ -0,0 +1,806 @@
+/******************************************************************************
+ * M5ATOM ENV archive
+ * Columnar archive for the samples of a monitor fleet and a query tool
+ * that memory-maps it.
+ *
+ * The archive is a directory with one file per UTC day (YYYYMMDD.atc).
+ * Inside a file the samples are sorted by device and time and cut into
+ * blocks of up to 4096 samples of one device. Every column of a block is
+ * compressed on its own (time: delta of delta, values: delta, both as
+ * zigzag varints), and the block index in front of the data keeps a zone
+ * map per block: time range, count/min/max/sum of every metric. A missing
+ * value (failed sensor read, empty CSV field) is stored as INT32_MIN in its
+ * column and is not part of the zone map. Queries skip
+ * files by their name, blocks by their zone map, and aggregates take
+ * blocks that are completely inside the query range from the zone map
+ * without decoding them.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -o atom_archive atom_archive.cpp
+ *
+ * usage:
+ *   atom_archive import <archive> <csv> ...
+ *       add the CSV files of fleet_collector to the archive
+ *       (samples that are already archived are skipped)
+ *   atom_archive query <archive> [-d device] [-f from] [-t to]
+ *                      [-m metric [-g value] [-l value]]
+ *       print the samples in the range as CSV, -g/-l keep only samples
+ *       with the metric greater/less than the value (and not missing)
+ *   atom_archive agg <archive> [-d device] [-f from] [-t to] [-b seconds]
+ *       count/min/max/mean of every metric, in buckets with -b
+ *       (missing values are left out, an empty field if there is none)
+ *   atom_archive info <archive>
+ *       files, blocks and compression
+ *   from/to: ms since 1970 or UTC "YYYY-MM-DD[THH:MM[:SS]]", to is exclusive
+ *   metric: temperature, humidity or pressure
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#define ARCHIVE_MAGIC      "ATOMCOL1"
+#define ARCHIVE_VERSION    2
+#define ARCHIVE_BLOCK_SIZE 4096
+#define ARCHIVE_NAME_SIZE  32
+#define N_METRICS          3
+
+static const char* metric_names[N_METRICS] = {"temperature", "humidity", "pressure"};
+static const char* metric_columns[N_METRICS] = {"temperature_C", "humidity_pct", "pressure_Pa"};
+
+// all values are stored as fixed point: 0.01 degC, 0.01 %, 0.01 Pa
+#define FIXED_SCALE 100.0
+// code of a missing value in the columns
+#define VALUE_MISSING INT32_MIN
+
+// file layout (little endian):
+//   archive_header_t
+//   n_devices * device name (ARCHIVE_NAME_SIZE bytes, zero padded)
+//   n_blocks * block_zone_t (block index with the zone maps)
+//   column data of the blocks
+typedef struct _archive_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t day;
+  uint32_t n_devices;
+  uint32_t n_blocks;
+  int64_t t_min;
+  int64_t t_max;
+  uint64_t samples;
+  uint64_t device_offset;
+  uint64_t block_offset;
+} archive_header_t;
+
+// min/max/sum of the values that are not missing,
+// min > max if all values of the block are missing
+typedef struct _zone_metric {
+  int32_t min;
+  int32_t max;
+  int64_t sum;
+  uint32_t count;
+  uint32_t reserved;
+} zone_metric_t;
+
+typedef struct _block_zone {
+  uint32_t device;
+  uint32_t count;
+  int64_t t_min;
+  int64_t t_max;
+  zone_metric_t metric[N_METRICS];
+  // the columns time, temperature, humidity, pressure follow each other
+  uint64_t offset;
+  uint32_t size[1 + N_METRICS];
+} block_zone_t;
+
+static_assert(sizeof(archive_header_t) == 64, "archive header layout");
+static_assert(sizeof(block_zone_t) == 120, "block zone layout");
+
+typedef struct _sample {
+  int64_t time_ms;
+  int32_t value[N_METRICS];
+} sample_t;
+
+static bool sample_before(const sample_t& a, const sample_t& b)
+{
+  return a.time_ms < b.time_ms;
+}
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t day_of(int64_t time_ms)
+{
+  time_t t = (time_t)(time_ms / 1000);
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  return (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
+
+// ms since 1970 or a UTC date/time, returns false if it is neither
+static bool parse_time(const char* text, int64_t* time_ms)
+{
+  struct tm tm;
+  const char* formats[] = {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%dT%H:%M", "%Y-%m-%d"};
+  for(int i = 0; i < 3; i++){
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(text, formats[i], &tm);
+    if(end && *end == 0){
+      *time_ms = (int64_t)timegm(&tm) * 1000;
+      return true;
+    }
+  }
+  char* end;
+  *time_ms = strtoll(text, &end, 10);
+  return *text && *end == 0;
+}
+
+static int metric_index(const char* name)
+{
+  for(int i = 0; i < N_METRICS; i++)
+    if(strcmp(name, metric_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+// ===============================================================
+// column encoding
+// ===============================================================
+
+static void put_varint(std::vector<uint8_t>* out, int64_t value)
+{
+  // zigzag: small negative numbers become small positive numbers
+  uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  while(v >= 0x80){
+    out->push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back((uint8_t)v);
+}
+
+static const uint8_t* get_varint(const uint8_t* p, const uint8_t* end, int64_t* value)
+{
+  uint64_t v = 0;
+  int shift = 0;
+  while(p < end && shift < 64){
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if((b & 0x80) == 0){
+      *value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+      return p;
+    }
+    shift += 7;
+  }
+  return NULL;
+}
+
+// time: first value, first delta, then the change of the delta
+// (0 for every sample of a device with a steady interval)
+static void encode_time(std::vector<uint8_t>* out, const sample_t* samples, size_t n)
+{
+  int64_t last = 0, last_delta = 0;
+  for(size_t i = 0; i < n; i++){
+    int64_t delta = samples[i].time_ms - last;
+    put_varint(out, i == 0 ? samples[i].time_ms : delta - last_delta);
+    last = samples[i].time_ms;
+    last_delta = i == 0 ? 0 : delta;
+  }
+}
+
+static bool decode_time(const uint8_t* p, const uint8_t* end, int64_t* times, size_t n)
+{
+  int64_t last = 0, delta = 0, v;
+  for(size_t i = 0; i < n; i++){
+    if((p = get_varint(p, end, &v)) == NULL)
+      return false;
+    if(i == 0){
+      last = v;
+    } else {
+      delta += v;
+      last += delta;
+    }
+    times[i] = last;
+  }
+  return true;
+}
+
+static void encode_values(std::vector<uint8_t>* out, const sample_t* samples, size_t n, int metric)
+{
+  int64_t last = 0;
+  for(size_t i = 0; i < n; i++){
+    put_varint(out, samples[i].value[metric] - last);
+    last = samples[i].value[metric];
+  }
+}
+
+static bool decode_values(const uint8_t* p, const uint8_t* end, int32_t* values, size_t n)
+{
+  int64_t last = 0, v;
+  for(size_t i = 0; i < n; i++){
+    if((p = get_varint(p, end, &v)) == NULL)
+      return false;
+    last += v;
+    values[i] = (int32_t)last;
+  }
+  return true;
+}
+
+// ===============================================================
+// archive files
+// ===============================================================
+
+struct ArchiveFile {
+  std::string path;
+  uint32_t day;
+  const uint8_t* data;
+  size_t size;
+  const archive_header_t* header;
+  const char* names;
+  const block_zone_t* zones;
+};
+
+static void archive_close(ArchiveFile* file)
+{
+  if(file->data)
+    munmap((void*)file->data, file->size);
+  file->data = NULL;
+}
+
+static bool archive_open(ArchiveFile* file)
+{
+  int fd = open(file->path.c_str(), O_RDONLY);
+  struct stat st;
+  file->data = NULL;
+  if(fd < 0 || fstat(fd, &st) < 0){
+    perror(file->path.c_str());
+    if(fd >= 0)
+      close(fd);
+    return false;
+  }
+  file->size = st.st_size;
+  void* data = file->size >= sizeof(archive_header_t) ? mmap(NULL, file->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if(data == MAP_FAILED){
+    fprintf(stderr, "%s: not an archive file\n", file->path.c_str());
+    return false;
+  }
+  file->data = (const uint8_t*)data;
+  file->header = (const archive_header_t*)data;
+  const archive_header_t* h = file->header;
+  if(memcmp(h->magic, ARCHIVE_MAGIC, 8) == 0 && h->version != ARCHIVE_VERSION){
+    fprintf(stderr, "%s: archive version %u, import the CSV files again\n", file->path.c_str(), h->version);
+    archive_close(file);
+    return false;
+  }
+  if(memcmp(h->magic, ARCHIVE_MAGIC, 8) != 0 ||
+     h->device_offset + (uint64_t)h->n_devices * ARCHIVE_NAME_SIZE > file->size ||
+     h->block_offset + (uint64_t)h->n_blocks * sizeof(block_zone_t) > file->size){
+    fprintf(stderr, "%s: not an archive file\n", file->path.c_str());
+    archive_close(file);
+    return false;
+  }
+  file->names = (const char*)(file->data + h->device_offset);
+  file->zones = (const block_zone_t*)(file->data + h->block_offset);
+  return true;
+}
+
+// decode the requested columns of one block, returns false if it is damaged
+static bool block_decode(const ArchiveFile* file, const block_zone_t* zone, int64_t* times, int32_t* values[N_METRICS])
+{
+  uint64_t offset = zone->offset;
+  for(int c = 0; c <= N_METRICS; c++){
+    if(offset + zone->size[c] > file->size || zone->count > ARCHIVE_BLOCK_SIZE)
+      return false;
+    const uint8_t* p = file->data + offset;
+    bool ok = true;
+    if(c == 0 && times)
+      ok = decode_time(p, p + zone->size[c], times, zone->count);
+    else if(c > 0 && values[c - 1])
+      ok = decode_values(p, p + zone->size[c], values[c - 1], zone->count);
+    if(!ok)
+      return false;
+    offset += zone->size[c];
+  }
+  return true;
+}
+
+static std::vector<ArchiveFile> archive_files(const char* dir, int64_t from, int64_t to)
+{
+  std::vector<ArchiveFile> files;
+  DIR* d = opendir(dir);
+  if(d == NULL){
+    perror(dir);
+    exit(1);
+  }
+  // open ranges: from/to are far outside of what gmtime() handles
+  uint32_t first_day = from > 0 ? day_of(from) : 0;
+  uint32_t last_day = to < INT64_MAX / 4 ? day_of(to - 1) : UINT32_MAX;
+  struct dirent* entry;
+  while((entry = readdir(d)) != NULL){
+    unsigned int day;
+    char ext[8];
+    // the file name is the partition key: no need to open other days
+    if(sscanf(entry->d_name, "%8u.%3s", &day, ext) != 2 || strcmp(ext, "atc") != 0 || strlen(entry->d_name) != 12)
+      continue;
+    if(day < first_day || day > last_day)
+      continue;
+    ArchiveFile file;
+    file.path = std::string(dir) + "/" + entry->d_name;
+    file.day = day;
+    file.data = NULL;
+    files.push_back(file);
+  }
+  closedir(d);
+  std::sort(files.begin(), files.end(), [](const ArchiveFile& a, const ArchiveFile& b) { return a.day < b.day; });
+  return files;
+}
+
+static bool archive_write(const char* dir, uint32_t day, std::map<std::string, std::vector<sample_t> >* devices)
+{
+  archive_header_t header;
+  std::vector<block_zone_t> zones;
+  std::vector<uint8_t> columns[1 + N_METRICS];
+  std::vector<uint8_t> data;
+  std::string names;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ARCHIVE_MAGIC, 8);
+  header.version = ARCHIVE_VERSION;
+  header.day = day;
+  header.t_min = INT64_MAX;
+  header.t_max = INT64_MIN;
+  for(std::map<std::string, std::vector<sample_t> >::iterator it = devices->begin(); it != devices->end(); ++it){
+    std::vector<sample_t>* samples = &it->second;
+    std::string name = it->first.substr(0, ARCHIVE_NAME_SIZE - 1);
+    name.resize(ARCHIVE_NAME_SIZE, 0);
+    names += name;
+    for(size_t start = 0; start < samples->size(); start += ARCHIVE_BLOCK_SIZE){
+      size_t n = std::min(samples->size() - start, (size_t)ARCHIVE_BLOCK_SIZE);
+      const sample_t* s = &(*samples)[start];
+      block_zone_t zone;
+      memset(&zone, 0, sizeof(zone));
+      zone.device = header.n_devices;
+      zone.count = n;
+      zone.t_min = s[0].time_ms;
+      zone.t_max = s[n - 1].time_ms;
+      for(int m = 0; m < N_METRICS; m++){
+        zone.metric[m].min = INT32_MAX;
+        zone.metric[m].max = INT32_MIN;
+        for(size_t i = 0; i < n; i++){
+          if(s[i].value[m] == VALUE_MISSING)
+            continue;
+          zone.metric[m].min = std::min(zone.metric[m].min, s[i].value[m]);
+          zone.metric[m].max = std::max(zone.metric[m].max, s[i].value[m]);
+          zone.metric[m].sum += s[i].value[m];
+          zone.metric[m].count++;
+        }
+      }
+      zone.offset = data.size();
+      for(int c = 0; c <= N_METRICS; c++){
+        columns[c].clear();
+        if(c == 0)
+          encode_time(&columns[c], s, n);
+        else
+          encode_values(&columns[c], s, n, c - 1);
+        zone.size[c] = columns[c].size();
+        data.insert(data.end(), columns[c].begin(), columns[c].end());
+      }
+      zones.push_back(zone);
+      header.samples += n;
+      header.t_min = std::min(header.t_min, zone.t_min);
+      header.t_max = std::max(header.t_max, zone.t_max);
+    }
+    header.n_devices++;
+  }
+  header.n_blocks = zones.size();
+  header.device_offset = sizeof(header);
+  header.block_offset = header.device_offset + names.size();
+  uint64_t data_offset = header.block_offset + zones.size() * sizeof(block_zone_t);
+  for(size_t i = 0; i < zones.size(); i++)
+    zones[i].offset += data_offset;
+
+  // write a new file and replace the old one, a reader never sees half a file
+  char path[512], tmp[520];
+  snprintf(path, sizeof(path), "%s/%08u.atc", dir, day);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE* f = fopen(tmp, "wb");
+  if(f == NULL){
+    perror(tmp);
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(names.data(), 1, names.size(), f) == names.size() &&
+            (zones.empty() || fwrite(zones.data(), sizeof(block_zone_t), zones.size(), f) == zones.size()) &&
+            fwrite(data.data(), 1, data.size(), f) == data.size();
+  ok = (fclose(f) == 0) && ok;
+  if(!ok || rename(tmp, path) < 0){
+    perror(path);
+    unlink(tmp);
+    return false;
+  }
+  return true;
+}
+
+// ===============================================================
+// commands
+// ===============================================================
+
+// add the samples of one day to the existing file of that day
+static bool import_day(const char* dir, uint32_t day, std::map<std::string, std::vector<sample_t> >* devices)
+{
+  ArchiveFile file;
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%08u.atc", dir, day);
+  file.path = path;
+  if(access(path, F_OK) == 0){
+    if(!archive_open(&file))
+      return false;
+    std::vector<int64_t> times(ARCHIVE_BLOCK_SIZE);
+    std::vector<int32_t> columns[N_METRICS];
+    int32_t* values[N_METRICS];
+    for(int m = 0; m < N_METRICS; m++){
+      columns[m].resize(ARCHIVE_BLOCK_SIZE);
+      values[m] = columns[m].data();
+    }
+    for(uint32_t b = 0; b < file.header->n_blocks; b++){
+      const block_zone_t* zone = &file.zones[b];
+      if(zone->device >= file.header->n_devices || !block_decode(&file, zone, times.data(), values)){
+        fprintf(stderr, "%s: damaged block %u\n", path, b);
+        archive_close(&file);
+        return false;
+      }
+      std::vector<sample_t>* samples = &(*devices)[std::string(file.names + zone->device * ARCHIVE_NAME_SIZE)];
+      for(uint32_t i = 0; i < zone->count; i++){
+        sample_t s;
+        s.time_ms = times[i];
+        for(int m = 0; m < N_METRICS; m++)
+          s.value[m] = values[m][i];
+        samples->push_back(s);
+      }
+    }
+    archive_close(&file);
+  }
+  // sort and drop samples that were imported twice
+  for(std::map<std::string, std::vector<sample_t> >::iterator it = devices->begin(); it != devices->end(); ++it){
+    std::vector<sample_t>* samples = &it->second;
+    std::stable_sort(samples->begin(), samples->end(), sample_before);
+    size_t n = 0;
+    for(size_t i = 0; i < samples->size(); i++)
+      if(n == 0 || (*samples)[i].time_ms != (*samples)[n - 1].time_ms)
+        (*samples)[n++] = (*samples)[i];
+    samples->resize(n);
+  }
+  return archive_write(dir, day, devices);
+}
+
+static int cmd_import(const char* dir, int argc, char* argv[])
+{
+  mkdir(dir, 0755);
+  for(int i = 0; i < argc; i++){
+    FILE* f = fopen(argv[i], "r");
+    if(f == NULL){
+      perror(argv[i]);
+      return 1;
+    }
+    // day -> device -> samples
+    std::map<uint32_t, std::map<std::string, std::vector<sample_t> > > days;
+    char line[256];
+    unsigned long lines = 0, skipped = 0;
+    while(fgets(line, sizeof(line), f)){
+      // device,time_ms,temperature_C,humidity_pct,pressure_Pa
+      char* fields[5];
+      char* p = line;
+      int n = 0;
+      while(n < 5){
+        fields[n++] = p;
+        p = strchr(p, ',');
+        if(p == NULL)
+          break;
+        *p++ = 0;
+      }
+      char* end;
+      sample_t s;
+      s.time_ms = n == 5 ? strtoll(fields[1], &end, 10) : 0;
+      if(n != 5 || end == fields[1] || fields[0][0] == 0){
+        // the header line or something that is not a sample
+        skipped++;
+        continue;
+      }
+      // an empty field is a failed sensor read
+      for(int m = 0; m < N_METRICS; m++){
+        double value = strtod(fields[2 + m], &end);
+        s.value[m] = end == fields[2 + m] || !isfinite(value) ? VALUE_MISSING : (int32_t)lround(value * FIXED_SCALE);
+      }
+      days[day_of(s.time_ms)][fields[0]].push_back(s);
+      lines++;
+    }
+    fclose(f);
+    for(std::map<uint32_t, std::map<std::string, std::vector<sample_t> > >::iterator it = days.begin(); it != days.end(); ++it)
+      if(!import_day(dir, it->first, &it->second))
+        return 1;
+    printf("%s: %lu samples, %lu lines skipped, %u days\n", argv[i], lines, skipped, (unsigned int)days.size());
+  }
+  return 0;
+}
+
+struct Query {
+  const char* device;
+  int64_t from;
+  int64_t to;
+  int metric;
+  bool has_above;
+  bool has_below;
+  int32_t above;
+  int32_t below;
+  int64_t bucket_ms;
+  // statistics of the zone maps
+  unsigned long blocks;
+  unsigned long skipped;
+  unsigned long from_zone;
+};
+
+// count: all samples, n: the samples with a value of the metric
+struct Aggregate {
+  uint64_t count;
+  uint64_t n[N_METRICS];
+  int32_t min[N_METRICS];
+  int32_t max[N_METRICS];
+  int64_t sum[N_METRICS];
+};
+
+static bool zone_outside(const Query* q, const ArchiveFile* file, const block_zone_t* zone)
+{
+  if(zone->t_max < q->from || zone->t_min >= q->to)
+    return true;
+  if(q->device && strncmp(q->device, file->names + zone->device * ARCHIVE_NAME_SIZE, ARCHIVE_NAME_SIZE) != 0)
+    return true;
+  if(q->has_above && zone->metric[q->metric].max <= q->above)
+    return true;
+  if(q->has_below && zone->metric[q->metric].min >= q->below)
+    return true;
+  return false;
+}
+
+static void aggregate_add(Aggregate* agg, int32_t value[N_METRICS])
+{
+  for(int m = 0; m < N_METRICS; m++){
+    if(value[m] == VALUE_MISSING)
+      continue;
+    if(agg->n[m] == 0 || value[m] < agg->min[m])
+      agg->min[m] = value[m];
+    if(agg->n[m] == 0 || value[m] > agg->max[m])
+      agg->max[m] = value[m];
+    agg->sum[m] += value[m];
+    agg->n[m]++;
+  }
+  agg->count++;
+}
+
+static void aggregate_zone(Aggregate* agg, const block_zone_t* zone)
+{
+  for(int m = 0; m < N_METRICS; m++){
+    if(zone->metric[m].count == 0)
+      continue;
+    if(agg->n[m] == 0 || zone->metric[m].min < agg->min[m])
+      agg->min[m] = zone->metric[m].min;
+    if(agg->n[m] == 0 || zone->metric[m].max > agg->max[m])
+      agg->max[m] = zone->metric[m].max;
+    agg->sum[m] += zone->metric[m].sum;
+    agg->n[m] += zone->metric[m].count;
+  }
+  agg->count += zone->count;
+}
+
+static void aggregate_print(int64_t bucket, const Aggregate* agg)
+{
+  if(agg->count == 0)
+    return;
+  printf("%lld,%llu", (long long)bucket, (unsigned long long)agg->count);
+  for(int m = 0; m < N_METRICS; m++){
+    if(agg->n[m] == 0)
+      printf(",,,");
+    else
+      printf(",%.2f,%.2f,%.3f", agg->min[m] / FIXED_SCALE, agg->max[m] / FIXED_SCALE,
+             (double)agg->sum[m] / agg->n[m] / FIXED_SCALE);
+  }
+  printf("\n");
+}
+
+// a missing value is an empty field
+static void print_value(int32_t value)
+{
+  if(value != VALUE_MISSING)
+    printf(",%.2f", value / FIXED_SCALE);
+  else
+    printf(",");
+}
+
+// query and agg share the scan: files by name, blocks by zone map,
+// complete blocks of an aggregate straight from the zone map
+static int run_query(const char* dir, Query* q, bool aggregate)
+{
+  double start = now_s();
+  std::vector<ArchiveFile> files = archive_files(dir, q->from, q->to);
+  std::vector<int64_t> times(ARCHIVE_BLOCK_SIZE);
+  std::vector<int32_t> columns[N_METRICS];
+  int32_t* values[N_METRICS];
+  for(int m = 0; m < N_METRICS; m++){
+    columns[m].resize(ARCHIVE_BLOCK_SIZE);
+    values[m] = columns[m].data();
+  }
+  // bucket start -> aggregate, a single bucket without -b
+  std::map<int64_t, Aggregate> buckets;
+  unsigned long long rows = 0;
+
+  if(aggregate)
+    printf("bucket_ms,count");
+  else
+    printf("device,time_ms");
+  for(int m = 0; m < N_METRICS; m++){
+    if(aggregate)
+      printf(",%s_min,%s_max,%s_mean", metric_names[m], metric_names[m], metric_names[m]);
+    else
+      printf(",%s", metric_columns[m]);
+  }
+  printf("\n");
+
+  for(size_t f = 0; f < files.size(); f++){
+    ArchiveFile* file = &files[f];
+    if(!archive_open(file))
+      continue;
+    for(uint32_t b = 0; b < file->header->n_blocks; b++){
+      const block_zone_t* zone = &file->zones[b];
+      q->blocks++;
+      if(zone->device >= file->header->n_devices || zone_outside(q, file, zone)){
+        q->skipped++;
+        continue;
+      }
+      int64_t bucket = q->bucket_ms ? zone->t_min - ((zone->t_min % q->bucket_ms) + q->bucket_ms) % q->bucket_ms : 0;
+      bool inside = zone->t_min >= q->from && zone->t_max < q->to &&
+                    (q->bucket_ms == 0 || zone->t_max < bucket + q->bucket_ms);
+      if(aggregate && inside){
+        aggregate_zone(&buckets[bucket], zone);
+        q->from_zone++;
+        continue;
+      }
+      if(!block_decode(file, zone, times.data(), values)){
+        fprintf(stderr, "%s: damaged block %u\n", file->path.c_str(), b);
+        continue;
+      }
+      const char* name = file->names + zone->device * ARCHIVE_NAME_SIZE;
+      for(uint32_t i = 0; i < zone->count; i++){
+        if(times[i] < q->from || times[i] >= q->to)
+          continue;
+        int32_t value[N_METRICS] = {values[0][i], values[1][i], values[2][i]};
+        if(aggregate){
+          int64_t t = times[i];
+          bucket = q->bucket_ms ? t - ((t % q->bucket_ms) + q->bucket_ms) % q->bucket_ms : 0;
+          aggregate_add(&buckets[bucket], value);
+          continue;
+        }
+        // a missing value of the filtered metric matches neither -g nor -l
+        if((q->has_above || q->has_below) && value[q->metric] == VALUE_MISSING)
+          continue;
+        if((q->has_above && value[q->metric] <= q->above) || (q->has_below && value[q->metric] >= q->below))
+          continue;
+        printf("%.*s,%lld", ARCHIVE_NAME_SIZE, name, (long long)times[i]);
+        for(int m = 0; m < N_METRICS; m++)
+          print_value(value[m]);
+        printf("\n");
+        rows++;
+      }
+    }
+    archive_close(file);
+  }
+  for(std::map<int64_t, Aggregate>::iterator it = buckets.begin(); it != buckets.end(); ++it){
+    aggregate_print(it->first, &it->second);
+    rows++;
+  }
+  fflush(stdout);
+  fprintf(stderr, "%llu rows, %u files, %lu blocks: %lu skipped by the zone maps, %lu aggregated from the zone maps, %.2f ms\n",
+          rows, (unsigned int)files.size(), q->blocks, q->skipped, q->from_zone, (now_s() - start) * 1000.0);
+  return 0;
+}
+
+static int cmd_info(const char* dir)
+{
+  std::vector<ArchiveFile> files = archive_files(dir, INT64_MIN / 2, INT64_MAX / 2);
+  uint64_t samples = 0, bytes = 0, column_bytes[1 + N_METRICS] = {0};
+  printf("file              devices  blocks    samples      bytes  bytes/sample\n");
+  for(size_t f = 0; f < files.size(); f++){
+    ArchiveFile* file = &files[f];
+    if(!archive_open(file))
+      continue;
+    const archive_header_t* h = file->header;
+    for(uint32_t b = 0; b < h->n_blocks; b++)
+      for(int c = 0; c <= N_METRICS; c++)
+        column_bytes[c] += file->zones[b].size[c];
+    printf("%-16s %8u %7u %10llu %10llu %13.2f\n", strrchr(file->path.c_str(), '/') + 1, h->n_devices, h->n_blocks,
+           (unsigned long long)h->samples, (unsigned long long)file->size, h->samples ? (double)file->size / h->samples : 0.0);
+    samples += h->samples;
+    bytes += file->size;
+    archive_close(file);
+  }
+  printf("%u files, %llu samples, %llu bytes (%.2f bytes/sample, CSV ~50)\n", (unsigned int)files.size(),
+         (unsigned long long)samples, (unsigned long long)bytes, samples ? (double)bytes / samples : 0.0);
+  if(samples)
+    printf("columns in bytes/sample: time %.2f, temperature %.2f, humidity %.2f, pressure %.2f\n",
+           (double)column_bytes[0] / samples, (double)column_bytes[1] / samples,
+           (double)column_bytes[2] / samples, (double)column_bytes[3] / samples);
+  return 0;
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr, "usage: %s import <archive> <csv> ...\n"
+                  "       %s query <archive> [-d device] [-f from] [-t to] [-m metric [-g value] [-l value]]\n"
+                  "       %s agg <archive> [-d device] [-f from] [-t to] [-b seconds]\n"
+                  "       %s info <archive>\n", name, name, name, name);
+}
+
+int main(int argc, char* argv[])
+{
+  if(argc < 3){
+    usage(argv[0]);
+    return 1;
+  }
+  const char* cmd = argv[1];
+  const char* dir = argv[2];
+  if(strcmp(cmd, "import") == 0)
+    return cmd_import(dir, argc - 3, argv + 3);
+  if(strcmp(cmd, "info") == 0)
+    return cmd_info(dir);
+  bool aggregate = strcmp(cmd, "agg") == 0;
+  if(!aggregate && strcmp(cmd, "query") != 0){
+    usage(argv[0]);
+    return 1;
+  }
+
+  Query q;
+  memset(&q, 0, sizeof(q));
+  q.from = INT64_MIN / 2;
+  q.to = INT64_MAX / 2;
+  q.metric = -1;
+  int opt;
+  optind = 3;
+  while((opt = getopt(argc, argv, aggregate ? "d:f:t:b:" : "d:f:t:m:g:l:")) != -1){
+    switch(opt){
+      case 'd': q.device = optarg; break;
+      case 'f':
+      case 't':
+        if(!parse_time(optarg, opt == 'f' ? &q.from : &q.to)){
+          fprintf(stderr, "invalid time: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'm': q.metric = metric_index(optarg); break;
+      case 'g': q.has_above = true; q.above = (int32_t)lround(atof(optarg) * FIXED_SCALE); break;
+      case 'l': q.has_below = true; q.below = (int32_t)lround(atof(optarg) * FIXED_SCALE); break;
+      case 'b': q.bucket_ms = atoll(optarg) * 1000; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if((q.has_above || q.has_below) && q.metric < 0){
+    fprintf(stderr, "-g and -l need a metric (-m temperature|humidity|pressure)\n");
+    return 1;
+  }
+  return run_query(dir, &q, aggregate);
+}
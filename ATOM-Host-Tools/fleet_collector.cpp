@@ -0,0 +1,827 @@
+/******************************************************************************
+ * M5ATOM ENV fleet collector
+ * Polls many ATOM-Web-Monitor devices from one Linux host and stores their
+ * samples. All devices share one epoll loop (no thread per device); every
+ * poll is a short HTTP request for /update.bin?seq=n, so each sample is
+ * transferred only once. The device millis() of every sample is mapped to
+ * UTC with the request round trip, and the samples are appended in batches
+ * to one CSV file per UTC day in the output directory.
+ *
+ * With -S the collector forks a simulator that serves n fake devices on
+ * consecutive local ports, to load-test the collector with thousands of
+ * endpoints. The statistics line shows the ingest throughput and the lag
+ * (time from the measurement to the disk) over all devices.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -I../ATOM-Web-Monitor/src -o fleet_collector \
+ *       fleet_collector.cpp
+ *
+ * usage:
+ *   fleet_collector [options] [host[:port] ...]
+ *   -f file      read the device list from a file (one host[:port] per line)
+ *   -i ms        poll interval per device (default 3000)
+ *   -c n         max. number of parallel requests (default 256)
+ *   -o dir       output directory (default ., "-" to store nothing)
+ *   -b bytes     write batch size (default 262144)
+ *   -t seconds   stop after the given time (default: run until Ctrl+C)
+ *   -r seconds   statistics interval (default 10)
+ *   -S n         simulate n devices on 127.0.0.1 and collect from them
+ *   -P port      first port of the simulated devices (default 20000)
+ *   -s ms        measurement interval of the simulated devices (default 1000)
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "HistoryFormat.h"
+#include "EnvSample.h"
+
+// largest response of a device: the complete history plus the HTTP header
+#define MAX_RESPONSE   (HISTORY_BIN_HEADER_SIZE + 1200 * HISTORY_BIN_RECORD_SIZE + 1024)
+#define REQUEST_TIMEOUT_MS 5000
+// longest retry interval for unreachable devices
+#define BACKOFF_MAX_MS 60000
+
+static volatile bool running = true;
+
+static void on_signal(int)
+{
+  running = false;
+}
+
+static uint64_t mono_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static int64_t epoch_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void raise_fd_limit()
+{
+  struct rlimit rl;
+  if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+// ===============================================================
+// simulated devices
+// ===============================================================
+// every simulated device answers /history.bin and /update.bin like the
+// firmware. The samples are computed from the seq, so a device needs
+// no memory besides its start time.
+
+struct SimDevice {
+  int listen_fd;
+  uint64_t boot_ms;
+  float phase;
+};
+
+struct SimConn {
+  int fd;
+  int device;
+  std::vector<uint8_t> out;
+  size_t sent;
+};
+
+static void sim_sample(const SimDevice* dev, uint32_t seq, uint32_t sample_ms, history_record_t* rec)
+{
+  float t = seq * sample_ms / 60000.0f + dev->phase;
+  rec->time_ms = seq * sample_ms + 7;
+  rec->temperature = (int16_t)lroundf((21.0f + 2.0f * sinf(t)) * 100.0f);
+  rec->humidity = (uint16_t)lroundf((45.0f + 5.0f * cosf(t)) * 100.0f);
+  rec->pressure = (uint32_t)lroundf((101325.0f + 50.0f * sinf(t * 0.3f)) * 100.0f);
+}
+
+static void sim_response(const SimDevice* dev, const char* request, uint32_t sample_ms, std::vector<uint8_t>* out)
+{
+  uint32_t now = (uint32_t)(mono_ms() - dev->boot_ms);
+  uint32_t next_seq = now / sample_ms + 1;
+  uint32_t first_seq = next_seq > 1200 ? next_seq - 1200 : 0;
+  uint32_t from_seq = first_seq;
+  char header[160];
+  int len;
+
+  if(strncmp(request, "GET /update.bin", 15) == 0){
+    const char* p = strstr(request, "seq=");
+    from_seq = p ? (uint32_t)strtoul(p + 4, NULL, 10) : 0;
+  } else if(strncmp(request, "GET /history.bin", 16) != 0){
+    len = snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    out->assign(header, header + len);
+    return;
+  }
+  // the same clamping as History::clampSeq()
+  if(from_seq < first_seq)
+    from_seq = first_seq;
+  if(from_seq > next_seq)
+    from_seq = next_seq;
+  uint16_t n = next_seq - from_seq;
+  len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-type:application/octet-stream\r\n"
+                 "Cache-Control: no-store\r\nContent-Length: %u\r\n\r\n",
+                 (unsigned int)(HISTORY_BIN_HEADER_SIZE + n * HISTORY_BIN_RECORD_SIZE));
+  out->resize(len + HISTORY_BIN_HEADER_SIZE + n * HISTORY_BIN_RECORD_SIZE);
+  memcpy(out->data(), header, len);
+  uint8_t* p = out->data() + len;
+  p += history_bin_encode_header(n, from_seq, now, p);
+  for(uint32_t seq = from_seq; seq < next_seq; seq++){
+    history_record_t rec;
+    sim_sample(dev, seq, sample_ms, &rec);
+    p += history_bin_encode_record(&rec, p);
+  }
+}
+
+static void sim_close(int epfd, std::vector<SimConn*>* conns, SimConn* conn)
+{
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+  (*conns)[conn->fd] = NULL;
+  delete conn;
+}
+
+static void sim_run(std::vector<SimDevice>* devices, uint32_t sample_ms)
+{
+  int epfd = epoll_create1(0);
+  std::vector<SimConn*> conns;
+  struct epoll_event ev;
+
+  for(size_t i = 0; i < devices->size(); i++){
+    ev.events = EPOLLIN;
+    // listening sockets are tagged with the negative device index
+    ev.data.u64 = (uint64_t)(-(int64_t)i - 1);
+    epoll_ctl(epfd, EPOLL_CTL_ADD, (*devices)[i].listen_fd, &ev);
+  }
+  struct epoll_event events[256];
+  while(running){
+    int n = epoll_wait(epfd, events, 256, 200);
+    for(int e = 0; e < n; e++){
+      int64_t tag = (int64_t)events[e].data.u64;
+      if(tag < 0){
+        int device = (int)(-tag - 1);
+        int fd;
+        while((fd = accept4((*devices)[device].listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0){
+          if((size_t)fd >= conns.size())
+            conns.resize(fd + 1024, NULL);
+          SimConn* conn = new SimConn();
+          conn->fd = fd;
+          conn->device = device;
+          conn->sent = 0;
+          conns[fd] = conn;
+          ev.events = EPOLLIN;
+          ev.data.u64 = fd;
+          epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+        continue;
+      }
+      SimConn* conn = conns[tag];
+      if(conn == NULL)
+        continue;
+      if(conn->out.empty()){
+        char request[512];
+        ssize_t len = read(conn->fd, request, sizeof(request) - 1);
+        if(len <= 0){
+          if(len == 0 || errno != EAGAIN)
+            sim_close(epfd, &conns, conn);
+          continue;
+        }
+        // the request line always arrives in the first segment
+        request[len] = 0;
+        sim_response(&(*devices)[conn->device], request, sample_ms, &conn->out);
+      }
+      ssize_t len = write(conn->fd, conn->out.data() + conn->sent, conn->out.size() - conn->sent);
+      if(len > 0)
+        conn->sent += len;
+      if(conn->sent == conn->out.size() || (len < 0 && errno != EAGAIN)){
+        // like the firmware: close after the response
+        sim_close(epfd, &conns, conn);
+      } else {
+        ev.events = EPOLLOUT;
+        ev.data.u64 = conn->fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+      }
+    }
+  }
+}
+
+static pid_t sim_start(int n, int base_port, uint32_t sample_ms, std::vector<std::string>* hosts)
+{
+  std::vector<SimDevice> devices;
+  uint64_t now = mono_ms();
+  srand((unsigned int)now);
+  for(int i = 0; i < n; i++){
+    SimDevice dev;
+    struct sockaddr_in addr;
+    int yes = 1;
+    dev.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    setsockopt(dev.listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(base_port + i);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(dev.listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(dev.listen_fd, 64) < 0){
+      fprintf(stderr, "simulated device on port %i: %s\n", base_port + i, strerror(errno));
+      exit(1);
+    }
+    // devices that run for up to one hour already, so some of them
+    // start with a full history
+    dev.boot_ms = now - (uint64_t)(rand() % 3600000);
+    dev.phase = i * 0.7f;
+    devices.push_back(dev);
+    char host[32];
+    snprintf(host, sizeof(host), "127.0.0.1:%i", base_port + i);
+    hosts->push_back(host);
+  }
+  // the sockets are listening before the fork, so the collector
+  // can connect right away
+  pid_t pid = fork();
+  if(pid == 0){
+    sim_run(&devices, sample_ms);
+    _exit(0);
+  }
+  for(size_t i = 0; i < devices.size(); i++)
+    close(devices[i].listen_fd);
+  return pid;
+}
+
+// ===============================================================
+// collector
+// ===============================================================
+
+struct Device {
+  std::string name;
+  struct sockaddr_in addr;
+  // seq of the next sample to fetch, -1 until the history is loaded
+  int64_t next_seq;
+  uint64_t due_ms;
+  uint32_t backoff_ms;
+  // clock mapping: device millis() ref_device_ms was UTC ref_epoch_ms
+  bool synced;
+  uint32_t ref_device_ms;
+  int64_t ref_epoch_ms;
+  // round trip of the request the mapping is based on, grows with
+  // its age so that the mapping follows the drift of the device clock
+  double ref_rtt_ms;
+  uint64_t ref_mono_ms;
+  uint32_t last_device_ms;
+  // statistics
+  uint64_t samples;
+  uint64_t lost;
+  uint32_t errors;
+  uint32_t restarts;
+  int64_t lag_ms;
+  int64_t max_lag_ms;
+};
+
+enum conn_state { CONN_CONNECTING, CONN_SENDING, CONN_RECEIVING };
+
+struct Conn {
+  int fd;
+  int device;
+  conn_state state;
+  uint64_t start_ms;
+  int64_t start_epoch_ms;
+  std::string request;
+  size_t sent;
+  std::vector<uint8_t> in;
+};
+
+struct Store {
+  std::string dir;
+  std::string buffer;
+  size_t batch_bytes;
+  int fd;
+  int day;
+  uint64_t last_flush_ms;
+  uint64_t bytes;
+  uint32_t writes;
+};
+
+struct Stats {
+  uint64_t requests;
+  uint64_t samples;
+  uint64_t bytes;
+  uint64_t errors;
+  uint64_t timeouts;
+};
+
+static bool parse_host(const char* spec, Device* dev)
+{
+  char host[256];
+  int port = 80;
+  strncpy(host, spec, sizeof(host) - 1);
+  host[sizeof(host) - 1] = 0;
+  char* colon = strrchr(host, ':');
+  if(colon){
+    *colon = 0;
+    port = atoi(colon + 1);
+  }
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if(getaddrinfo(host, NULL, &hints, &res) != 0){
+    fprintf(stderr, "unknown host: %s\n", host);
+    return false;
+  }
+  memcpy(&dev->addr, res->ai_addr, sizeof(dev->addr));
+  dev->addr.sin_port = htons(port);
+  freeaddrinfo(res);
+  dev->name = spec;
+  return true;
+}
+
+static void store_flush(Store* store)
+{
+  if(store->buffer.empty())
+    return;
+  // one write per batch, O_APPEND keeps the lines of a batch together
+  if(write(store->fd, store->buffer.data(), store->buffer.size()) != (ssize_t)store->buffer.size())
+    perror("write samples");
+  store->bytes += store->buffer.size();
+  store->writes++;
+  store->buffer.clear();
+}
+
+static void store_sample(Store* store, const Device* dev, int64_t time_ms, const history_record_t* rec)
+{
+  if(store->dir == "-")
+    return;
+  // one file per UTC day: the day of the sample, not of the collector
+  time_t t = time_ms / 1000;
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  int day = (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+  if(day != store->day){
+    store_flush(store);
+    if(store->fd >= 0)
+      close(store->fd);
+    char path[512];
+    snprintf(path, sizeof(path), "%s/atom-env-%08i.csv", store->dir.c_str(), day);
+    store->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(store->fd < 0){
+      perror(path);
+      exit(1);
+    }
+    if(lseek(store->fd, 0, SEEK_END) == 0)
+      store->buffer = "device,time_ms,temperature_C,humidity_pct,pressure_Pa\n";
+    store->day = day;
+  }
+  char line[160];
+  int len = snprintf(line, sizeof(line), "%s,%lld,", dev->name.c_str(), (long long)time_ms);
+  // a failed read of the device is an empty field
+  if(rec->temperature != ENV_TEMPERATURE_MISSING)
+    len += snprintf(&line[len], sizeof(line) - len, "%.2f", rec->temperature / 100.0);
+  line[len++] = ',';
+  if(rec->humidity != ENV_HUMIDITY_MISSING)
+    len += snprintf(&line[len], sizeof(line) - len, "%.2f", rec->humidity / 100.0);
+  line[len++] = ',';
+  if(rec->pressure != ENV_PRESSURE_MISSING)
+    len += snprintf(&line[len], sizeof(line) - len, "%.2f", rec->pressure / 100.0);
+  line[len++] = '\n';
+  store->buffer.append(line, len);
+  if(store->buffer.size() >= store->batch_bytes)
+    store_flush(store);
+}
+
+// map the device clock to UTC. The device sent its millis() somewhere
+// between the start of the request and the arrival of the response,
+// the middle of both has an error of at most rtt/2.
+static void sync_clock(Device* dev, uint32_t device_ms, int64_t start_epoch, int64_t end_epoch, uint64_t now)
+{
+  double rtt = (double)(end_epoch - start_epoch);
+  // 0.1 ms per second: an order of magnitude above the drift of a crystal
+  double aged_rtt = dev->ref_rtt_ms + (now - dev->ref_mono_ms) / 10000.0;
+  if(!dev->synced || rtt <= aged_rtt){
+    dev->ref_device_ms = device_ms;
+    dev->ref_epoch_ms = start_epoch + (end_epoch - start_epoch) / 2;
+    dev->ref_rtt_ms = rtt;
+    dev->ref_mono_ms = now;
+    dev->synced = true;
+  }
+}
+
+static int64_t device_time(const Device* dev, uint32_t time_ms)
+{
+  // signed difference: handles the wrap of millis() and samples
+  // that were taken before the reference
+  return dev->ref_epoch_ms + (int32_t)(time_ms - dev->ref_device_ms);
+}
+
+// returns false if the response is not a valid blob
+static bool handle_response(Device* dev, Conn* conn, Store* store, Stats* stats, uint64_t now)
+{
+  const char* data = (const char*)conn->in.data();
+  size_t size = conn->in.size();
+  if(size < 12 || strncmp(data, "HTTP/1.1 200", 12) != 0)
+    return false;
+  const char* body = (const char*)memmem(data, size, "\r\n\r\n", 4);
+  if(body == NULL)
+    return false;
+  body += 4;
+  const uint8_t* blob = (const uint8_t*)body;
+  size_t len = size - (body - data);
+  history_bin_header_t header;
+  if(!history_bin_decode_header(blob, len, &header) ||
+     len < HISTORY_BIN_HEADER_SIZE + (size_t)header.count * header.record_size)
+    return false;
+
+  int64_t end_epoch = epoch_ms();
+  uint32_t device_next = header.first_seq + header.count;
+  stats->bytes += size;
+  // a restarted device counts from 0 again and its clock went back:
+  // load its complete history with the next poll
+  if(dev->next_seq >= 0 &&
+     (device_next < dev->next_seq || (int32_t)(header.now_ms - dev->last_device_ms) < 0)){
+    dev->restarts++;
+    dev->synced = false;
+    dev->next_seq = -1;
+    return true;
+  }
+  bool initial = dev->next_seq < 0;
+  dev->last_device_ms = header.now_ms;
+  sync_clock(dev, header.now_ms, conn->start_epoch_ms, end_epoch, now);
+  if(!initial && header.first_seq > dev->next_seq)
+    dev->lost += header.first_seq - dev->next_seq;
+
+  const uint8_t* p = blob + HISTORY_BIN_HEADER_SIZE;
+  for(uint16_t i = 0; i < header.count; i++, p += header.record_size){
+    uint32_t seq = header.first_seq + i;
+    if(!initial && seq < dev->next_seq)
+      continue;
+    history_record_t rec;
+    history_bin_decode_record(p, &rec);
+    int64_t t = device_time(dev, rec.time_ms);
+    store_sample(store, dev, t, &rec);
+    dev->lag_ms = end_epoch - t;
+    dev->samples++;
+    stats->samples++;
+  }
+  // the history loaded at the start is old by nature
+  if(!initial && dev->lag_ms > dev->max_lag_ms)
+    dev->max_lag_ms = dev->lag_ms;
+  dev->next_seq = device_next;
+  return true;
+}
+
+static void conn_close(int epfd, Conn* conn)
+{
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close(conn->fd);
+  conn->fd = -1;
+}
+
+static void schedule(Device* dev, uint64_t now, uint32_t interval_ms, bool ok)
+{
+  if(ok){
+    dev->backoff_ms = 0;
+    // keep the phase of the device, no bursts after a slow response
+    dev->due_ms += interval_ms;
+    if(dev->due_ms <= now)
+      dev->due_ms = now + interval_ms;
+  } else {
+    // unreachable devices are retried less and less often
+    dev->errors++;
+    dev->backoff_ms = dev->backoff_ms ? std::min(dev->backoff_ms * 2, (uint32_t)BACKOFF_MAX_MS) : interval_ms;
+    dev->due_ms = now + dev->backoff_ms;
+  }
+}
+
+static bool conn_start(int epfd, Conn* conn, Device* dev, int index)
+{
+  conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if(conn->fd < 0)
+    return false;
+  int yes = 1;
+  setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  if(connect(conn->fd, (struct sockaddr*)&dev->addr, sizeof(dev->addr)) < 0 && errno != EINPROGRESS){
+    close(conn->fd);
+    conn->fd = -1;
+    return false;
+  }
+  char request[256];
+  if(dev->next_seq < 0)
+    snprintf(request, sizeof(request), "GET /history.bin HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+             dev->name.c_str());
+  else
+    snprintf(request, sizeof(request), "GET /update.bin?seq=%lld HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+             (long long)dev->next_seq, dev->name.c_str());
+  conn->request = request;
+  conn->sent = 0;
+  conn->in.clear();
+  conn->device = index;
+  conn->state = CONN_CONNECTING;
+  conn->start_ms = mono_ms();
+  conn->start_epoch_ms = epoch_ms();
+  struct epoll_event ev;
+  ev.events = EPOLLOUT;
+  ev.data.ptr = conn;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, conn->fd, &ev);
+  return true;
+}
+
+// returns true when the request is finished (successful or not)
+static bool conn_event(int epfd, Conn* conn, uint32_t events, bool* ok)
+{
+  *ok = false;
+  if(conn->state == CONN_CONNECTING){
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if(err != 0)
+      return true;
+    conn->state = CONN_SENDING;
+  }
+  if(conn->state == CONN_SENDING){
+    ssize_t len = write(conn->fd, conn->request.data() + conn->sent, conn->request.size() - conn->sent);
+    if(len < 0)
+      return errno != EAGAIN;
+    conn->sent += len;
+    if(conn->sent < conn->request.size())
+      return false;
+    conn->state = CONN_RECEIVING;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    return false;
+  }
+  // receiving: the device closes the connection after the response
+  uint8_t buf[16384];
+  for(;;){
+    ssize_t len = read(conn->fd, buf, sizeof(buf));
+    if(len > 0){
+      conn->in.insert(conn->in.end(), buf, buf + len);
+      if(conn->in.size() > MAX_RESPONSE)
+        return true;
+      continue;
+    }
+    if(len == 0){
+      *ok = true;
+      return true;
+    }
+    return errno != EAGAIN || (events & (EPOLLERR | EPOLLHUP));
+  }
+}
+
+static int64_t percentile(std::vector<int64_t>* values, int percent)
+{
+  if(values->empty())
+    return 0;
+  size_t k = (values->size() - 1) * percent / 100;
+  std::nth_element(values->begin(), values->begin() + k, values->end());
+  return (*values)[k];
+}
+
+static void print_stats(std::vector<Device>* devices, Stats* stats, Stats* last, Store* store, double seconds)
+{
+  std::vector<int64_t> lags;
+  size_t active = 0;
+  for(size_t i = 0; i < devices->size(); i++){
+    if((*devices)[i].samples > 0){
+      lags.push_back((*devices)[i].lag_ms);
+      active++;
+    }
+  }
+  printf("%6.0f samples/s %7.1f kB/s %6.0f req/s | devices %u/%u | lag ms p50 %lld p99 %lld max %lld | "
+         "errors %llu timeouts %llu | stored %llu kB in %u writes\n",
+         (stats->samples - last->samples) / seconds, (stats->bytes - last->bytes) / seconds / 1000.0,
+         (stats->requests - last->requests) / seconds, (unsigned int)active, (unsigned int)devices->size(),
+         (long long)percentile(&lags, 50), (long long)percentile(&lags, 99), (long long)percentile(&lags, 100),
+         (unsigned long long)stats->errors, (unsigned long long)stats->timeouts,
+         (unsigned long long)(store->bytes / 1000), store->writes);
+  fflush(stdout);
+  *last = *stats;
+}
+
+static void print_summary(std::vector<Device>* devices)
+{
+  std::vector<Device*> order;
+  for(size_t i = 0; i < devices->size(); i++)
+    order.push_back(&(*devices)[i]);
+  std::sort(order.begin(), order.end(), [](const Device* a, const Device* b) { return a->max_lag_ms > b->max_lag_ms; });
+  printf("devices with the largest lag:\n");
+  printf("%-24s %10s %8s %8s %8s %8s %8s\n", "device", "samples", "lost", "restart", "errors", "lag", "max lag");
+  for(size_t i = 0; i < order.size() && i < 10; i++){
+    Device* dev = order[i];
+    printf("%-24s %10llu %8llu %8u %8u %8lld %8lld\n", dev->name.c_str(), (unsigned long long)dev->samples,
+           (unsigned long long)dev->lost, dev->restarts, dev->errors, (long long)dev->lag_ms, (long long)dev->max_lag_ms);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  uint32_t interval_ms = 3000;
+  int max_parallel = 256;
+  int duration_s = 0;
+  int report_s = 10;
+  int simulate = 0;
+  int sim_port = 20000;
+  uint32_t sim_sample_ms = 1000;
+  const char* device_file = NULL;
+  Store store;
+  store.dir = ".";
+  store.batch_bytes = 256 * 1024;
+  store.fd = -1;
+  store.day = 0;
+  store.last_flush_ms = 0;
+  store.bytes = 0;
+  store.writes = 0;
+  int opt;
+
+  while((opt = getopt(argc, argv, "f:i:c:o:b:t:r:S:P:s:")) != -1){
+    switch(opt){
+      case 'f': device_file = optarg; break;
+      case 'i': interval_ms = atoi(optarg); break;
+      case 'c': max_parallel = atoi(optarg); break;
+      case 'o': store.dir = optarg; break;
+      case 'b': store.batch_bytes = atoi(optarg); break;
+      case 't': duration_s = atoi(optarg); break;
+      case 'r': report_s = atoi(optarg); break;
+      case 'S': simulate = atoi(optarg); break;
+      case 'P': sim_port = atoi(optarg); break;
+      case 's': sim_sample_ms = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-f file] [-i interval_ms] [-c parallel] [-o dir] [-b batch_bytes] [-t seconds]\n"
+                        "          [-r seconds] [-S simulated] [-P port] [-s sample_ms] [host[:port] ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(interval_ms == 0 || max_parallel < 1 || report_s < 1 || sim_sample_ms == 0){
+    fprintf(stderr, "invalid option value\n");
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  raise_fd_limit();
+
+  std::vector<std::string> hosts;
+  for(int i = optind; i < argc; i++)
+    hosts.push_back(argv[i]);
+  if(device_file){
+    FILE* f = fopen(device_file, "r");
+    if(f == NULL){
+      perror(device_file);
+      return 1;
+    }
+    char line[256];
+    while(fgets(line, sizeof(line), f)){
+      char* end = line + strcspn(line, " \t\r\n#");
+      *end = 0;
+      if(line[0])
+        hosts.push_back(line);
+    }
+    fclose(f);
+  }
+  pid_t sim_pid = simulate > 0 ? sim_start(simulate, sim_port, sim_sample_ms, &hosts) : 0;
+
+  std::vector<Device> devices;
+  uint64_t now = mono_ms();
+  for(size_t i = 0; i < hosts.size(); i++){
+    Device dev;
+    if(!parse_host(hosts[i].c_str(), &dev))
+      continue;
+    dev.next_seq = -1;
+    // spread the polls over one interval
+    dev.due_ms = now + (uint64_t)interval_ms * i / hosts.size();
+    dev.backoff_ms = 0;
+    dev.synced = false;
+    dev.ref_rtt_ms = 0;
+    dev.ref_mono_ms = 0;
+    dev.last_device_ms = 0;
+    dev.samples = dev.lost = 0;
+    dev.errors = dev.restarts = 0;
+    dev.lag_ms = dev.max_lag_ms = 0;
+    devices.push_back(dev);
+  }
+  if(devices.empty()){
+    fprintf(stderr, "no devices\n");
+    return 1;
+  }
+  printf("fleet_collector: %u devices, poll every %u ms, %i parallel requests, output %s\n",
+         (unsigned int)devices.size(), interval_ms, max_parallel, store.dir == "-" ? "off" : store.dir.c_str());
+
+  int epfd = epoll_create1(0);
+  std::vector<Conn> conns(max_parallel);
+  std::vector<Conn*> free_conns;
+  for(int i = 0; i < max_parallel; i++){
+    conns[i].fd = -1;
+    free_conns.push_back(&conns[i]);
+  }
+  // devices in the order they are due, the next one is at the front
+  std::vector<std::pair<uint64_t, int> > queue;
+  for(size_t i = 0; i < devices.size(); i++)
+    queue.push_back(std::make_pair(devices[i].due_ms, (int)i));
+  std::make_heap(queue.begin(), queue.end(), std::greater<std::pair<uint64_t, int> >());
+
+  Stats stats, last_stats;
+  memset(&stats, 0, sizeof(stats));
+  last_stats = stats;
+  uint64_t start = mono_ms();
+  uint64_t next_report = start + report_s * 1000ULL;
+  uint64_t next_timeout_check = start;
+  struct epoll_event events[256];
+
+  while(running && (duration_s == 0 || mono_ms() - start < (uint64_t)duration_s * 1000)){
+    now = mono_ms();
+    // start the requests of all due devices as long as a connection is free
+    while(!queue.empty() && queue.front().first <= now && !free_conns.empty()){
+      int index = queue.front().second;
+      std::pop_heap(queue.begin(), queue.end(), std::greater<std::pair<uint64_t, int> >());
+      queue.pop_back();
+      Conn* conn = free_conns.back();
+      if(conn_start(epfd, conn, &devices[index], index)){
+        free_conns.pop_back();
+        stats.requests++;
+      } else {
+        stats.errors++;
+        schedule(&devices[index], now, interval_ms, false);
+        queue.push_back(std::make_pair(devices[index].due_ms, index));
+        std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<uint64_t, int> >());
+      }
+    }
+
+    int timeout = 100;
+    if(!queue.empty() && !free_conns.empty())
+      timeout = queue.front().first > now ? (int)std::min<uint64_t>(queue.front().first - now, 100) : 0;
+    int n = epoll_wait(epfd, events, 256, timeout);
+    now = mono_ms();
+    for(int e = 0; e < n; e++){
+      Conn* conn = (Conn*)events[e].data.ptr;
+      bool ok;
+      if(conn->fd < 0 || !conn_event(epfd, conn, events[e].events, &ok))
+        continue;
+      Device* dev = &devices[conn->device];
+      if(ok)
+        ok = handle_response(dev, conn, &store, &stats, now);
+      if(!ok)
+        stats.errors++;
+      conn_close(epfd, conn);
+      free_conns.push_back(conn);
+      schedule(dev, now, interval_ms, ok);
+      queue.push_back(std::make_pair(dev->due_ms, conn->device));
+      std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<uint64_t, int> >());
+    }
+
+    if(now >= next_timeout_check){
+      next_timeout_check = now + 250;
+      for(size_t i = 0; i < conns.size(); i++){
+        Conn* conn = &conns[i];
+        if(conn->fd < 0 || now - conn->start_ms < REQUEST_TIMEOUT_MS)
+          continue;
+        stats.timeouts++;
+        conn_close(epfd, conn);
+        free_conns.push_back(conn);
+        schedule(&devices[conn->device], now, interval_ms, false);
+        queue.push_back(std::make_pair(devices[conn->device].due_ms, conn->device));
+        std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<uint64_t, int> >());
+      }
+    }
+    // small fleets do not fill a batch: write at least once per second
+    if(now - store.last_flush_ms >= 1000){
+      store_flush(&store);
+      store.last_flush_ms = now;
+    }
+    if(now >= next_report){
+      print_stats(&devices, &stats, &last_stats, &store, (now - next_report + report_s * 1000.0) / 1000.0);
+      next_report = now + report_s * 1000ULL;
+    }
+  }
+
+  store_flush(&store);
+  if(store.fd >= 0)
+    close(store.fd);
+  if(sim_pid > 0){
+    kill(sim_pid, SIGTERM);
+    waitpid(sim_pid, NULL, 0);
+  }
+  print_summary(&devices);
+  return 0;
+}
@@ -0,0 +1,257 @@
+/******************************************************************************
+ * M5ATOM ENV fleet simulator
+ * Runs several simulated ATOM-Web-Monitor nodes on one Linux host.
+ * Every node multicasts a FleetPacket per measurement like the firmware
+ * does, and an optional aggregator collects them with the same FleetPeers
+ * table as the device and serves /api/fleet on a local HTTP port.
+ * Real monitors in the same network show up in the aggregator as well.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -I../ATOM-Web-Monitor/src -o fleet_sim \
+ *       fleet_sim.cpp ../ATOM-Web-Monitor/src/FleetPeers.cpp
+ *
+ * usage:
+ *   fleet_sim [-n nodes] [-i interval_ms] [-l loss_percent]
+ *             [-p http_port] [-t seconds] [-a] [-s] [-I interface_ip]
+ *   -a  aggregator only (no simulated nodes)
+ *   -s  simulated nodes only (no aggregator)
+ *   -I  interface for the multicast traffic (default 127.0.0.1)
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <vector>
+
+#include "FleetPacket.h"
+#include "FleetPeers.h"
+
+static uint32_t now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+struct SimNode {
+  uint32_t node_id;
+  uint32_t seq;
+  uint32_t next_ms;
+  float phase;
+};
+
+static int open_sender(const char* interface_ip)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct in_addr iface;
+  unsigned char loop = 1, ttl = 1;
+  inet_pton(AF_INET, interface_ip, &iface);
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  return fd;
+}
+
+static int open_receiver(const char* interface_ip)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int yes = 1;
+  struct sockaddr_in addr;
+  struct ip_mreq mreq;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(FLEET_MULTICAST_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0){
+    perror("bind multicast port");
+    exit(1);
+  }
+  uint8_t group[4] = {FLEET_MULTICAST_GROUP};
+  memcpy(&mreq.imr_multiaddr.s_addr, group, 4);
+  inet_pton(AF_INET, interface_ip, &mreq.imr_interface);
+  if(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0){
+    perror("join multicast group");
+    exit(1);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+static int open_http(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  struct sockaddr_in addr;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0){
+    perror("http port");
+    exit(1);
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+// the same JSON as /api/fleet of the firmware
+static void serve_http(int listen_fd, FleetPeers* peers)
+{
+  int fd = accept(listen_fd, NULL, NULL);
+  if(fd < 0)
+    return;
+  char request[512];
+  // the request is small, one read is enough for this tool
+  struct pollfd pfd = {fd, POLLIN, 0};
+  poll(&pfd, 1, 200);
+  ssize_t n = read(fd, request, sizeof(request) - 1);
+  request[n > 0 ? n : 0] = 0;
+
+  std::vector<char> body;
+  char json[256];
+  uint32_t now = now_ms();
+  int n_peers = 0;
+  int len = snprintf(json, sizeof(json), "{\"node\":\"host\",\"aggregator\":true,\"rejected\":%u,\"peers\":[",
+                     (unsigned int)peers->rejected);
+  body.insert(body.end(), json, json + len);
+  for(int i = 0; i < peers->size(); i++){
+    size_t plen = peers->formatJson(i, json, sizeof(json), now);
+    if(plen == 0)
+      continue;
+    if(n_peers++ > 0)
+      body.push_back(',');
+    body.insert(body.end(), json, json + plen);
+  }
+  body.push_back(']');
+  body.push_back('}');
+
+  const char* status = strncmp(request, "GET /api/fleet", 14) == 0 ? "200 OK" : "404 Not Found";
+  len = snprintf(json, sizeof(json), "HTTP/1.1 %s\r\nContent-type:application/json\r\nContent-Length: %u\r\n"
+                 "Connection: close\r\n\r\n", status, (unsigned int)(status[0] == '2' ? body.size() : 0));
+  if(write(fd, json, len) < 0 || (status[0] == '2' && write(fd, body.data(), body.size()) < 0))
+    perror("http write");
+  close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+  int n_nodes = 8;
+  int interval_ms = 3000;
+  int loss_percent = 0;
+  int http_port = 8080;
+  int duration_s = 0;
+  bool run_nodes = true;
+  bool run_aggregator = true;
+  const char* interface_ip = "127.0.0.1";
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:i:l:p:t:asI:")) != -1){
+    switch(opt){
+      case 'n': n_nodes = atoi(optarg); break;
+      case 'i': interval_ms = atoi(optarg); break;
+      case 'l': loss_percent = atoi(optarg); break;
+      case 'p': http_port = atoi(optarg); break;
+      case 't': duration_s = atoi(optarg); break;
+      case 'a': run_nodes = false; break;
+      case 's': run_aggregator = false; break;
+      case 'I': interface_ip = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n nodes] [-i interval_ms] [-l loss_percent] [-p http_port] [-t seconds] [-a] [-s] [-I interface_ip]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  int tx_fd = open_sender(interface_ip);
+  int rx_fd = run_aggregator ? open_receiver(interface_ip) : -1;
+  int http_fd = run_aggregator ? open_http(http_port) : -1;
+  FleetPeers* peers = new FleetPeers();
+
+  std::vector<SimNode> nodes;
+  uint32_t start = now_ms();
+  srand(start);
+  for(int i = 0; run_nodes && i < n_nodes; i++){
+    SimNode node;
+    node.node_id = 0x51000000 | (uint32_t)i;
+    node.seq = 0;
+    // spread the first packets over one interval
+    node.next_ms = start + (uint32_t)((uint64_t)interval_ms * i / n_nodes);
+    node.phase = i * 0.7f;
+    nodes.push_back(node);
+  }
+  struct sockaddr_in group_addr;
+  memset(&group_addr, 0, sizeof(group_addr));
+  group_addr.sin_family = AF_INET;
+  group_addr.sin_port = htons(FLEET_MULTICAST_PORT);
+  uint8_t group[4] = {FLEET_MULTICAST_GROUP};
+  memcpy(&group_addr.sin_addr.s_addr, group, 4);
+
+  printf("fleet_sim: %u simulated nodes, aggregator %s", (unsigned int)nodes.size(), run_aggregator ? "on" : "off");
+  if(run_aggregator)
+    printf(", http://127.0.0.1:%i/api/fleet", http_port);
+  printf("\n");
+
+  uint32_t sent = 0, dropped = 0, received = 0;
+  while(duration_s == 0 || (now_ms() - start) < (uint32_t)duration_s * 1000){
+    uint32_t now = now_ms();
+    int timeout = 50;
+    for(size_t i = 0; i < nodes.size(); i++){
+      SimNode* node = &nodes[i];
+      if((int32_t)(now - node->next_ms) < 0)
+        continue;
+      node->next_ms += interval_ms;
+      float t = (now - start) / 60000.0f + node->phase;
+      fleet_packet_t packet;
+      uint8_t buf[FLEET_PACKET_SIZE];
+      packet.node_id = node->node_id;
+      packet.seq = node->seq++;
+      packet.uptime_ms = now - start;
+      packet.temperature = (int16_t)lroundf((21.0f + 2.0f * sinf(t)) * 100.0f);
+      packet.humidity = (uint16_t)lroundf((45.0f + 5.0f * cosf(t)) * 100.0f);
+      packet.pressure = (uint32_t)lroundf((101325.0f + 50.0f * sinf(t * 0.3f)) * 100.0f);
+      // simulated packet loss
+      if(loss_percent > 0 && (rand() % 100) < loss_percent){
+        dropped++;
+        continue;
+      }
+      fleet_packet_encode(&packet, buf);
+      if(sendto(tx_fd, buf, sizeof(buf), 0, (struct sockaddr*)&group_addr, sizeof(group_addr)) == sizeof(buf))
+        sent++;
+    }
+
+    if(run_aggregator){
+      struct pollfd pfd[2] = {{rx_fd, POLLIN, 0}, {http_fd, POLLIN, 0}};
+      if(poll(pfd, 2, timeout) > 0){
+        uint8_t buf[64];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len;
+        while((len = recvfrom(rx_fd, buf, sizeof(buf), 0, (struct sockaddr*)&from, &from_len)) > 0){
+          fleet_packet_t packet;
+          if(fleet_packet_decode(buf, len, &packet)){
+            peers->update(&packet, from.sin_addr.s_addr, now_ms());
+            received++;
+          }
+          from_len = sizeof(from);
+        }
+        if(pfd[1].revents & POLLIN)
+          serve_http(http_fd, peers);
+      }
+    } else {
+      usleep(timeout * 1000);
+    }
+  }
+  printf("sent %u, dropped (simulated) %u, received %u, rejected %u\n",
+         sent, dropped, received, (unsigned int)peers->rejected);
+  return 0;
+}
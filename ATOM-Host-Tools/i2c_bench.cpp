@@ -0,0 +1,347 @@
+/******************************************************************************
+ * M5ATOM ENV I2C driver benchmark
+ * Runs the SHT3X and QMP6988 drivers of the firmware on the emulated ENV
+ * unit of I2CMock.h through the transaction recorder of I2CRecorder.h.
+ * For every acquisition scenario it reports per measurement the I2C
+ * transactions, the bytes written and read, the bus time at the bus
+ * clock and the host time of driver and mock together; the values of
+ * the last measurement are checked against the ones of the mock.
+ * The queued scenarios run the drivers on the transfer queue of
+ * I2CQueue.h (callbacks). "registers queued" is a synthetic case for the
+ * merging of the queue: one 1 byte read per QMP6988 calibration register
+ * becomes one burst, checked against the burst read of the driver.
+ * The fault scenario holds the bus of the mock and runs the sensor
+ * health of SensorHealth.h like loop() does: the failed read recovers
+ * the bus and is repeated within the same sample. It reports the lost
+ * samples, the time of the recovery (clock-out and new init of both
+ * sensors) and the outage on the virtual clock.
+ * -v prints the transactions of one measurement per scenario.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -I../ATOM-Web-Monitor/src -o i2c_bench i2c_bench.cpp \
+ *       ../ATOM-Web-Monitor/src/SHT3X.cpp ../ATOM-Web-Monitor/src/QMP6988.cpp \
+ *       ../ATOM-Web-Monitor/src/I2CMock.cpp ../ATOM-Web-Monitor/src/I2CRecorder.cpp \
+ *       ../ATOM-Web-Monitor/src/I2CQueue.cpp ../ATOM-Web-Monitor/src/SensorHealth.cpp
+ *
+ * usage:
+ *   i2c_bench [-n count] [-c clock] [-v]
+ *   -n  measurements per scenario (default 10000, 1/100 of it faults)
+ *   -c  I2C clock in Hz for the bus time (default 400000)
+ *   -v  print the transactions of one measurement
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "I2CMock.h"
+#include "I2CRecorder.h"
+#include "I2CQueue.h"
+#include "SHT3X.h"
+#include "QMP6988.h"
+#include "SensorHealth.h"
+
+#define LOG_SIZE 64
+// sample period of the fault scenario
+#define FAULT_PERIOD_MS 1000
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct Bench {
+  I2CMock* mock;
+  I2CRecorder* recorder;
+  SHT3X* sht30;
+  QMP6988* qmp6988;
+  // the same drivers on the queue
+  I2CQueue* queue;
+  SHT3X* sht30_queued;
+  QMP6988* qmp6988_queued;
+  bool pressure_ok;
+  byte sht30_ret;
+  unsigned long count;
+  bool verbose;
+  unsigned long failed;
+};
+
+static void print_log(const I2CRecorder* recorder)
+{
+  char line[128];
+  for(size_t i = 0; i < recorder->count(); i++){
+    I2CRecorder::format(recorder->entry(i), line, sizeof(line));
+    printf("    %s\n", line);
+  }
+}
+
+// one measurement of a scenario, returns false on an error
+typedef bool (*measure_t)(Bench* b);
+
+static void run(Bench* b, const char* name, measure_t measure)
+{
+  unsigned long failed = 0;
+  if(b->verbose){
+    b->recorder->clear();
+    measure(b);
+    printf("%s:\n", name);
+    print_log(b->recorder);
+  }
+  b->recorder->clear();
+  double start = now_s();
+  for(unsigned long n = 0; n < b->count; n++){
+    if(!measure(b))
+      failed++;
+  }
+  double seconds = now_s() - start;
+  const i2c_record_stats_t* s = &b->recorder->stats;
+  printf("%-22s %6.2f transactions %6.1f bytes W %6.1f R %7.1f us bus %8.0f ns host",
+         name, (double)s->transactions / b->count, (double)s->bytes_written / b->count,
+         (double)s->bytes_read / b->count, (double)b->recorder->busTime() / b->count,
+         seconds * 1e9 / b->count);
+  if(s->errors)
+    printf(" %5.2f NACK", (double)s->errors / b->count);
+  if(failed)
+    printf(" %lu failed", failed);
+  printf("\n");
+  b->failed += failed;
+}
+
+static bool sht30_single_shot(Bench* b)
+{
+  return b->sht30->get() == 0;
+}
+
+// the periodic mode is started before the run,
+// the host waits on the virtual clock for the next result
+static bool sht30_periodic(Bench* b)
+{
+  while(!b->sht30->poll())
+    b->mock->advance(1000);
+  return b->sht30->read() == 0;
+}
+
+static bool qmp6988_normal(Bench* b)
+{
+  return b->qmp6988->calcPressure() != 0.0F;
+}
+
+static bool qmp6988_forced(Bench* b)
+{
+  if(!b->qmp6988->startForced())
+    return false;
+  while(!b->qmp6988->ready())
+    b->mock->advance(1000);
+  return b->qmp6988->calcPressure() != 0.0F;
+}
+
+static bool qmp6988_init(Bench* b)
+{
+  return b->qmp6988->init(b->recorder, I2C_MOCK_QMP6988_ADDRESS) == 1;
+}
+
+// one sample of the firmware: the SHT30 converts while
+// the QMP6988 (normal mode) is read
+static bool cycle_direct(Bench* b)
+{
+  if(b->sht30->start(SHT3X_REPEATABILITY_HIGH) != 0)
+    return false;
+  bool ok = b->qmp6988->calcPressure() != 0.0F;
+  while(!b->sht30->poll())
+    b->mock->delay(1);
+  return b->sht30->read() == 0 && ok;
+}
+
+static void pressure_done(void* context, float pressure)
+{
+  ((Bench*)context)->pressure_ok = pressure != 0.0F;
+}
+
+static void sht30_done(void* context, byte ret)
+{
+  ((Bench*)context)->sht30_ret = ret;
+}
+
+// the same with the transfers queued like in loop()
+static bool cycle_queued(Bench* b)
+{
+  b->pressure_ok = false;
+  b->sht30_ret = 1;
+  if(b->sht30_queued->start(SHT3X_REPEATABILITY_HIGH) != 0)
+    return false;
+  if(!b->qmp6988_queued->requestPressure(pressure_done, b))
+    return false;
+  while(!b->sht30_queued->poll()){
+    b->queue->process(2000);
+    b->mock->delay(1);
+  }
+  if(b->sht30_queued->requestRead(sht30_done, b) != 0)
+    return false;
+  b->queue->process(2000);
+  return b->sht30_ret == 0 && b->pressure_ok;
+}
+
+static bool qmp6988_init_queued(Bench* b)
+{
+  return b->qmp6988_queued->init(b->queue, I2C_MOCK_QMP6988_ADDRESS) == 1;
+}
+
+static void count_error(void* context, uint8_t result, const uint8_t* /* data */, size_t /* len */)
+{
+  if(result != I2C_OK)
+    (*(unsigned long*)context)++;
+}
+
+// one request per register, the queue merges them into one burst
+static bool registers_queued(Bench* b)
+{
+  uint8_t data[QMP6988_CALIBRATION_DATA_LENGTH];
+  unsigned long errors = 0;
+  for(int i = 0; i < QMP6988_CALIBRATION_DATA_LENGTH; i++){
+    if(!b->queue->submitReadRegister(I2C_MOCK_QMP6988_ADDRESS, QMP6988_CALIBRATION_DATA_START + i,
+                                     &data[i], 1, count_error, &errors))
+      return false;
+  }
+  b->queue->flush();
+  return errors == 0 && memcmp(data, b->qmp6988_queued->calibrationData(), sizeof(data)) == 0;
+}
+
+// good samples, then the bus is held and the next sample fails,
+// the health of the sensors asks for the recovery at once and the
+// sample is read again (one health for both sensors)
+static void fault_recovery(Bench* b, unsigned long faults)
+{
+  const health_config_t config = { 1, 3, 10000, 3 * FAULT_PERIOD_MS };
+  SensorHealth health;
+  unsigned long lost = 0;
+  uint64_t recovery_us = 0;
+
+  health.begin(&config, b->mock->micros() / 1000);
+  for(unsigned long n = 0; n < faults; n++){
+    if(cycle_queued(b))
+      health.success(b->mock->micros() / 1000);
+    b->mock->stick();
+    for(;;){
+      b->mock->delay(FAULT_PERIOD_MS);
+      health.startSample();
+      bool ok = cycle_queued(b);
+      if(!ok){
+        health.failure(b->mock->micros() / 1000);
+        if(health.needsRecovery(b->mock->micros() / 1000)){
+          uint32_t start_us = b->mock->micros();
+          bool init = b->queue->recover() && b->sht30_queued->reset() == 0 &&
+                      b->qmp6988_queued->init(b->queue, I2C_MOCK_QMP6988_ADDRESS) == 1;
+          recovery_us += b->mock->micros() - start_us;
+          health.recovered(init, b->mock->micros() / 1000);
+          // the first conversion after the init
+          b->mock->delay(b->qmp6988_queued->conversionTime() / 1000 + 1);
+          ok = init && cycle_queued(b);
+          if(!ok)
+            health.failure(b->mock->micros() / 1000);
+        }
+      }
+      if(ok){
+        health.success(b->mock->micros() / 1000);
+        break;
+      }
+      lost++;
+    }
+  }
+  const health_stats_t* s = &health.stats;
+  printf("fault recovery: %lu faults, %.1f lost samples of %u ms per fault, "
+         "recovery %.0f us, outage %u ms (max %u)\n",
+         faults, (double)lost / faults, FAULT_PERIOD_MS,
+         s->recoveries ? (double)recovery_us / s->recoveries : 0.0,
+         (unsigned int)s->outage_ms, (unsigned int)s->max_outage_ms);
+  if(s->recoveries != faults || s->recovery_failures != 0 || health.state() != HEALTH_OK){
+    printf("[ERR] %u recoveries, %u failed, state %s\n", (unsigned int)s->recoveries,
+           (unsigned int)s->recovery_failures, health_state_name(health.state()));
+    b->failed++;
+  }
+}
+
+static void check(Bench* b, const char* what, double value, double expected, double tolerance)
+{
+  if(fabs(value - expected) <= tolerance)
+    return;
+  printf("[ERR] %s %.3f, expected %.3f\n", what, value, expected);
+  b->failed++;
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned long count = 10000;
+  uint32_t clock_hz = I2C_MOCK_CLOCK;
+  bool verbose = false;
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:c:v")) != -1){
+    switch(opt){
+      case 'n': count = strtoul(optarg, NULL, 10); break;
+      case 'c': clock_hz = strtoul(optarg, NULL, 10); break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-n count] [-c clock] [-v]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(count == 0 || clock_hz == 0){
+    fprintf(stderr, "count and clock must be > 0\n");
+    return 1;
+  }
+
+  static i2c_transaction_t log[LOG_SIZE];
+  I2CMock mock(clock_hz);
+  I2CRecorder recorder(&mock, log, LOG_SIZE, clock_hz);
+  SHT3X sht30(I2C_MOCK_SHT30_ADDRESS, &recorder);
+  QMP6988 qmp6988;
+  I2CQueue queue(&recorder);
+  SHT3X sht30_queued(I2C_MOCK_SHT30_ADDRESS, &queue);
+  QMP6988 qmp6988_queued;
+
+  Bench b;
+  b.mock = &mock;
+  b.recorder = &recorder;
+  b.sht30 = &sht30;
+  b.qmp6988 = &qmp6988;
+  b.queue = &queue;
+  b.sht30_queued = &sht30_queued;
+  b.qmp6988_queued = &qmp6988_queued;
+  b.count = count;
+  b.verbose = verbose;
+  b.failed = 0;
+
+  printf("I2C clock %u Hz, %lu measurements per scenario\n", (unsigned int)clock_hz, count);
+  run(&b, "QMP6988 init", qmp6988_init);
+  run(&b, "SHT30 single shot", sht30_single_shot);
+  sht30.startPeriodic(SHT3X_MODE_10_MPS, SHT3X_REPEATABILITY_HIGH);
+  run(&b, "SHT30 periodic 10 mps", sht30_periodic);
+  sht30.stop();
+  run(&b, "QMP6988 normal", qmp6988_normal);
+  qmp6988.configure(QMP6988_SLEEP_MODE, QMP6988_OVERSAMPLING_8X, QMP6988_OVERSAMPLING_1X, QMP6988_FILTERCOEFF_4);
+  run(&b, "QMP6988 forced", qmp6988_forced);
+  qmp6988.configure(QMP6988_NORMAL_MODE, QMP6988_OVERSAMPLING_8X, QMP6988_OVERSAMPLING_1X, QMP6988_FILTERCOEFF_4);
+  run(&b, "sample direct", cycle_direct);
+  run(&b, "QMP6988 init queued", qmp6988_init_queued);
+  run(&b, "sample queued", cycle_queued);
+  run(&b, "registers queued", registers_queued);
+  printf("queue: %u requests, %u merged into bursts, largest fill %u\n",
+         (unsigned int)queue.stats.submitted, (unsigned int)queue.stats.merged, queue.stats.max_fill);
+
+  fault_recovery(&b, count / 100 > 0 ? count / 100 : 1);
+
+  // the default values of the mock
+  check(&b, "SHT30 temperature", sht30.cTemp, 21.5, 0.01);
+  check(&b, "SHT30 humidity", sht30.humidity, 45.0, 0.01);
+  check(&b, "QMP6988 pressure", qmp6988.calcPressure(), 101325.0, 2.0);
+  check(&b, "QMP6988 pressure queued", qmp6988_queued.calcPressure(), 101325.0, 2.0);
+  printf("%u conversions of the mock, %.3f s virtual time\n",
+         (unsigned int)mock.conversions, mock.micros() / 1e6);
+  return b.failed ? 1 : 0;
+}
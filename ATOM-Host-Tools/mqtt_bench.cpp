@@ -0,0 +1,461 @@
+/******************************************************************************
+ * M5ATOM ENV MQTT benchmark
+ * Runs the MQTTPublisher of the firmware on Linux over TCP against a local
+ * broker stand-in, or against a real broker with -r. The stand-in answers
+ * CONNECT, PUBLISH (PUBACK for QoS 1) and PINGREQ like a broker and checks
+ * the sample numbers of the received messages for gaps and duplicates.
+ * The publisher runs like in loop(): one sample, then one loop() call.
+ * Reports messages per second and bytes per sample (all packets sent by
+ * the publisher) for the batch size and the QoS.
+ * -o n makes the stand-in drop the connection instead of the PUBACK of
+ * every n-th message, the queue of the publisher has to bridge the
+ * outages; the reconnect wait (MQTT_RECONNECT_MS) is skipped on the
+ * clock of the publisher.
+ * -s publishes the samples as a store-and-forward backlog like
+ * store_forward_export() of the firmware: chunks of at most
+ * REPLAY_CHUNK samples cut to replayCapacity(), one chunk per loop()
+ * call. The bench fails if the replay stalls.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -I../ATOM-Web-Monitor/src -o mqtt_bench mqtt_bench.cpp \
+ *       ../ATOM-Web-Monitor/src/MQTTPublisher.cpp
+ *
+ * usage:
+ *   mqtt_bench [-n samples] [-b batch] [-q qos] [-l] [-o n] [-s] [-r host:port]
+ *   -n  samples to publish (default 100000)
+ *   -b  samples per message 1..8 (default 1)
+ *   -q  QoS 0 or 1 (default 1)
+ *   -l  publish the retained last value with every sample
+ *   -o  drop the connection after every n messages (stand-in only)
+ *   -s  replay the samples as a store-and-forward backlog
+ *   -r  real broker instead of the stand-in (no check of the samples)
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <string>
+#include <vector>
+
+#include "MQTTPublisher.h"
+
+// wait for the last messages and acknowledgements
+#define DRAIN_MS 5000
+// samples per replay of the store-and-forward queue (StoreForward::loop())
+#define REPLAY_CHUNK 32
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// clock of the publisher, the bench skips the reconnect waits
+static double start_s;
+static uint32_t clock_offset_ms = 0;
+
+uint32_t millis()
+{
+  return (uint32_t)((now_s() - start_s) * 1000.0) + clock_offset_ms;
+}
+
+static void set_nonblocking(int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Client of the Arduino core over a TCP socket,
+// reads are buffered and never block
+class SocketClient : public Client {
+public:
+  SocketClient() : fd(-1), head(0), tail(0), eof(false) {}
+
+  int connect(const char* host, uint16_t port){
+    struct addrinfo hints, *res;
+    char service[8];
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+    if(getaddrinfo(host, service, &hints, &res) != 0)
+      return 0;
+    fd = socket(res->ai_family, res->ai_socktype, 0);
+    if(fd < 0 || ::connect(fd, res->ai_addr, res->ai_addrlen) < 0){
+      freeaddrinfo(res);
+      stop();
+      return 0;
+    }
+    freeaddrinfo(res);
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    set_nonblocking(fd);
+    head = tail = 0;
+    eof = false;
+    return 1;
+  }
+
+  size_t write(const uint8_t* data, size_t len){
+    size_t written = 0;
+    while(fd >= 0 && written < len){
+      ssize_t n = send(fd, data + written, len - written, MSG_NOSIGNAL);
+      if(n > 0){
+        written += n;
+      } else if(n < 0 && errno == EAGAIN){
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        poll(&pfd, 1, 100);
+      } else {
+        eof = true;
+        break;
+      }
+    }
+    return written;
+  }
+
+  int available(){
+    if(head == tail && fd >= 0 && !eof){
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      head = 0;
+      tail = n > 0 ? n : 0;
+      if(n == 0 || (n < 0 && errno != EAGAIN))
+        eof = true;
+    }
+    return tail - head;
+  }
+
+  int read(){
+    if(available() == 0)
+      return -1;
+    return buf[head++];
+  }
+
+  void stop(){
+    if(fd >= 0)
+      close(fd);
+    fd = -1;
+    head = tail = 0;
+  }
+
+  uint8_t connected(){
+    return fd >= 0 && (!eof || head < tail);
+  }
+
+private:
+  int fd;
+  uint8_t buf[4096];
+  size_t head;
+  size_t tail;
+  bool eof;
+};
+
+// the part of a broker the publisher needs, one connection at a time
+struct Broker {
+  int listen_fd;
+  int fd;
+  uint16_t port;
+  std::string rx;
+  uint32_t drop_every;
+  uint32_t connects;
+  uint32_t messages;
+  uint32_t retained;
+  uint32_t pubacks;
+  uint32_t drops;
+  uint32_t duplicates;
+  std::vector<uint8_t> seen;
+};
+
+static void broker_open(Broker* b, uint32_t samples)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int yes = 1;
+  b->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(b->listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // any free port
+  if(bind(b->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(b->listen_fd, 4) < 0){
+    perror("broker port");
+    exit(1);
+  }
+  getsockname(b->listen_fd, (struct sockaddr*)&addr, &len);
+  b->port = ntohs(addr.sin_port);
+  set_nonblocking(b->listen_fd);
+  b->fd = -1;
+  b->seen.assign(samples, 0);
+}
+
+static void broker_send(Broker* b, uint8_t type, const uint8_t* body, size_t len)
+{
+  uint8_t packet[4] = { type, (uint8_t)len };
+  if(len > 0)
+    memcpy(&packet[2], body, len);
+  if(send(b->fd, packet, 2 + len, MSG_NOSIGNAL) < 0)
+    perror("broker send");
+}
+
+static void broker_drop(Broker* b)
+{
+  close(b->fd);
+  b->fd = -1;
+  b->rx.clear();
+}
+
+// sample numbers of a JSON object or array
+static void broker_samples(Broker* b, const char* payload, size_t len)
+{
+  std::string text(payload, len);
+  size_t pos = 0;
+  while((pos = text.find("\"seq\":", pos)) != std::string::npos){
+    pos += 6;
+    unsigned long seq = strtoul(text.c_str() + pos, NULL, 10);
+    if(seq >= b->seen.size())
+      continue;
+    if(b->seen[seq])
+      b->duplicates++;
+    b->seen[seq] = 1;
+  }
+}
+
+// returns false if the connection was dropped
+static bool broker_packet(Broker* b, uint8_t type, const uint8_t* data, size_t len)
+{
+  switch(type & 0xF0){
+    case 0x10: {
+      // CONNECT: accepted
+      static const uint8_t connack[2] = { 0, 0 };
+      b->connects++;
+      broker_send(b, 0x20, connack, 2);
+      break;
+    }
+    case 0x30: {
+      uint8_t qos = (type >> 1) & 3;
+      size_t topic_len = (data[0] << 8) | data[1];
+      size_t pos = 2 + topic_len;
+      uint8_t id[2] = { 0, 0 };
+      if(qos > 0){
+        memcpy(id, &data[pos], 2);
+        pos += 2;
+      }
+      b->messages++;
+      if(b->drop_every > 0 && b->messages % b->drop_every == 0){
+        // the message is lost, QoS 1 has to send it again
+        b->drops++;
+        broker_drop(b);
+        return false;
+      }
+      if(type & 0x01)
+        b->retained++;
+      else
+        broker_samples(b, (const char*)&data[pos], len - pos);
+      if(qos > 0){
+        b->pubacks++;
+        broker_send(b, 0x40, id, 2);
+      }
+      break;
+    }
+    case 0xC0:
+      // PINGREQ
+      broker_send(b, 0xD0, NULL, 0);
+      break;
+    case 0xE0:
+      broker_drop(b);
+      return false;
+  }
+  return true;
+}
+
+static void broker_poll(Broker* b)
+{
+  if(b->fd < 0){
+    b->fd = accept(b->listen_fd, NULL, NULL);
+    if(b->fd < 0)
+      return;
+    set_nonblocking(b->fd);
+  }
+  char buf[8192];
+  ssize_t n;
+  while((n = recv(b->fd, buf, sizeof(buf), 0)) > 0)
+    b->rx.append(buf, n);
+  if(n == 0){
+    broker_drop(b);
+    return;
+  }
+  // complete packets: type, remaining length, body
+  for(;;){
+    const uint8_t* p = (const uint8_t*)b->rx.data();
+    size_t len = 0, header = 1;
+    uint32_t multiplier = 1;
+    bool complete = false;
+    while(header < b->rx.size() && header <= 4){
+      len += (p[header] & 0x7f) * multiplier;
+      multiplier *= 128;
+      if((p[header++] & 0x80) == 0){
+        complete = true;
+        break;
+      }
+    }
+    if(!complete || b->rx.size() < header + len)
+      return;
+    if(!broker_packet(b, p[0], p + header, len))
+      return;
+    b->rx.erase(0, header + len);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned long count = 100000;
+  int batch = 1;
+  int qos = 1;
+  bool last_value = false;
+  unsigned long drop_every = 0;
+  bool replay = false;
+  const char* remote = NULL;
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:b:q:lo:sr:")) != -1){
+    switch(opt){
+      case 'n': count = strtoul(optarg, NULL, 10); break;
+      case 'b': batch = atoi(optarg); break;
+      case 'q': qos = atoi(optarg); break;
+      case 'l': last_value = true; break;
+      case 'o': drop_every = strtoul(optarg, NULL, 10); break;
+      case 's': replay = true; break;
+      case 'r': remote = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-n samples] [-b batch] [-q qos] [-l] [-o n] [-s] [-r host:port]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(count == 0 || batch < 1 || batch > MQTT_MAX_BATCH || qos < 0 || qos > 1){
+    fprintf(stderr, "samples > 0, batch 1..%d and QoS 0 or 1 expected\n", MQTT_MAX_BATCH);
+    return 1;
+  }
+
+  Broker broker;
+  broker.listen_fd = -1;
+  broker.fd = -1;
+  broker.port = 0;
+  broker.drop_every = drop_every;
+  broker.connects = 0;
+  broker.messages = 0;
+  broker.retained = 0;
+  broker.pubacks = 0;
+  broker.drops = 0;
+  broker.duplicates = 0;
+  std::string host = "127.0.0.1";
+  uint16_t port;
+  if(remote != NULL){
+    const char* colon = strrchr(remote, ':');
+    host = colon ? std::string(remote, colon - remote) : std::string(remote);
+    port = colon ? atoi(colon + 1) : 1883;
+  } else {
+    broker_open(&broker, count);
+    port = broker.port;
+  }
+
+  mqtt_config_t config;
+  memset(&config, 0, sizeof(config));
+  config.broker = host.c_str();
+  config.port = port;
+  config.client_id = "mqtt_bench";
+  config.topic = "atom/env/bench";
+  config.last_topic = last_value ? "atom/env/bench/last" : NULL;
+  config.qos = qos;
+  config.batch = batch;
+  config.keep_alive_s = 30;
+
+  SocketClient client;
+  static MQTTPublisher mqtt;
+  start_s = now_s();
+  mqtt.begin(&client, &config);
+
+  env_sample_t sample;
+  double t0 = now_s();
+  double progress_s = t0;
+  bool stalled = false;
+  unsigned long seq = 0;
+  while(seq < count){
+    size_t n = 1;
+    if(replay){
+      // the part of the chunk the publisher can not take stays in the backlog
+      n = mqtt.replayCapacity();
+      if(n > REPLAY_CHUNK)
+        n = REPLAY_CHUNK;
+      if(n > count - seq)
+        n = count - seq;
+      if(n > 0)
+        progress_s = now_s();
+      else if((now_s() - progress_s) * 1000 > DRAIN_MS){
+        stalled = true;
+        break;
+      }
+    }
+    for(size_t i = 0; i < n; i++, seq++){
+      sample.seq = seq;
+      sample.time_ms = seq * 1000;
+      sample.temperature = 21.5f + (seq % 100) * 0.01f;
+      sample.humidity = 45.0f + (seq % 50) * 0.1f;
+      sample.pressure = 101325.0f + (seq % 200) * 0.5f;
+      mqtt.publish(&sample, !replay);
+    }
+    mqtt.loop();
+    if(remote == NULL){
+      uint32_t drops = broker.drops;
+      broker_poll(&broker);
+      // reconnect at once instead of MQTT_RECONNECT_MS later
+      if(broker.drops != drops)
+        clock_offset_ms += MQTT_RECONNECT_MS;
+    }
+  }
+  // the queued and the unacknowledged messages
+  double drain_start = now_s();
+  while(mqtt.queued() > 0 && (now_s() - drain_start) * 1000 < DRAIN_MS){
+    mqtt.loop();
+    if(remote == NULL)
+      broker_poll(&broker);
+    else
+      usleep(100);
+  }
+  double seconds = now_s() - t0;
+
+  const mqtt_stats_t* s = &mqtt.stats;
+  if(stalled)
+    printf("replay stalled after %lu of %lu samples\n", seq, count);
+  printf("batch %d, QoS %d%s%s: %u samples in %u messages, %.3f s, %.0f messages/s, %.0f samples/s, "
+         "%.1f bytes/sample, %u connects\n",
+         batch, qos, last_value ? ", last value" : "", replay ? ", replay" : "", (unsigned int)s->samples, (unsigned int)s->messages,
+         seconds, s->messages / seconds, s->samples / seconds,
+         s->samples ? (double)s->bytes / s->samples : 0.0, (unsigned int)s->connects);
+  if(s->dropped || mqtt.queued())
+    printf("publisher: %u messages dropped (queue full), %u still queued\n",
+           (unsigned int)s->dropped, mqtt.queued());
+  if(remote != NULL)
+    return mqtt.queued() || stalled ? 1 : 0;
+
+  unsigned long missing = 0;
+  // samples of an incomplete last batch are not sent
+  unsigned long sent = count - count % batch;
+  for(unsigned long i = 0; i < sent; i++)
+    if(!broker.seen[i])
+      missing++;
+  printf("stand-in: %u messages, %u retained, %u PUBACK, %u dropped connections, "
+         "%lu samples missing, %u duplicates\n",
+         (unsigned int)broker.messages, (unsigned int)broker.retained, (unsigned int)broker.pubacks,
+         (unsigned int)broker.drops, missing, (unsigned int)broker.duplicates);
+  // QoS 0 loses the messages of a dropped connection
+  return (missing > 0 && qos > 0) || s->dropped || stalled ? 1 : 0;
+}
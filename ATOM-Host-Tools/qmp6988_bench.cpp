@@ -0,0 +1,398 @@
+/******************************************************************************
+ * M5ATOM ENV QMP6988 compensation benchmark
+ * Compares the fixed point and the float compensation of QMP6988Compensation.h:
+ * sweeps the raw pressure and temperature words over the full 24 bit range,
+ * reports the largest error of both paths against the datasheet formulas
+ * in double precision and their largest difference inside the operating
+ * range of the sensor (-40 ... 85 degC, 30 ... 110 kPa) and measures the
+ * time (and on x86 the TSC cycles) per compensation.
+ * The batch functions over arrays of logged raw words (structure of arrays)
+ * are timed in samples per second: the reference with one policy call per
+ * sample and the float kernel written for auto-vectorization.
+ * The table altitude of Altitude.h is compared with the pow() formula
+ * over the pressure range of the table and timed the same way.
+ * The same comparison runs on the device with the serial command "bench".
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -I../ATOM-Web-Monitor/src -o qmp6988_bench qmp6988_bench.cpp
+ *   (-O3 -march=native lets the compiler use the widest vector unit)
+ *
+ * usage:
+ *   qmp6988_bench [-c calibration] [-s step] [-n count]
+ *   -c  the 25 OTP bytes as 50 hex digits (printed by raw_capture),
+ *       default is a made up but plausible calibration
+ *   -s  step of the sweep over the raw words (default 4096)
+ *   -n  compensations per timing run (default 10000000)
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "QMP6988Compensation.h"
+#include "Altitude.h"
+
+// operating range of the sensor
+#define T_MIN_C   -40.0
+#define T_MAX_C    85.0
+#define P_MIN_PA   30000.0
+#define P_MAX_PA   110000.0
+
+static const uint8_t default_otp[QMP6988_CALIBRATION_DATA_LENGTH] = {
+  0x4e, 0x20, 0x00, 0xc8, 0xf0, 0x60, 0x05, 0xdc, 0xfc, 0xe0, 0x09, 0xc4, 0x02,
+  0x58, 0xfe, 0xd4, 0x03, 0xe8, 0x19, 0x00, 0xfb, 0x50, 0x0b, 0xb8, 0x00
+};
+
+static bool parse_otp(const char* hex, uint8_t* otp)
+{
+  if(strlen(hex) != 2 * QMP6988_CALIBRATION_DATA_LENGTH)
+    return false;
+  for(int i = 0; i < QMP6988_CALIBRATION_DATA_LENGTH; i++){
+    unsigned int byte;
+    if(sscanf(&hex[2 * i], "%2x", &byte) != 1)
+      return false;
+    otp[i] = byte;
+  }
+  return true;
+}
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// datasheet formulas in double precision as reference
+static void reference(const qmp6988_cali_data_t* cali, uint32_t p_read, uint32_t t_read,
+                      double* temperature, double* pressure)
+{
+  double dt = (QMP6988_S32_t)(t_read - SUBTRACTOR);
+  double dp = (QMP6988_S32_t)(p_read - SUBTRACTOR);
+  double a1 = -6.30E-03 + 4.30E-04 * cali->COE_a1 / 32767.0;
+  double a2 = -1.90E-11 + 1.20E-10 * cali->COE_a2 / 32767.0;
+  double bt1 = 1.00E-01 + 9.10E-02 * cali->COE_bt1 / 32767.0;
+  double bt2 = 1.20E-08 + 1.20E-06 * cali->COE_bt2 / 32767.0;
+  double bp1 = 3.30E-02 + 1.90E-02 * cali->COE_bp1 / 32767.0;
+  double b11 = 2.10E-07 + 1.40E-07 * cali->COE_b11 / 32767.0;
+  double bp2 = -6.30E-10 + 3.50E-10 * cali->COE_bp2 / 32767.0;
+  double b12 = 2.90E-13 + 7.60E-13 * cali->COE_b12 / 32767.0;
+  double b21 = 2.10E-15 + 1.20E-14 * cali->COE_b21 / 32767.0;
+  double bp3 = 1.30E-16 + 7.90E-17 * cali->COE_bp3 / 32767.0;
+  double tr = cali->COE_a0 / 16.0 + a1 * dt + a2 * dt * dt;
+  *pressure = cali->COE_b00 / 16.0 + bt1 * tr + bp1 * dp + b11 * tr * dp + bt2 * tr * tr +
+              bp2 * dp * dp + b12 * dp * tr * tr + b21 * dp * dp * tr + bp3 * dp * dp * dp;
+  *temperature = tr / 256.0;
+}
+
+struct Validation {
+  unsigned long points;
+  unsigned long in_range;
+  unsigned long wrapped;
+  // largest errors against the reference and largest difference
+  double int_dp, int_dt;   // Pa, degC
+  double float_dp, float_dt;
+  double max_dp, max_dt;
+  uint32_t worst_p_read, worst_t_read;
+  double p_range_min, p_range_max;
+};
+
+static void update_max(double* max, double value)
+{
+  if(fabs(value) > *max)
+    *max = fabs(value);
+}
+
+// the fixed point path is the reference, only points where it
+// gives a value inside the operating range are compared;
+// its 16 bit temperature wraps for raw words far outside of the
+// operating range, such points are counted but not compared
+static void validate(const qmp6988_cali_data_t* cali, const qmp6988_ik_data_t* ik, const qmp6988_fk_data_t* fk,
+                     uint32_t step, Validation* v)
+{
+  memset(v, 0, sizeof(*v));
+  v->p_range_min = 1e9;
+  v->p_range_max = -1e9;
+  for(uint32_t t_read = 0; t_read < (1u << 24); t_read += step){
+    float ti, pi, tf, pf;
+    QMP6988IntegerCompensation::compensate(ik, SUBTRACTOR, t_read, &ti, &pi);
+    QMP6988FloatCompensation::compensate(fk, SUBTRACTOR, t_read, &tf, &pf);
+    if(ti < T_MIN_C || ti > T_MAX_C || fabs(tf - ti) > 128.0){
+      if(ti >= T_MIN_C && ti <= T_MAX_C)
+        v->wrapped++;
+      v->points += ((1u << 24) + step - 1) / step;
+      continue;
+    }
+    for(uint32_t p_read = 0; p_read < (1u << 24); p_read += step){
+      v->points++;
+      QMP6988IntegerCompensation::compensate(ik, p_read, t_read, &ti, &pi);
+      if(pi < P_MIN_PA || pi > P_MAX_PA)
+        continue;
+      QMP6988FloatCompensation::compensate(fk, p_read, t_read, &tf, &pf);
+      double tr, pr;
+      reference(cali, p_read, t_read, &tr, &pr);
+      v->in_range++;
+      if(fabs(pf - pi) > v->max_dp){
+        v->max_dp = fabs(pf - pi);
+        v->worst_p_read = p_read;
+        v->worst_t_read = t_read;
+      }
+      update_max(&v->max_dt, tf - ti);
+      update_max(&v->int_dp, pi - pr);
+      update_max(&v->int_dt, ti - tr);
+      update_max(&v->float_dp, pf - pr);
+      update_max(&v->float_dt, tf - tr);
+      if(pi < v->p_range_min)
+        v->p_range_min = pi;
+      if(pi > v->p_range_max)
+        v->p_range_max = pi;
+    }
+  }
+}
+
+// raw words of the operating range, the timing loop cycles through them
+#define INPUTS 4096
+
+template <class C>
+static void bench(const typename C::coefficients_t* k, const uint32_t* p_read, const uint32_t* t_read,
+                  unsigned long count)
+{
+  volatile float sink = 0;
+  float sum = 0;
+  // warm up
+  for(int i = 0; i < INPUTS; i++){
+    float t, p;
+    C::compensate(k, p_read[i], t_read[i], &t, &p);
+    sum += p + t;
+  }
+  double start = now_s();
+#ifdef HAVE_TSC
+  unsigned long long tsc = __rdtsc();
+#endif
+  for(unsigned long n = 0; n < count; n++){
+    float t, p;
+    C::compensate(k, p_read[n % INPUTS], t_read[n % INPUTS], &t, &p);
+    sum += p + t;
+  }
+#ifdef HAVE_TSC
+  tsc = __rdtsc() - tsc;
+#endif
+  double seconds = now_s() - start;
+  sink = sum;
+  (void)sink;
+  printf("%-8s %8.2f ns", C::name(), seconds * 1e9 / count);
+#ifdef HAVE_TSC
+  printf(" %8.1f TSC cycles", (double)tsc / count);
+#endif
+  printf(" %10.2f M/s\n", count / seconds / 1e6);
+}
+
+// batch functions over a structure of arrays
+#define BATCH 65536
+
+typedef struct _batch {
+  const qmp6988_ik_data_t* ik;
+  const qmp6988_fk_data_t* fk;
+  uint32_t p_read[BATCH];
+  uint32_t t_read[BATCH];
+  float pressure[BATCH];
+  float temperature[BATCH];
+} batch_t;
+
+struct BatchIntegerRef {
+  static const char* name() { return "integer reference"; }
+  static void run(batch_t* b)
+  {
+    qmp6988_compensate_batch_ref<QMP6988IntegerCompensation>(b->ik, b->p_read, b->t_read, b->pressure, b->temperature, BATCH);
+  }
+};
+
+struct BatchFloatRef {
+  static const char* name() { return "float reference"; }
+  static void run(batch_t* b)
+  {
+    qmp6988_compensate_batch_ref<QMP6988FloatCompensation>(b->fk, b->p_read, b->t_read, b->pressure, b->temperature, BATCH);
+  }
+};
+
+struct BatchFloatKernel {
+  static const char* name() { return "float kernel"; }
+  static void run(batch_t* b)
+  {
+    qmp6988_fk_compensate_batch(b->fk, b->p_read, b->t_read, b->pressure, b->temperature, BATCH);
+  }
+};
+
+// altitude of the table against the reference formula,
+// largest error for the pressure ranges of the Altitude.h comment
+static void validate_altitude(const AltitudeTable* table)
+{
+  static const double ranges[][2] = {
+    { ALTITUDE_PRESSURE_MIN, ALTITUDE_PRESSURE_MAX },
+    { 70000.0, ALTITUDE_PRESSURE_MAX },
+    { 90000.0, ALTITUDE_PRESSURE_MAX }
+  };
+  for(size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++){
+    double max_dh = 0.0, worst_p = 0.0;
+    for(double t = T_MIN_C; t <= T_MAX_C; t += 25.0){
+      for(double p = ranges[r][0]; p <= ranges[r][1]; p += 1.0){
+        double dh = fabs(table->altitude(p, t) - altitude_reference(p, t, table->seaLevel()));
+        if(dh > max_dh){
+          max_dh = dh;
+          worst_p = p;
+        }
+      }
+    }
+    printf("altitude error %.0f ... %.0f Pa: max %.3f m (at %.0f Pa)\n",
+           ranges[r][0], ranges[r][1], max_dh, worst_p);
+  }
+}
+
+struct AltitudePow {
+  static const char* name() { return "powf"; }
+  static float run(const AltitudeTable* table, float p, float t)
+  {
+    return (powf(table->seaLevel() / p, 1.0F / 5.257F) - 1.0F) * (t + 273.15F) / 0.0065F;
+  }
+};
+
+struct AltitudeLookup {
+  static const char* name() { return "table"; }
+  static float run(const AltitudeTable* table, float p, float t)
+  {
+    return table->altitude(p, t);
+  }
+};
+
+template <class A>
+static void bench_altitude(const AltitudeTable* table, const float* pressure, unsigned long count)
+{
+  volatile float sink = 0;
+  float sum = 0;
+  double start = now_s();
+  for(unsigned long n = 0; n < count; n++)
+    sum += A::run(table, pressure[n % INPUTS], 20.0F);
+  double seconds = now_s() - start;
+  sink = sum;
+  (void)sink;
+  printf("altitude %-8s %8.2f ns %10.2f M/s\n", A::name(), seconds * 1e9 / count, count / seconds / 1e6);
+}
+
+template <class B>
+static void bench_batch(batch_t* b, unsigned long count)
+{
+  unsigned long passes = (count + BATCH - 1) / BATCH;
+  B::run(b);
+  double start = now_s();
+  for(unsigned long n = 0; n < passes; n++)
+    B::run(b);
+  double seconds = now_s() - start;
+  printf("batch %-18s %10.2f M samples/s\n", B::name(), passes * (double)BATCH / seconds / 1e6);
+}
+
+int main(int argc, char* argv[])
+{
+  uint8_t otp[QMP6988_CALIBRATION_DATA_LENGTH];
+  uint32_t step = 4096;
+  unsigned long count = 10000000;
+  int opt;
+
+  memcpy(otp, default_otp, sizeof(otp));
+  while((opt = getopt(argc, argv, "c:s:n:")) != -1){
+    switch(opt){
+      case 'c':
+        if(!parse_otp(optarg, otp)){
+          fprintf(stderr, "calibration needs %i hex bytes\n", QMP6988_CALIBRATION_DATA_LENGTH);
+          return 1;
+        }
+        break;
+      case 's': step = strtoul(optarg, NULL, 10); break;
+      case 'n': count = strtoul(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-c calibration] [-s step] [-n count]\n", argv[0]);
+        return 1;
+    }
+  }
+  if(step == 0 || count == 0){
+    fprintf(stderr, "step and count must be > 0\n");
+    return 1;
+  }
+
+  qmp6988_cali_data_t cali;
+  qmp6988_ik_data_t ik;
+  qmp6988_fk_data_t fk;
+  qmp6988_cali_decode(otp, &cali);
+  QMP6988IntegerCompensation::init(&cali, &ik);
+  QMP6988FloatCompensation::init(&cali, &fk);
+
+  Validation v;
+  validate(&cali, &ik, &fk, step, &v);
+  printf("sweep: %lu points, %lu inside the operating range (%.0f ... %.0f Pa), "
+         "%lu temperature words with a wrapped integer result\n",
+         v.points, v.in_range, v.in_range ? v.p_range_min : 0.0, v.in_range ? v.p_range_max : 0.0, v.wrapped);
+  if(v.in_range == 0){
+    fprintf(stderr, "no raw word of the sweep maps into the operating range, check the calibration\n");
+    return 1;
+  }
+  printf("integer error:   max %.3f Pa, %.4f degC\n", v.int_dp, v.int_dt);
+  printf("float error:     max %.3f Pa, %.4f degC\n", v.float_dp, v.float_dt);
+  printf("float - integer: max %.3f Pa (raw P 0x%06x T 0x%06x), %.4f degC\n",
+         v.max_dp, (unsigned int)v.worst_p_read, (unsigned int)v.worst_t_read, v.max_dt);
+
+  // inputs for the timing: random points of the operating range
+  static uint32_t p_read[INPUTS], t_read[INPUTS];
+  srand(1);
+  for(int i = 0; i < INPUTS; ){
+    uint32_t p = rand() & 0xffffff, t = rand() & 0xffffff;
+    float tc, pc;
+    QMP6988IntegerCompensation::compensate(&ik, p, t, &tc, &pc);
+    if(tc < T_MIN_C || tc > T_MAX_C || pc < P_MIN_PA || pc > P_MAX_PA)
+      continue;
+    p_read[i] = p;
+    t_read[i] = t;
+    i++;
+  }
+  bench<QMP6988IntegerCompensation>(&ik, p_read, t_read, count);
+  bench<QMP6988FloatCompensation>(&fk, p_read, t_read, count);
+
+  static batch_t batch;
+  batch.ik = &ik;
+  batch.fk = &fk;
+  for(int i = 0; i < BATCH; i++){
+    batch.p_read[i] = p_read[i % INPUTS];
+    batch.t_read[i] = t_read[(i * 7) % INPUTS];
+  }
+  // the kernel has to give the results of the reference
+  static float ref_pressure[BATCH], ref_temperature[BATCH];
+  BatchFloatRef::run(&batch);
+  memcpy(ref_pressure, batch.pressure, sizeof(ref_pressure));
+  memcpy(ref_temperature, batch.temperature, sizeof(ref_temperature));
+  BatchFloatKernel::run(&batch);
+  double max_dp = 0.0, max_dt = 0.0;
+  for(int i = 0; i < BATCH; i++){
+    update_max(&max_dp, batch.pressure[i] - ref_pressure[i]);
+    update_max(&max_dt, batch.temperature[i] - ref_temperature[i]);
+  }
+  printf("batch float kernel - reference: max %.4f Pa, %.5f degC\n", max_dp, max_dt);
+  bench_batch<BatchIntegerRef>(&batch, count);
+  bench_batch<BatchFloatRef>(&batch, count);
+  bench_batch<BatchFloatKernel>(&batch, count);
+
+  AltitudeTable table;
+  table.begin();
+  validate_altitude(&table);
+  static float altitude_pressure[INPUTS];
+  for(int i = 0; i < INPUTS; i++)
+    altitude_pressure[i] = batch.pressure[i];
+  bench_altitude<AltitudePow>(&table, altitude_pressure, count);
+  bench_altitude<AltitudeLookup>(&table, altitude_pressure, count);
+  return 0;
+}
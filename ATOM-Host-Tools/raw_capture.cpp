@@ -0,0 +1,293 @@
+/******************************************************************************
+ * M5ATOM ENV raw stream capture
+ * Starts the raw sensor stream of the ATOM-Web-Monitor on its USB serial
+ * port, decodes the COBS framed packets (see RawStream.h) and writes every
+ * sample as CSV. The QMP6988 words are compensated with the calibration
+ * of the info packets (float path of QMP6988Compensation.h), the
+ * calibration is printed once for qmp6988_bench -c.
+ * Frames with a wrong CRC are counted and skipped, gaps in
+ * the sequence numbers are counted as lost packets. Ctrl+C stops the
+ * stream and switches the monitor back to the normal mode.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -I../ATOM-Web-Monitor/src -o raw_capture raw_capture.cpp
+ *
+ * usage:
+ *   raw_capture [-b baud] [-o file.csv] [-t seconds] [-n] <tty|file|->
+ *   -b  baud rate of the stream (default 921600)
+ *   -o  CSV output (default stdout)
+ *   -n  do not send the start/stop commands (input is a file or
+ *       the stream is already running)
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+
+#include "RawStream.h"
+#include "QMP6988Compensation.h"
+
+// baud rate of the serial console in the normal mode
+#define CONSOLE_BAUD 115200
+
+static volatile bool running = true;
+
+static void on_signal(int)
+{
+  running = false;
+}
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static speed_t baud_constant(unsigned long baud)
+{
+  switch(baud){
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 576000: return B576000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1152000: return B1152000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 2500000: return B2500000;
+    case 3000000: return B3000000;
+    default: return 0;
+  }
+}
+
+static bool set_baud(int fd, unsigned long baud)
+{
+  struct termios tio;
+  speed_t speed = baud_constant(baud);
+  if(speed == 0 || tcgetattr(fd, &tio) < 0)
+    return false;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~CRTSCTS;
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+static void send_command(int fd, const char* command)
+{
+  if(write(fd, command, strlen(command)) < 0)
+    perror("serial write");
+  tcdrain(fd);
+}
+
+struct Capture {
+  FILE* out;
+  bool have_seq;
+  uint16_t next_seq;
+  bool have_info;
+  raw_info_t info;
+  qmp6988_fk_data_t fk;
+  unsigned long samples;
+  unsigned long infos;
+  unsigned long crc_errors;
+  unsigned long lost;
+  unsigned long sht30_invalid;
+  unsigned long qmp6988_invalid;
+  // micros() of the device wraps after 71 minutes
+  uint32_t last_time_us;
+  uint64_t time_high;
+};
+
+static void handle_frame(Capture* cap, const uint8_t* frame, size_t len)
+{
+  uint8_t packet[RAW_MAX_PACKET];
+  size_t packet_len = raw_cobs_decode(frame, len, packet, sizeof(packet));
+  uint8_t type = packet_len ? raw_packet_type(packet, packet_len) : 0;
+  if(type == 0){
+    cap->crc_errors++;
+    return;
+  }
+  uint16_t seq = raw_packet_seq(packet);
+  if(cap->have_seq && seq != cap->next_seq)
+    cap->lost += (uint16_t)(seq - cap->next_seq);
+  cap->have_seq = true;
+  cap->next_seq = seq + 1;
+
+  if(type == RAW_PACKET_INFO){
+    raw_parse_info(packet, &cap->info);
+    qmp6988_cali_data_t cali;
+    qmp6988_cali_decode(cap->info.calibration, &cali);
+    QMP6988FloatCompensation::init(&cali, &cap->fk);
+    if(!cap->have_info){
+      fprintf(stderr, "stream at %u baud, QMP6988 oversampling P %u T %u filter %u\ncalibration ",
+              (unsigned int)cap->info.baud, cap->info.oversampling_p, cap->info.oversampling_t, cap->info.filter);
+      for(int i = 0; i < RAW_CALI_SIZE; i++)
+        fprintf(stderr, "%02x", cap->info.calibration[i]);
+      fprintf(stderr, "\n");
+    }
+    cap->have_info = true;
+    cap->infos++;
+    return;
+  }
+  raw_sample_t s;
+  raw_parse_sample(packet, &s);
+  if(s.time_us < cap->last_time_us)
+    cap->time_high += 1ULL << 32;
+  cap->last_time_us = s.time_us;
+  fprintf(cap->out, "%u,%llu", s.seq, (unsigned long long)(cap->time_high + s.time_us));
+  if(s.flags & RAW_FLAG_SHT30){
+    fprintf(cap->out, ",%u,%u,%.3f,%.3f", s.sht30_temperature, s.sht30_humidity,
+            -45.0 + 175.0 * s.sht30_temperature / 65535.0, 100.0 * s.sht30_humidity / 65535.0);
+  } else {
+    fprintf(cap->out, ",,,,");
+    cap->sht30_invalid++;
+  }
+  if(s.flags & RAW_FLAG_QMP6988){
+    fprintf(cap->out, ",%u,%u", (unsigned int)s.qmp6988_pressure, (unsigned int)s.qmp6988_temperature);
+    // the values need the calibration of an info packet
+    if(cap->have_info){
+      float temperature, pressure;
+      QMP6988FloatCompensation::compensate(&cap->fk, s.qmp6988_pressure, s.qmp6988_temperature,
+                                           &temperature, &pressure);
+      fprintf(cap->out, ",%.3f,%.3f\n", pressure, temperature);
+    } else {
+      fprintf(cap->out, ",,\n");
+    }
+  } else {
+    fprintf(cap->out, ",,,,\n");
+    cap->qmp6988_invalid++;
+  }
+  cap->samples++;
+}
+
+static void print_stats(Capture* cap, double seconds)
+{
+  fprintf(stderr, "%lu samples (%.1f/s), %lu info packets, %lu CRC errors, %lu lost, "
+                  "invalid SHT30 %lu QMP6988 %lu\n", cap->samples, seconds > 0 ? cap->samples / seconds : 0.0,
+          cap->infos, cap->crc_errors, cap->lost, cap->sht30_invalid, cap->qmp6988_invalid);
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned long baud = RAW_STREAM_DEFAULT_BAUD;
+  const char* out_path = NULL;
+  int duration_s = 0;
+  bool control = true;
+  int opt;
+
+  while((opt = getopt(argc, argv, "b:o:t:n")) != -1){
+    switch(opt){
+      case 'b': baud = strtoul(optarg, NULL, 10); break;
+      case 'o': out_path = optarg; break;
+      case 't': duration_s = atoi(optarg); break;
+      case 'n': control = false; break;
+      default:
+        fprintf(stderr, "usage: %s [-b baud] [-o file.csv] [-t seconds] [-n] <tty|file|->\n", argv[0]);
+        return 1;
+    }
+  }
+  if(optind >= argc){
+    fprintf(stderr, "usage: %s [-b baud] [-o file.csv] [-t seconds] [-n] <tty|file|->\n", argv[0]);
+    return 1;
+  }
+  const char* path = argv[optind];
+  int fd = strcmp(path, "-") == 0 ? 0 : open(path, O_RDWR | O_NOCTTY);
+  if(fd < 0){
+    perror(path);
+    return 1;
+  }
+  bool tty = isatty(fd);
+  if(tty && baud_constant(baud) == 0){
+    fprintf(stderr, "unsupported baud rate %lu\n", baud);
+    return 1;
+  }
+
+  Capture cap;
+  memset(&cap, 0, sizeof(cap));
+  cap.out = out_path ? fopen(out_path, "w") : stdout;
+  if(cap.out == NULL){
+    perror(out_path);
+    return 1;
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  if(tty){
+    if(control){
+      // the command is sent at the console baud rate,
+      // the monitor answers and switches over
+      set_baud(fd, CONSOLE_BAUD);
+      tcflush(fd, TCIOFLUSH);
+      char command[32];
+      snprintf(command, sizeof(command), "\nstream %lu\n", baud);
+      send_command(fd, command);
+      usleep(100000);
+    }
+    set_baud(fd, baud);
+    tcflush(fd, TCIFLUSH);
+  }
+  fprintf(cap.out, "seq,time_us,sht30_t_raw,sht30_rh_raw,temperature_C,humidity_pct,"
+                   "qmp6988_p_raw,qmp6988_t_raw,pressure_Pa,qmp6988_temperature_C\n");
+
+  uint8_t frame[RAW_MAX_FRAME * 4];
+  size_t frame_len = 0;
+  // on a serial port everything before the first delimiter is a partial frame
+  bool synced = !tty;
+  uint8_t buf[4096];
+  double start = now_s(), next_stats = start + 5.0;
+  while(running && (duration_s == 0 || now_s() - start < duration_s)){
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if(poll(&pfd, 1, 200) <= 0)
+      continue;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      break;
+    for(ssize_t i = 0; i < n; i++){
+      if(buf[i] != 0){
+        // a frame that is too long is garbage, e.g. text of the console
+        if(frame_len < sizeof(frame))
+          frame[frame_len++] = buf[i];
+        else
+          frame_len = sizeof(frame) + 1;
+        continue;
+      }
+      if(synced && frame_len > 0){
+        if(frame_len <= sizeof(frame))
+          handle_frame(&cap, frame, frame_len);
+        else
+          cap.crc_errors++;
+      }
+      synced = true;
+      frame_len = 0;
+    }
+    if(tty && now_s() >= next_stats){
+      print_stats(&cap, now_s() - start);
+      next_stats += 5.0;
+    }
+  }
+  if(tty && control){
+    send_command(fd, "\nstop\n");
+    usleep(50000);
+    set_baud(fd, CONSOLE_BAUD);
+  }
+  print_stats(&cap, now_s() - start);
+  if(cap.out != stdout)
+    fclose(cap.out);
+  return 0;
+}
@@ -0,0 +1,155 @@
+/******************************************************************************
+ * M5ATOM ENV webhook sink
+ * Local stand-in for the alert webhook of the ATOM-Web-Monitor: accepts
+ * the POSTs of the monitor, prints every alert of a batch and answers
+ * 200, or 503 for a given share of the requests to check the retries.
+ *
+ * build:
+ *   g++ -O2 -std=c++11 -o webhook_sink webhook_sink.cpp
+ *
+ * usage:
+ *   webhook_sink [-p port] [-f fail_percent] [-d delay_ms] [-r]
+ *   -r  print the raw request body instead of one line per alert
+ *
+ * Distributed as-is; no warranty is given.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <string>
+
+// largest request that is accepted (header and body)
+#define MAX_REQUEST 16384
+
+static int open_http(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  struct sockaddr_in addr;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  // the monitors are in the network, not on this host
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0){
+    perror("http port");
+    exit(1);
+  }
+  return fd;
+}
+
+// read one request with header and body (Content-Length)
+static bool read_request(int fd, std::string* header, std::string* body)
+{
+  std::string data;
+  size_t body_start = std::string::npos, length = 0;
+  char buf[2048];
+  while(data.size() < MAX_REQUEST){
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if(poll(&pfd, 1, 3000) <= 0)
+      return false;
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if(n <= 0)
+      return false;
+    data.append(buf, n);
+    if(body_start == std::string::npos){
+      size_t end = data.find("\r\n\r\n");
+      if(end == std::string::npos)
+        continue;
+      body_start = end + 4;
+      *header = data.substr(0, end);
+      const char* cl = strcasestr(header->c_str(), "\r\nContent-Length:");
+      length = cl ? strtoul(cl + 17, NULL, 10) : 0;
+    }
+    if(data.size() >= body_start + length){
+      *body = data.substr(body_start, length);
+      return true;
+    }
+  }
+  return false;
+}
+
+// the firmware sends flat JSON objects inside "alerts":[...],
+// print each of them on its own line
+static void print_alerts(const std::string& body)
+{
+  size_t pos = body.find("\"alerts\":[");
+  if(pos == std::string::npos){
+    printf("  (no alerts) %s\n", body.c_str());
+    return;
+  }
+  int n = 0;
+  while((pos = body.find('{', pos)) != std::string::npos){
+    size_t end = body.find('}', pos);
+    if(end == std::string::npos)
+      break;
+    printf("  %s\n", body.substr(pos, end - pos + 1).c_str());
+    pos = end + 1;
+    n++;
+  }
+  printf("  %i alerts\n", n);
+}
+
+int main(int argc, char* argv[])
+{
+  int port = 8081;
+  int fail_percent = 0;
+  int delay_ms = 0;
+  bool raw = false;
+  int opt;
+
+  while((opt = getopt(argc, argv, "p:f:d:r")) != -1){
+    switch(opt){
+      case 'p': port = atoi(optarg); break;
+      case 'f': fail_percent = atoi(optarg); break;
+      case 'd': delay_ms = atoi(optarg); break;
+      case 'r': raw = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-p port] [-f fail_percent] [-d delay_ms] [-r]\n", argv[0]);
+        return 1;
+    }
+  }
+  int listen_fd = open_http(port);
+  srand(time(NULL));
+  printf("webhook_sink: listening on port %i, %i%% of the requests fail\n", port, fail_percent);
+  fflush(stdout);
+
+  for(;;){
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int fd = accept(listen_fd, (struct sockaddr*)&from, &from_len);
+    if(fd < 0)
+      continue;
+    std::string header, body;
+    if(read_request(fd, &header, &body)){
+      bool fail = fail_percent > 0 && (rand() % 100) < fail_percent;
+      char addr[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &from.sin_addr, addr, sizeof(addr));
+      time_t now = time(NULL);
+      char stamp[32];
+      strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+      printf("%s %s %s -> %s\n", stamp, addr, header.substr(0, header.find("\r\n")).c_str(),
+             fail ? "503 (simulated failure)" : "200");
+      if(raw)
+        printf("  %s\n", body.c_str());
+      else
+        print_alerts(body);
+      fflush(stdout);
+      if(delay_ms > 0)
+        usleep(delay_ms * 1000);
+      const char* response = fail ? "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"
+                                  : "HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      if(write(fd, response, strlen(response)) < 0)
+        perror("http write");
+    }
+    close(fd);
+  }
+  return 0;
+}
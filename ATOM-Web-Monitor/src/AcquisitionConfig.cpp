@@ -0,0 +1,169 @@
+#include <Preferences.h>
+#include "AcquisitionConfig.h"
+
+#define ACQ_PREFS_NAMESPACE "acquisition"
+#define ACQ_PREFS_KEY       "config"
+
+static const char* acq_profile_names[] = {"low_noise", "fast"};
+static const char* acq_sht30_mode_names[] = {"single", "0.5", "1", "2", "4", "10", "art"};
+static const char* acq_repeatability_names[] = {"high", "medium", "low"};
+
+void AcquisitionConfig::begin()
+{
+  Preferences prefs;
+  acquisition_config_t stored;
+  size_t len;
+
+  profile(ACQ_PROFILE_LOW_NOISE, &active);
+  stored = active;
+  prefs.begin(ACQ_PREFS_NAMESPACE, true);
+  len = prefs.getBytes(ACQ_PREFS_KEY, &stored, sizeof(stored));
+  // settings stored by an older version are shorter,
+  // the new settings keep the values of the default profile
+  if(len >= offsetof(acquisition_config_t, sht30_mode) && len <= sizeof(stored)){
+    if(valid(&stored))
+      active = stored;
+  }
+  prefs.end();
+}
+
+bool AcquisitionConfig::save()
+{
+  Preferences prefs;
+  size_t len;
+
+  if(!prefs.begin(ACQ_PREFS_NAMESPACE, false))
+    return false;
+  len = prefs.putBytes(ACQ_PREFS_KEY, &active, sizeof(active));
+  prefs.end();
+  return len == sizeof(active);
+}
+
+bool AcquisitionConfig::profile(int profile, acquisition_config_t* config)
+{
+  switch(profile){
+    case ACQ_PROFILE_LOW_NOISE:
+      // high precission mode
+      config->period_ms = 3000;
+      config->n_average = 10;
+      config->oversampling_p = QMP6988_OVERSAMPLING_32X;
+      config->oversampling_t = QMP6988_OVERSAMPLING_4X;
+      // the sensor sleeps between the samples, the noise is
+      // reduced by the oversampling and the average
+      config->filter = QMP6988_FILTERCOEFF_OFF;
+      config->sht30_mode = SHT3X_MODE_SINGLE_SHOT;
+      config->sht30_repeatability = SHT3X_REPEATABILITY_HIGH;
+      config->pressure_forced = 1;
+      return true;
+    case ACQ_PROFILE_FAST:
+      // short interval, no averaging and filtering
+      config->period_ms = 500;
+      config->n_average = 1;
+      config->oversampling_p = QMP6988_OVERSAMPLING_4X;
+      config->oversampling_t = QMP6988_OVERSAMPLING_1X;
+      config->filter = QMP6988_FILTERCOEFF_OFF;
+      // the SHT30 measures on its own, one result per interval
+      config->sht30_mode = SHT3X_MODE_2_MPS;
+      config->sht30_repeatability = SHT3X_REPEATABILITY_MEDIUM;
+      config->pressure_forced = 0;
+      return true;
+    default:
+      return false;
+  }
+}
+
+int AcquisitionConfig::profileNumber(const char* name)
+{
+  for(int i = 0; i < 2; i++){
+    if(strcmp(name, acq_profile_names[i]) == 0)
+      return i;
+  }
+  return ACQ_PROFILE_UNKNOWN;
+}
+
+bool AcquisitionConfig::valid(const acquisition_config_t* config)
+{
+  return (config->period_ms >= ACQ_PERIOD_MIN_MS) &&
+         (config->period_ms <= ACQ_PERIOD_MAX_MS) &&
+         (config->n_average >= 1) &&
+         (config->n_average <= ACQ_AVERAGE_MAX) &&
+         // pressure needs at least one sample
+         (config->oversampling_p >= QMP6988_OVERSAMPLING_1X) &&
+         (config->oversampling_p <= QMP6988_OVERSAMPLING_64X) &&
+         // temperature is needed for the pressure compensation
+         (config->oversampling_t >= QMP6988_OVERSAMPLING_1X) &&
+         (config->oversampling_t <= QMP6988_OVERSAMPLING_64X) &&
+         (config->filter <= QMP6988_FILTERCOEFF_32) &&
+         // one forced conversion per sample: a long IIR filter
+         // would lag the pressure by many sample periods
+         (!config->pressure_forced || config->filter <= QMP6988_FILTERCOEFF_2) &&
+         (config->sht30_mode <= SHT3X_MODE_ART) &&
+         // a periodic SHT30 has to deliver a result per sample
+         (config->period_ms >= SHT3X::period(config->sht30_mode) / 1000) &&
+         (config->sht30_repeatability <= SHT3X_REPEATABILITY_LOW) &&
+         (config->pressure_forced <= 1);
+}
+
+int AcquisitionConfig::oversamplingRatio(uint8_t oversampling)
+{
+  if(oversampling == QMP6988_OVERSAMPLING_SKIPPED)
+    return 0;
+  return 1 << (oversampling - QMP6988_OVERSAMPLING_1X);
+}
+
+int AcquisitionConfig::oversamplingCode(int ratio)
+{
+  for(uint8_t code = QMP6988_OVERSAMPLING_SKIPPED; code <= QMP6988_OVERSAMPLING_64X; code++){
+    if(oversamplingRatio(code) == ratio)
+      return code;
+  }
+  return -1;
+}
+
+int AcquisitionConfig::filterRatio(uint8_t filter)
+{
+  if(filter == QMP6988_FILTERCOEFF_OFF)
+    return 0;
+  return 1 << filter;
+}
+
+int AcquisitionConfig::filterCode(int ratio)
+{
+  for(uint8_t code = QMP6988_FILTERCOEFF_OFF; code <= QMP6988_FILTERCOEFF_32; code++){
+    if(filterRatio(code) == ratio)
+      return code;
+  }
+  return -1;
+}
+
+const char* AcquisitionConfig::sht30ModeName(uint8_t mode)
+{
+  if(mode > SHT3X_MODE_ART)
+    return "unknown";
+  return acq_sht30_mode_names[mode];
+}
+
+int AcquisitionConfig::sht30ModeCode(const char* name)
+{
+  for(int i = SHT3X_MODE_SINGLE_SHOT; i <= SHT3X_MODE_ART; i++){
+    if(strcmp(name, acq_sht30_mode_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char* AcquisitionConfig::repeatabilityName(uint8_t repeatability)
+{
+  if(repeatability > SHT3X_REPEATABILITY_LOW)
+    return "unknown";
+  return acq_repeatability_names[repeatability];
+}
+
+int AcquisitionConfig::repeatabilityCode(const char* name)
+{
+  for(int i = SHT3X_REPEATABILITY_HIGH; i <= SHT3X_REPEATABILITY_LOW; i++){
+    if(strcmp(name, acq_repeatability_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
@@ -0,0 +1,61 @@
+#ifndef __ACQUISITION_CONFIG_H
+#define __ACQUISITION_CONFIG_H
+
+#include "Arduino.h"
+#include "QMP6988.h"
+#include "SHT3X.h"
+
+// limits for the runtime settings
+#define ACQ_PERIOD_MIN_MS   500
+#define ACQ_PERIOD_MAX_MS   3600000
+#define ACQ_AVERAGE_MAX     100
+
+// acquisition profiles
+#define ACQ_PROFILE_UNKNOWN   -1
+#define ACQ_PROFILE_LOW_NOISE  0
+#define ACQ_PROFILE_FAST       1
+
+typedef struct _acquisition_config {
+  uint32_t period_ms;     // measurement interval
+  uint8_t n_average;      // depth of the running average
+  uint8_t oversampling_p; // QMP6988_OVERSAMPLING_xx
+  uint8_t oversampling_t; // QMP6988_OVERSAMPLING_xx
+  uint8_t filter;         // QMP6988_FILTERCOEFF_xx
+  uint8_t sht30_mode;     // SHT3X_MODE_xx
+  uint8_t sht30_repeatability; // SHT3X_REPEATABILITY_xx
+  uint8_t pressure_forced; // 1: one QMP6988 conversion per sample (forced mode)
+} acquisition_config_t;
+
+// settings of the measurement that can be changed at runtime
+// and are stored in the NVS (Preferences) of the ESP32
+class AcquisitionConfig
+{
+public:
+  acquisition_config_t active;
+
+  // load the stored settings (or the low noise profile)
+  void begin();
+  // store the active settings
+  bool save();
+
+  // copy a predefined profile into config
+  static bool profile(int profile, acquisition_config_t* config);
+  static int profileNumber(const char* name);
+  static bool valid(const acquisition_config_t* config);
+
+  // conversion between register values and human readable numbers
+  // oversampling: 0 (skipped), 1, 2, 4 ... 64
+  // filter: 0 (off), 2, 4 ... 32
+  static int oversamplingRatio(uint8_t oversampling);
+  static int oversamplingCode(int ratio);
+  static int filterRatio(uint8_t filter);
+  static int filterCode(int ratio);
+  // SHT30 mode: single, 0.5, 1, 2, 4, 10 (measurements per second), art
+  // repeatability: high, medium, low
+  static const char* sht30ModeName(uint8_t mode);
+  static int sht30ModeCode(const char* name);
+  static const char* repeatabilityName(uint8_t repeatability);
+  static int repeatabilityCode(const char* name);
+};
+
+#endif
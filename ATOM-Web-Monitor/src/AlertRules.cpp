@@ -0,0 +1,132 @@
+#include "AlertRules.h"
+
+static const char* alert_type_names[] = {"above", "below", "rate", "stale"};
+
+const char* alert_type_name(uint8_t type)
+{
+  return type <= ALERT_STALE ? alert_type_names[type] : "unknown";
+}
+
+AlertRules::AlertRules()
+{
+  rules = NULL;
+  n_rules = 0;
+  event_head = 0;
+  event_count = 0;
+  dropped = 0;
+}
+
+void AlertRules::begin(const alert_rule_t* rules_in, uint8_t n, uint32_t now_ms)
+{
+  rules = rules_in;
+  n_rules = n > ALERT_MAX_RULES ? ALERT_MAX_RULES : n;
+  for(uint8_t i = 0; i < n_rules; i++){
+    state[i].firing = false;
+    state[i].pending = false;
+    state[i].has_value = false;
+    state[i].since_ms = now_ms;
+    state[i].last_value = 0.0f;
+    state[i].last_ms = now_ms;
+  }
+}
+
+void AlertRules::pushEvent(uint8_t index, bool firing, float value, uint32_t now_ms)
+{
+  if(event_count == ALERT_EVENT_QUEUE){
+    event_head = (event_head + 1) % ALERT_EVENT_QUEUE;
+    event_count--;
+    dropped++;
+  }
+  alert_event_t* event = &events[(event_head + event_count) % ALERT_EVENT_QUEUE];
+  event->rule = index;
+  event->firing = firing;
+  event->value = value;
+  event->time_ms = now_ms;
+  event_count++;
+}
+
+// condition: the rule should fire, clear: the rule may clear
+// (between both the hysteresis keeps the current state)
+void AlertRules::update(uint8_t index, bool condition, bool clear, float value, uint32_t now_ms)
+{
+  alert_state_t* s = &state[index];
+  if(s->firing){
+    if(clear){
+      s->firing = false;
+      s->pending = false;
+      pushEvent(index, false, value, now_ms);
+    }
+    return;
+  }
+  if(!condition){
+    s->pending = false;
+    return;
+  }
+  if(!s->pending){
+    s->pending = true;
+    s->since_ms = now_ms;
+  }
+  if(now_ms - s->since_ms >= rules[index].hold_ms){
+    s->firing = true;
+    s->pending = false;
+    pushEvent(index, true, value, now_ms);
+  }
+}
+
+void AlertRules::evaluate(const env_sample_t* sample)
+{
+  for(uint8_t i = 0; i < n_rules; i++){
+    const alert_rule_t* r = &rules[i];
+    alert_state_t* s = &state[i];
+    float value = env_sample_value(sample, r->metric);
+    // a failed read (NAN) neither raises nor clears an alert
+    if(!env_value_valid(value))
+      continue;
+    switch(r->type){
+      case ALERT_ABOVE:
+        update(i, value > r->threshold, value < r->threshold - r->hysteresis, value, sample->time_ms);
+        break;
+      case ALERT_BELOW:
+        update(i, value < r->threshold, value > r->threshold + r->hysteresis, value, sample->time_ms);
+        break;
+      case ALERT_RATE:
+        if(s->has_value && sample->time_ms != s->last_ms){
+          float rate = (value - s->last_value) * 60000.0f / (uint32_t)(sample->time_ms - s->last_ms);
+          float change = rate < 0.0f ? -rate : rate;
+          update(i, change > r->threshold, change < r->threshold - r->hysteresis, rate, sample->time_ms);
+        }
+        break;
+      case ALERT_STALE:
+        update(i, false, true, 0.0f, sample->time_ms);
+        break;
+    }
+    s->has_value = true;
+    s->last_value = value;
+    s->last_ms = sample->time_ms;
+  }
+}
+
+void AlertRules::tick(uint32_t now_ms)
+{
+  for(uint8_t i = 0; i < n_rules; i++){
+    if(rules[i].type != ALERT_STALE || state[i].firing)
+      continue;
+    float age_s = (uint32_t)(now_ms - state[i].last_ms) / 1000.0f;
+    update(i, age_s > rules[i].threshold, false, age_s, now_ms);
+  }
+}
+
+const alert_event_t* AlertRules::event(uint8_t i)
+{
+  if(i >= event_count)
+    return NULL;
+  return &events[(event_head + i) % ALERT_EVENT_QUEUE];
+}
+
+void AlertRules::consume(uint8_t n)
+{
+  if(n > event_count)
+    n = event_count;
+  event_head = (event_head + n) % ALERT_EVENT_QUEUE;
+  event_count -= n;
+}
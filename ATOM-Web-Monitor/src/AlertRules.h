@@ -0,0 +1,93 @@
+#ifndef __ALERT_RULES_H
+#define __ALERT_RULES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "EnvSample.h"
+
+// alert rules that are evaluated incrementally with every sample
+// O(rules) per sample, all state is kept in fixed arrays,
+// the time is passed in (tick() for the stale rules)
+
+#define ALERT_MAX_RULES    8
+// state changes waiting for the delivery
+#define ALERT_EVENT_QUEUE  16
+
+// rule types:
+// value above the threshold, clears below threshold - hysteresis
+#define ALERT_ABOVE  0
+// value below the threshold, clears above threshold + hysteresis
+#define ALERT_BELOW  1
+// change per minute (either direction) above the threshold,
+// clears below threshold - hysteresis
+#define ALERT_RATE   2
+// no valid value for threshold seconds, clears with the next valid value
+#define ALERT_STALE  3
+
+typedef struct _alert_rule {
+  const char* name;
+  uint8_t type;         // ALERT_xxx
+  int8_t metric;        // SERIES_xxx
+  float threshold;
+  float hysteresis;
+  // hold-off: the condition has to be true for this time
+  // before the rule fires (0: fire with the first sample)
+  uint32_t hold_ms;
+} alert_rule_t;
+
+typedef struct _alert_event {
+  uint8_t rule;         // index of the rule
+  bool firing;          // true: fired, false: cleared
+  float value;          // value (rate, age in s) that caused the change
+  uint32_t time_ms;     // millis() of the change
+} alert_event_t;
+
+typedef struct _alert_state {
+  bool firing;
+  bool pending;         // condition true, hold-off running
+  bool has_value;
+  uint32_t since_ms;    // start of the hold-off
+  float last_value;     // previous valid value of the metric
+  uint32_t last_ms;     // time of the previous valid value
+} alert_state_t;
+
+class AlertRules
+{
+private:
+  const alert_rule_t* rules;
+  uint8_t n_rules;
+  alert_state_t state[ALERT_MAX_RULES];
+  // ring of state changes, the oldest is dropped if it is full
+  alert_event_t events[ALERT_EVENT_QUEUE];
+  uint8_t event_head;
+  uint8_t event_count;
+
+  void update(uint8_t index, bool condition, bool clear, float value, uint32_t now_ms);
+  void pushEvent(uint8_t index, bool firing, float value, uint32_t now_ms);
+
+public:
+  uint32_t dropped;     // events lost because the queue was full
+
+  AlertRules();
+  // the rules are not copied and have to stay valid
+  // now_ms: start of the stale timers
+  void begin(const alert_rule_t* rules_in, uint8_t n, uint32_t now_ms);
+  // evaluate all rules with a new sample
+  void evaluate(const env_sample_t* sample);
+  // stale rules are checked on time, also without new samples
+  void tick(uint32_t now_ms);
+
+  uint8_t size() { return n_rules; }
+  const alert_rule_t* rule(uint8_t index) { return &rules[index]; }
+  bool isFiring(uint8_t index) { return state[index].firing; }
+
+  // events in the order they happened
+  uint8_t pending() { return event_count; }
+  const alert_event_t* event(uint8_t i);
+  // remove the oldest n events (after they were delivered)
+  void consume(uint8_t n);
+};
+
+const char* alert_type_name(uint8_t type);
+
+#endif
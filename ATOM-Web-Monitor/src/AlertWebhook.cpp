@@ -0,0 +1,155 @@
+#include "AlertWebhook.h"
+#include "TimeSync.h"
+
+static const char* webhook_metric_names[] = {"temperature", "humidity", "pressure"};
+
+AlertWebhook::AlertWebhook()
+{
+  client = NULL;
+  host = NULL;
+  port = 80;
+  path = "/";
+  device = "atom-env";
+  retry_ms = WEBHOOK_RETRY_MS;
+  next_try_ms = 0;
+  waiting = false;
+  first_pending_ms = 0;
+  state = WEBHOOK_IDLE;
+  sent_events = 0;
+  sent_dropped = 0;
+  sent_ms = 0;
+  status_len = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void AlertWebhook::begin(WiFiClient* client_in, const char* host_in, uint16_t port_in,
+                         const char* path_in, const char* device_in)
+{
+  client = client_in;
+  host = host_in;
+  port = port_in;
+  path = path_in;
+  device = device_in;
+  next_try_ms = millis();
+}
+
+size_t AlertWebhook::formatBody(AlertRules* alerts, uint8_t* n_events)
+{
+  size_t len = snprintf(body, sizeof(body), "{\"device\":\"%s\",\"alerts\":[", device);
+  uint8_t n = 0;
+  while(n < alerts->pending() && n < WEBHOOK_MAX_BATCH){
+    const alert_event_t* event = alerts->event(n);
+    const alert_rule_t* rule = alerts->rule(event->rule);
+    char item[256];
+    size_t item_len = snprintf(item, sizeof(item),
+      "%s{\"rule\":\"%s\",\"type\":\"%s\",\"metric\":\"%s\",\"state\":\"%s\",\"value\":%.2f,"
+      "\"threshold\":%.2f,\"time_ms\":%u",
+      n > 0 ? "," : "", rule->name, alert_type_name(rule->type),
+      webhook_metric_names[rule->metric < SERIES_COUNT ? rule->metric : 0],
+      event->firing ? "firing" : "cleared", event->value, rule->threshold,
+      (unsigned int)event->time_ms);
+    uint64_t epoch_ns = time_epoch_ns(event->time_ms);
+    if(epoch_ns > 0 && item_len < sizeof(item))
+      item_len += snprintf(&item[item_len], sizeof(item) - item_len, ",\"utc\":%u",
+                           (unsigned int)(epoch_ns / 1000000000ULL));
+    // room for this item, its closing brace and the end of the document
+    if(item_len + 1 >= sizeof(item) || len + item_len + 4 > sizeof(body))
+      break;
+    memcpy(&body[len], item, item_len);
+    len += item_len;
+    body[len++] = '}';
+    n++;
+  }
+  body[len++] = ']';
+  body[len++] = '}';
+  body[len] = 0;
+  *n_events = n;
+  return len;
+}
+
+// one POST per connection, false if it could not be sent,
+// readStatus() waits for the answer
+bool AlertWebhook::post(const char* data, size_t len)
+{
+  if(!client->connect(host, port, WEBHOOK_CONNECT_TIMEOUT_MS))
+    return false;
+  client->printf("POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+                 "Content-Length: %u\r\nConnection: close\r\n\r\n", path, host, (unsigned int)len);
+  if(client->write((const uint8_t*)data, len) != len){
+    client->stop();
+    return false;
+  }
+  status_len = 0;
+  sent_ms = millis();
+  state = WEBHOOK_SENT;
+  return true;
+}
+
+// status line "HTTP/1.1 200 OK" as far as it has arrived
+void AlertWebhook::readStatus(AlertRules* alerts)
+{
+  while(status_len < sizeof(status) - 1 && client->available())
+    status[status_len++] = client->read();
+  if(status_len == sizeof(status) - 1){
+    status[status_len] = 0;
+    finish(alerts, strncmp(status, "HTTP/1.", 7) == 0 && status[9] == '2');
+  } else if(!client->connected() || millis() - sent_ms >= WEBHOOK_TIMEOUT_MS){
+    finish(alerts, false);
+  }
+}
+
+void AlertWebhook::finish(AlertRules* alerts, bool ok)
+{
+  client->stop();
+  state = WEBHOOK_IDLE;
+  if(ok){
+    // events that were sent and dropped from the full queue meanwhile
+    uint32_t lost = alerts->dropped - sent_dropped;
+    alerts->consume(lost < sent_events ? sent_events - lost : 0);
+    stats.posts++;
+    stats.events += sent_events;
+    retry_ms = WEBHOOK_RETRY_MS;
+    next_try_ms = millis();
+    waiting = false;
+  } else {
+    stats.failed++;
+    Serial.printf("[ERR] alert webhook %s:%u failed, retry in %u s\n", host, port, (unsigned int)(retry_ms / 1000));
+    next_try_ms = millis() + retry_ms;
+    retry_ms = retry_ms * 2 > WEBHOOK_RETRY_MAX_MS ? WEBHOOK_RETRY_MAX_MS : retry_ms * 2;
+  }
+}
+
+void AlertWebhook::loop(AlertRules* alerts)
+{
+  if(state == WEBHOOK_SENT){
+    readStatus(alerts);
+    return;
+  }
+  if(!enabled() || alerts->pending() == 0){
+    waiting = false;
+    return;
+  }
+  uint32_t now = millis();
+  // wait a moment for further events (e.g. temperature and
+  // humidity rules that fire with the same sample)
+  if(!waiting){
+    waiting = true;
+    first_pending_ms = now;
+  }
+  if(alerts->pending() < WEBHOOK_MAX_BATCH && now - first_pending_ms < WEBHOOK_DELAY_MS)
+    return;
+  if((int32_t)(now - next_try_ms) < 0)
+    return;
+
+  uint8_t n_events;
+  size_t len = formatBody(alerts, &n_events);
+  if(n_events == 0){
+    // an event that does not fit into a body at all
+    alerts->consume(1);
+    return;
+  }
+  sent_events = n_events;
+  sent_dropped = alerts->dropped;
+  if(!post(body, len))
+    finish(alerts, false);
+}
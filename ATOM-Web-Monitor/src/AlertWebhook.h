@@ -0,0 +1,76 @@
+#ifndef __ALERT_WEBHOOK_H
+#define __ALERT_WEBHOOK_H
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "AlertRules.h"
+
+// most events in one POST
+#define WEBHOOK_MAX_BATCH    8
+#define WEBHOOK_MAX_BODY     1024
+// collect the events of this time into one POST
+#define WEBHOOK_DELAY_MS     2000
+// the TCP connect blocks loop() for at most
+#define WEBHOOK_CONNECT_TIMEOUT_MS 300
+// wait for the HTTP status line (read across the calls of loop())
+#define WEBHOOK_TIMEOUT_MS   3000
+// retry interval after a failed POST (doubled up to the maximum)
+#define WEBHOOK_RETRY_MS     5000
+#define WEBHOOK_RETRY_MAX_MS 300000
+
+typedef struct _webhook_stats {
+  uint32_t posts;       // successful POSTs
+  uint32_t events;      // events delivered
+  uint32_t failed;      // POSTs without 2xx answer
+} webhook_stats_t;
+
+// state of the delivery
+#define WEBHOOK_IDLE         0
+#define WEBHOOK_SENT         1  // POST sent, waiting for the status line
+
+// delivers the events of the alert rules as batched HTTP POST:
+// {"device":"..","alerts":[{"rule":"..","type":"above","metric":"temperature",
+//  "state":"firing","value":30.12,"threshold":30.00,"time_ms":..,"utc":..},..]}
+// ("utc" in s since 1970, only if the clock is set)
+// An event is removed from the queue after the webhook answered 2xx.
+// loop() never waits for the answer, only the TCP connect blocks
+// (up to WEBHOOK_CONNECT_TIMEOUT_MS).
+class AlertWebhook
+{
+private:
+  WiFiClient* client;
+  const char* host;
+  uint16_t port;
+  const char* path;
+  const char* device;
+  uint32_t retry_ms;
+  uint32_t next_try_ms;
+  bool waiting;
+  uint32_t first_pending_ms;
+  char body[WEBHOOK_MAX_BODY];
+  // the POST on its way
+  uint8_t state;
+  uint8_t sent_events;
+  uint32_t sent_dropped;
+  uint32_t sent_ms;
+  char status[13];
+  uint8_t status_len;
+
+  size_t formatBody(AlertRules* alerts, uint8_t* n_events);
+  bool post(const char* data, size_t len);
+  void readStatus(AlertRules* alerts);
+  void finish(AlertRules* alerts, bool ok);
+
+public:
+  webhook_stats_t stats;
+
+  AlertWebhook();
+  // path e.g. "/alerts", device: name sent with every POST
+  void begin(WiFiClient* client_in, const char* host_in, uint16_t port_in,
+             const char* path_in, const char* device_in);
+  bool enabled() { return host != NULL && host[0] != 0; }
+  // send the pending events, has to be called from loop()
+  void loop(AlertRules* alerts);
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __ALTITUDE_H
+#define __ALTITUDE_H
+
+#include <stdint.h>
+#include <math.h>
+
+// barometric altitude without pow() per sample,
+// qmp6988_bench checks the table against the formula
+//
+// the reference (QMP6988::calcAltitude) is the hypsometric formula
+//   h = ((p0 / p)^(1/5.257) - 1) * (T + 273.15) / 0.0065
+// AltitudeTable keeps (p0 / p)^(1/5.257) - 1 in a table of 257 points
+// over 300 ... 1100 hPa and interpolates linearly, so an altitude costs
+// one table lookup and four multiplications
+//
+// largest error against the reference in double precision
+// (qmp6988_bench, p0 = 1013.25 hPa, step 1 Pa, -40 ... 85 degC):
+//   300 ... 1100 hPa (~12 km ... -700 m)   0.21 m
+//   700 ... 1100 hPa (~3.3 km ... -700 m)  0.034 m
+//   900 ... 1100 hPa                       0.020 m
+// (for comparison: 1 Pa ~ 8 cm at sea level)
+// the interpolation error grows with the square of the segment width
+// and with 1/p^2, near sea level the float rounding dominates,
+// outside of the table the last segment is extrapolated
+
+#define ALTITUDE_PRESSURE_MIN     30000.0F   // Pa
+#define ALTITUDE_PRESSURE_MAX     110000.0F  // Pa
+#define ALTITUDE_TABLE_SEGMENTS   256
+#define ALTITUDE_SEA_LEVEL        101325.0F  // Pa, standard atmosphere
+#define ALTITUDE_TEMPERATURE      15.0F      // degC, standard atmosphere
+#define ALTITUDE_EXPONENT         (1.0 / 5.257)
+
+// reference formula in double precision
+static inline double altitude_reference(double pressure, double temperature, double sea_level = ALTITUDE_SEA_LEVEL)
+{
+  return (pow(sea_level / pressure, ALTITUDE_EXPONENT) - 1.0) * (temperature + 273.15) / 0.0065;
+}
+
+class AltitudeTable {
+public:
+  // build the table for a sea level pressure (QNH) in Pa,
+  // 257 calls of pow(), only needed again if the QNH changes
+  void begin(float sea_level = ALTITUDE_SEA_LEVEL){
+    sea_level_pa = sea_level;
+    for(int i = 0; i <= ALTITUDE_TABLE_SEGMENTS; i++){
+      double p = ALTITUDE_PRESSURE_MIN + i * (double)(ALTITUDE_PRESSURE_MAX - ALTITUDE_PRESSURE_MIN) / ALTITUDE_TABLE_SEGMENTS;
+      table[i] = (float)(pow(sea_level / p, ALTITUDE_EXPONENT) - 1.0);
+    }
+  }
+
+  float seaLevel() const { return sea_level_pa; }
+
+  // altitude in m above the sea level pressure,
+  // pressure in Pa, temperature of the air in degC
+  float altitude(float pressure, float temperature) const {
+    float x = (pressure - ALTITUDE_PRESSURE_MIN) * (ALTITUDE_TABLE_SEGMENTS / (ALTITUDE_PRESSURE_MAX - ALTITUDE_PRESSURE_MIN));
+    int i = (int)x;
+    if(x < 0.0F)
+      i = 0;
+    else if(i >= ALTITUDE_TABLE_SEGMENTS)
+      i = ALTITUDE_TABLE_SEGMENTS - 1;
+    float r = table[i] + (x - i) * (table[i + 1] - table[i]);
+    return r * (temperature + 273.15F) * (1.0F / 0.0065F);
+  }
+
+private:
+  float sea_level_pa;
+  float table[ALTITUDE_TABLE_SEGMENTS + 1];
+};
+
+// vertical speed from the altitude of the samples, alpha-beta filter
+// with the critically damped gains (beta = alpha^2 / (2 - alpha)),
+// a smaller alpha smoothes more (noise of the QMP6988 ~ 10 cm)
+// and follows a change of the speed after ~ 2 / alpha samples
+class VerticalSpeed {
+public:
+  void begin(float alpha = 0.1F){
+    a = alpha;
+    b = alpha * alpha / (2.0F - alpha);
+    reset();
+  }
+
+  void reset(){
+    valid = false;
+    h = 0.0F;
+    v = 0.0F;
+  }
+
+  void update(float altitude, uint32_t time_ms){
+    if(!valid){
+      valid = true;
+      h = altitude;
+      v = 0.0F;
+      last_ms = time_ms;
+      return;
+    }
+    float dt = (uint32_t)(time_ms - last_ms) / 1000.0F;
+    if(dt <= 0.0F)
+      return;
+    last_ms = time_ms;
+    // predict and correct with the residual
+    h += v * dt;
+    float r = altitude - h;
+    h += a * r;
+    v += b * r / dt;
+  }
+
+  // filtered altitude in m and vertical speed in m/s
+  float altitude() const { return h; }
+  float speed() const { return v; }
+
+private:
+  float a, b;
+  bool valid;
+  float h, v;
+  uint32_t last_ms;
+};
+
+#endif
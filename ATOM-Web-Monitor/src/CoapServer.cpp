@@ -0,0 +1,363 @@
+#include "CoapServer.h"
+
+// message types
+#define COAP_CON  0
+#define COAP_NON  1
+#define COAP_ACK  2
+#define COAP_RST  3
+
+// codes (class << 5 | detail)
+#define COAP_EMPTY               0x00
+#define COAP_GET                 0x01
+#define COAP_CONTENT             0x45  // 2.05
+#define COAP_BAD_REQUEST         0x80  // 4.00
+#define COAP_BAD_OPTION          0x82  // 4.02
+#define COAP_NOT_FOUND           0x84  // 4.04
+#define COAP_METHOD_NOT_ALLOWED  0x85  // 4.05
+#define COAP_SERVICE_UNAVAILABLE 0xA3  // 5.03
+
+// option numbers
+#define COAP_OPT_URI_HOST        3
+#define COAP_OPT_OBSERVE         6
+#define COAP_OPT_URI_PORT        7
+#define COAP_OPT_URI_PATH        11
+#define COAP_OPT_CONTENT_FORMAT  12
+#define COAP_OPT_MAX_AGE         14
+#define COAP_OPT_URI_QUERY       15
+
+#define COAP_FORMAT_TEXT         0
+#define COAP_FORMAT_LINK         40
+
+#define COAP_PAYLOAD_MARKER      0xFF
+
+static const char* coap_paths[] = {"env/temperature", "env/humidity", "env/pressure", ".well-known/core"};
+static const char* coap_discovery = "</env/temperature>;obs;rt=\"temperature\","
+                                    "</env/humidity>;obs;rt=\"humidity\","
+                                    "</env/pressure>;obs;rt=\"pressure\"";
+
+// critical options (odd numbers) the server knows: the host and the
+// port are always the ones of this server, a query is ignored
+static bool coap_option_known(uint16_t number)
+{
+  return (number & 1) == 0 || number == COAP_OPT_URI_HOST || number == COAP_OPT_URI_PORT ||
+         number == COAP_OPT_URI_PATH || number == COAP_OPT_URI_QUERY;
+}
+
+// write one option, options have to be added in ascending order
+static size_t coap_put_option(uint8_t* buf, uint16_t* last_number, uint16_t number,
+                              const uint8_t* value, size_t value_len)
+{
+  size_t len = 1;
+  uint16_t delta = number - *last_number;
+  uint8_t delta_nibble, len_nibble;
+
+  *last_number = number;
+  // extended delta / length (only the 1 byte form is needed here)
+  delta_nibble = (delta < 13) ? delta : 13;
+  len_nibble = (value_len < 13) ? value_len : 13;
+  buf[0] = (delta_nibble << 4) | len_nibble;
+  if(delta_nibble == 13)
+    buf[len++] = delta - 13;
+  if(len_nibble == 13)
+    buf[len++] = value_len - 13;
+  memcpy(&buf[len], value, value_len);
+  return len + value_len;
+}
+
+// unsigned integer option value with the least number of bytes
+static size_t coap_put_uint_option(uint8_t* buf, uint16_t* last_number, uint16_t number, uint32_t value)
+{
+  uint8_t data[4];
+  size_t n = 0;
+  if(value > 0xFFFFFF) data[n++] = value >> 24;
+  if(value > 0xFFFF) data[n++] = (value >> 16) & 0xff;
+  if(value > 0xFF) data[n++] = (value >> 8) & 0xff;
+  if(value > 0) data[n++] = value & 0xff;
+  return coap_put_option(buf, last_number, number, data, n);
+}
+
+CoapServer::CoapServer()
+{
+  for(int i = 0; i < COAP_MAX_OBSERVERS; i++)
+    observers[i].active = false;
+  memset(&stats, 0, sizeof(stats));
+  has_sample = false;
+  confirmable = false;
+  max_age_s = 60;
+  next_mid = 1;
+  observe_seq = 2;
+}
+
+void CoapServer::begin(uint16_t port, bool confirmable_in)
+{
+  confirmable = confirmable_in;
+  next_mid = (uint16_t)micros();
+  udp.begin(port);
+}
+
+uint8_t CoapServer::observerCount()
+{
+  uint8_t n = 0;
+  for(int i = 0; i < COAP_MAX_OBSERVERS; i++){
+    if(observers[i].active)
+      n++;
+  }
+  return n;
+}
+
+coap_observer_t* CoapServer::findObserver(IPAddress ip, uint16_t port, const uint8_t* token, uint8_t token_len)
+{
+  for(int i = 0; i < COAP_MAX_OBSERVERS; i++){
+    coap_observer_t* obs = &observers[i];
+    if(obs->active && obs->ip == ip && obs->port == port &&
+       obs->token_len == token_len && memcmp(obs->token, token, token_len) == 0)
+      return obs;
+  }
+  return NULL;
+}
+
+void CoapServer::send(IPAddress ip, uint16_t port, const uint8_t* msg, size_t len)
+{
+  udp.beginPacket(ip, port);
+  udp.write(msg, len);
+  udp.endPacket();
+  stats.bytes_sent += len;
+}
+
+size_t CoapServer::buildResponse(uint8_t* out, uint8_t type, uint8_t code, uint16_t mid,
+                                 const uint8_t* token, uint8_t token_len,
+                                 int resource, bool observe)
+{
+  size_t len = 0;
+  uint16_t last_number = 0;
+  char value[16];
+  const char* payload = NULL;
+  size_t payload_len = 0;
+
+  out[len++] = 0x40 | (type << 4) | token_len;
+  out[len++] = code;
+  out[len++] = mid >> 8;
+  out[len++] = mid & 0xff;
+  memcpy(&out[len], token, token_len);
+  len += token_len;
+  if(code != COAP_CONTENT)
+    return len;
+
+  if(resource == COAP_RES_DISCOVERY){
+    len += coap_put_uint_option(&out[len], &last_number, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_LINK);
+    payload = coap_discovery;
+    payload_len = strlen(coap_discovery);
+  } else {
+    // the resources are numbered like the metrics of a sample
+    float v = env_sample_value(&last_sample, resource);
+    if(observe)
+      len += coap_put_uint_option(&out[len], &last_number, COAP_OPT_OBSERVE, observe_seq & 0xFFFFFF);
+    len += coap_put_uint_option(&out[len], &last_number, COAP_OPT_CONTENT_FORMAT, COAP_FORMAT_TEXT);
+    len += coap_put_uint_option(&out[len], &last_number, COAP_OPT_MAX_AGE, max_age_s);
+    payload_len = snprintf(value, sizeof(value), "%.2f", v);
+    payload = value;
+  }
+  // the discovery document is the only payload that could be too large
+  if(len + 1 + payload_len > COAP_MAX_MESSAGE)
+    payload_len = COAP_MAX_MESSAGE - len - 1;
+  out[len++] = COAP_PAYLOAD_MARKER;
+  memcpy(&out[len], payload, payload_len);
+  return len + payload_len;
+}
+
+void CoapServer::handleMessage(const uint8_t* msg, size_t len, IPAddress ip, uint16_t port)
+{
+  uint8_t type, token_len, code;
+  uint16_t mid;
+  const uint8_t* token;
+  size_t pos;
+  char path[40];
+  size_t path_len = 0;
+  bool path_overflow = false;
+  bool bad_option = false;
+  bool has_observe = false;
+  uint32_t observe = 0;
+  uint16_t number = 0;
+
+  if(len < 4 || (msg[0] >> 6) != 1)
+    return;
+  type = (msg[0] >> 4) & 0x03;
+  token_len = msg[0] & 0x0F;
+  code = msg[1];
+  mid = (msg[2] << 8) | msg[3];
+  if(token_len > COAP_MAX_TOKEN || len < 4 + (size_t)token_len)
+    return;
+  token = &msg[4];
+
+  // answer (ACK or RST) to a confirmable notification
+  if(type == COAP_ACK || type == COAP_RST){
+    for(int i = 0; i < COAP_MAX_OBSERVERS; i++){
+      coap_observer_t* obs = &observers[i];
+      if(obs->active && obs->ack_pending && obs->pending_mid == mid && obs->ip == ip && obs->port == port){
+        obs->ack_pending = false;
+        obs->missed_acks = 0;
+        // a reset cancels the observation
+        if(type == COAP_RST)
+          obs->active = false;
+      }
+    }
+    return;
+  }
+  if(code == COAP_EMPTY){
+    // CoAP ping: answer with a reset
+    if(type == COAP_CON){
+      uint8_t rst[4] = {0x40 | (COAP_RST << 4), COAP_EMPTY, msg[2], msg[3]};
+      send(ip, port, rst, 4);
+    }
+    return;
+  }
+  stats.requests++;
+
+  // options
+  pos = 4 + token_len;
+  while(pos < len && msg[pos] != COAP_PAYLOAD_MARKER){
+    uint16_t delta = msg[pos] >> 4;
+    uint16_t opt_len = msg[pos] & 0x0F;
+    pos++;
+    if(delta == 13){ if(pos >= len) return; delta = 13 + msg[pos++]; }
+    else if(delta == 14){ if(pos + 1 >= len) return; delta = 269 + ((msg[pos] << 8) | msg[pos+1]); pos += 2; }
+    else if(delta == 15) return;
+    if(opt_len == 13){ if(pos >= len) return; opt_len = 13 + msg[pos++]; }
+    else if(opt_len == 14){ if(pos + 1 >= len) return; opt_len = 269 + ((msg[pos] << 8) | msg[pos+1]); pos += 2; }
+    else if(opt_len == 15) return;
+    if(pos + opt_len > len)
+      return;
+    number += delta;
+    if(!coap_option_known(number))
+      bad_option = true;
+    if(number == COAP_OPT_URI_PATH){
+      // a path that does not fit is no resource of this server
+      if(path_len + opt_len + 1 < sizeof(path)){
+        if(path_len > 0)
+          path[path_len++] = '/';
+        memcpy(&path[path_len], &msg[pos], opt_len);
+        path_len += opt_len;
+      } else {
+        path_overflow = true;
+      }
+    } else if(number == COAP_OPT_OBSERVE){
+      has_observe = true;
+      observe = 0;
+      for(uint16_t i = 0; i < opt_len; i++)
+        observe = (observe << 8) | msg[pos + i];
+    }
+    pos += opt_len;
+  }
+  path[path_len] = 0;
+  // an unrecognized critical option rejects a NON request (RFC 7252 5.4.1)
+  if(bad_option && type == COAP_NON){
+    uint8_t rst[4] = {0x40 | (COAP_RST << 4), COAP_EMPTY, msg[2], msg[3]};
+    send(ip, port, rst, 4);
+    return;
+  }
+
+  int resource = COAP_RES_UNKNOWN;
+  for(int i = 0; i < 4 && !path_overflow; i++){
+    if(strcmp(path, coap_paths[i]) == 0)
+      resource = i;
+  }
+
+  // piggybacked response for CON, new NON message for NON requests
+  uint8_t resp_type = (type == COAP_CON) ? COAP_ACK : COAP_NON;
+  uint16_t resp_mid = (type == COAP_CON) ? mid : next_mid++;
+  uint8_t resp_code = COAP_CONTENT;
+  if(bad_option)
+    resp_code = COAP_BAD_OPTION;
+  else if(code != COAP_GET)
+    resp_code = COAP_METHOD_NOT_ALLOWED;
+  else if(resource == COAP_RES_UNKNOWN || (resource != COAP_RES_DISCOVERY && !has_sample))
+    resp_code = COAP_NOT_FOUND;
+  else if(resource != COAP_RES_DISCOVERY && !env_value_valid(env_sample_value(&last_sample, resource)))
+    resp_code = COAP_SERVICE_UNAVAILABLE;
+
+  bool observing = false;
+  if(resp_code == COAP_CONTENT && has_observe && resource != COAP_RES_DISCOVERY){
+    coap_observer_t* obs = findObserver(ip, port, token, token_len);
+    if(observe == 0){
+      // register (or refresh) an observation
+      if(obs == NULL){
+        for(int i = 0; i < COAP_MAX_OBSERVERS && obs == NULL; i++){
+          if(!observers[i].active)
+            obs = &observers[i];
+        }
+      }
+      if(obs != NULL){
+        obs->active = true;
+        obs->ip = ip;
+        obs->port = port;
+        obs->resource = resource;
+        obs->token_len = token_len;
+        memcpy(obs->token, token, token_len);
+        obs->ack_pending = false;
+        obs->missed_acks = 0;
+        observing = true;
+      }
+    } else if(obs != NULL){
+      // deregister
+      obs->active = false;
+    }
+  }
+  len = buildResponse(buffer, resp_type, resp_code, resp_mid, token, token_len, resource, observing);
+  send(ip, port, buffer, len);
+}
+
+void CoapServer::notify(const env_sample_t* sample)
+{
+  last_sample = *sample;
+  has_sample = true;
+  observe_seq++;
+
+  for(int i = 0; i < COAP_MAX_OBSERVERS; i++){
+    coap_observer_t* obs = &observers[i];
+    if(!obs->active)
+      continue;
+    // a missing value is not sent, the client sees it by the max-age
+    if(!env_value_valid(env_sample_value(sample, obs->resource)))
+      continue;
+    if(obs->ack_pending){
+      // the client did not acknowledge the last notification
+      obs->missed_acks++;
+      if(obs->missed_acks >= COAP_MAX_MISSED_ACKS){
+        obs->active = false;
+        stats.dropped_observers++;
+        continue;
+      }
+    }
+    uint16_t mid = next_mid++;
+    size_t len = buildResponse(buffer, confirmable ? COAP_CON : COAP_NON, COAP_CONTENT, mid,
+                               obs->token, obs->token_len, obs->resource, true);
+    send(obs->ip, obs->port, buffer, len);
+    stats.notifications++;
+    if(confirmable){
+      obs->ack_pending = true;
+      obs->pending_mid = mid;
+    }
+  }
+}
+
+void CoapServer::loop()
+{
+  int len;
+  // handle a few requests per call to keep loop() responsive
+  for(int i = 0; i < 4; i++){
+    len = udp.parsePacket();
+    if(len <= 0)
+      return;
+    if(len > COAP_MAX_MESSAGE){
+      // too large for this server, skip it
+      udp.flush();
+      continue;
+    }
+    len = udp.read(buffer, COAP_MAX_MESSAGE);
+    if(len > 0){
+      uint8_t request[COAP_MAX_MESSAGE];
+      memcpy(request, buffer, len);
+      handleMessage(request, len, udp.remoteIP(), udp.remotePort());
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef __COAP_SERVER_H
+#define __COAP_SERVER_H
+
+#include "Arduino.h"
+#include "WiFiUdp.h"
+#include "EnvSample.h"
+
+#define COAP_DEFAULT_PORT     5683
+// size of the receive and transmit buffer
+#define COAP_MAX_MESSAGE      160
+// number of observer registrations
+#define COAP_MAX_OBSERVERS    8
+// observers are dropped after this number of unacknowledged
+// confirmable notifications in a row
+#define COAP_MAX_MISSED_ACKS  3
+#define COAP_MAX_TOKEN        8
+
+// resources
+#define COAP_RES_TEMPERATURE  0
+#define COAP_RES_HUMIDITY     1
+#define COAP_RES_PRESSURE     2
+#define COAP_RES_DISCOVERY    3
+#define COAP_RES_UNKNOWN      -1
+
+typedef struct _coap_observer {
+  bool active;
+  IPAddress ip;
+  uint16_t port;
+  int8_t resource;
+  uint8_t token_len;
+  uint8_t token[COAP_MAX_TOKEN];
+  // message id of the last confirmable notification
+  // that was not acknowledged yet
+  bool ack_pending;
+  uint16_t pending_mid;
+  uint8_t missed_acks;
+} coap_observer_t;
+
+typedef struct _coap_stats {
+  uint32_t requests;
+  uint32_t notifications;
+  uint32_t bytes_sent;
+  uint32_t dropped_observers;
+} coap_stats_t;
+
+// CoAP (RFC 7252) server for the ENV values with Observe (RFC 7641)
+//   /env/temperature   degC
+//   /env/humidity      %
+//   /env/pressure      Pa
+//   /.well-known/core  resource discovery
+// The values are sent as text/plain. Every new sample is
+// sent to all observers as confirmable or non-confirmable
+// notification.
+class CoapServer
+{
+private:
+  WiFiUDP udp;
+  coap_observer_t observers[COAP_MAX_OBSERVERS];
+  env_sample_t last_sample;
+  bool has_sample;
+  bool confirmable;
+  uint32_t max_age_s;
+  uint16_t next_mid;
+  uint32_t observe_seq;
+  uint8_t buffer[COAP_MAX_MESSAGE];
+
+  void handleMessage(const uint8_t* msg, size_t len, IPAddress ip, uint16_t port);
+  size_t buildResponse(uint8_t* out, uint8_t type, uint8_t code, uint16_t mid,
+                       const uint8_t* token, uint8_t token_len,
+                       int resource, bool observe);
+  void send(IPAddress ip, uint16_t port, const uint8_t* msg, size_t len);
+  coap_observer_t* findObserver(IPAddress ip, uint16_t port, const uint8_t* token, uint8_t token_len);
+
+public:
+  coap_stats_t stats;
+
+  CoapServer();
+  // confirmable_in: send notifications as CON (true) or NON (false)
+  void begin(uint16_t port, bool confirmable_in);
+  // freshness of a value in seconds (measurement interval)
+  void setMaxAge(uint32_t max_age_in) { max_age_s = max_age_in; }
+  // new measurement: update the values and notify the observers
+  void notify(const env_sample_t* sample);
+  uint8_t observerCount();
+  // handle incoming requests, has to be called from loop()
+  void loop();
+};
+
+#endif
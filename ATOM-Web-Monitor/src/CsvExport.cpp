@@ -0,0 +1,82 @@
+#include "CsvExport.h"
+
+CsvExport::CsvExport()
+{
+  history = NULL;
+  next_seq = 0;
+  end_seq = 0;
+  running = false;
+}
+
+void CsvExport::begin(WiFiClient& client_in, History* history_in, uint32_t from_ms, uint32_t to_ms)
+{
+  client = client_in;
+  history = history_in;
+  next_seq = history->findSeq(from_ms);
+  // samples taken after the request are not part of the export
+  end_seq = (to_ms == 0xFFFFFFFF) ? history->nextSeq() : history->findSeq(to_ms + 1);
+  running = true;
+
+  client.println("HTTP/1.1 200 OK");
+  client.println("Content-type:text/csv");
+  client.println("Content-Disposition: attachment; filename=\"atom-env.csv\"");
+  client.println("Transfer-Encoding: chunked");
+  client.println("Connection: close");
+  client.println();
+  const char* header = "seq,time_ms,temperature_C,humidity_pct,pressure_Pa\n";
+  sendChunk(header, strlen(header));
+}
+
+void CsvExport::sendChunk(const char* data, size_t len)
+{
+  char size_line[12];
+  int n = snprintf(size_line, sizeof(size_line), "%X\r\n", (unsigned int)len);
+  client.write((const uint8_t*)size_line, n);
+  client.write((const uint8_t*)data, len);
+  client.write((const uint8_t*)"\r\n", 2);
+}
+
+void CsvExport::finish()
+{
+  // the zero length chunk terminates the body
+  client.write((const uint8_t*)"0\r\n\r\n", 5);
+  client.stop();
+  running = false;
+}
+
+void CsvExport::poll()
+{
+  env_sample_t sample;
+  size_t len = 0;
+
+  if(!running)
+    return;
+  if(!client.connected()){
+    client.stop();
+    running = false;
+    return;
+  }
+  // samples that were overwritten during the export are skipped
+  if(next_seq < history->firstSeq())
+    next_seq = history->firstSeq();
+
+  while((next_seq < end_seq) && (len + CSV_EXPORT_MAX_ROW <= sizeof(buffer))){
+    if(history->get(next_seq, &sample)){
+      len += snprintf(&buffer[len], sizeof(buffer) - len, "%u,%u",
+                      (unsigned int)sample.seq, (unsigned int)sample.time_ms);
+      // a missing value is an empty field
+      for(int metric = 0; metric < SERIES_COUNT; metric++){
+        float value = env_sample_value(&sample, metric);
+        buffer[len++] = ',';
+        if(env_value_valid(value))
+          len += snprintf(&buffer[len], sizeof(buffer) - len, "%.2f", value);
+      }
+      buffer[len++] = '\n';
+    }
+    next_seq++;
+  }
+  if(len > 0)
+    sendChunk(buffer, len);
+  if(next_seq >= end_seq)
+    finish();
+}
@@ -0,0 +1,41 @@
+#ifndef __CSV_EXPORT_H
+#define __CSV_EXPORT_H
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "History.h"
+
+// size of the one and only chunk buffer
+#define CSV_EXPORT_BUFFER 512
+// longest possible CSV row (incl. newline)
+#define CSV_EXPORT_MAX_ROW 64
+
+// streams a time window of the history as CSV file
+// with "Transfer-Encoding: chunked".
+// begin() takes over the client, afterwards poll() has to be
+// called from loop(). Every call sends one chunk of at most
+// CSV_EXPORT_BUFFER bytes, so the measurement keeps running
+// while a large export is in progress.
+class CsvExport
+{
+private:
+  WiFiClient client;
+  History* history;
+  uint32_t next_seq;
+  uint32_t end_seq;
+  bool running;
+  char buffer[CSV_EXPORT_BUFFER];
+
+  void sendChunk(const char* data, size_t len);
+  void finish();
+
+public:
+  CsvExport();
+  // send the HTTP header and start the export of [from_ms, to_ms]
+  void begin(WiFiClient& client_in, History* history_in, uint32_t from_ms, uint32_t to_ms);
+  bool active() { return running; }
+  // send the next chunk
+  void poll();
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef __ENV_SAMPLE_H
+#define __ENV_SAMPLE_H
+
+#include <stdint.h>
+#include <math.h>
+
+// one measurement of the ENV unit as it is passed around
+// inside the firmware (history, exporters, web pages)
+typedef struct _env_sample {
+  uint32_t seq;         // running sample number since boot
+  uint32_t time_ms;     // millis() at the time of the measurement
+  float temperature;    // SHT30 temperature in degC, NAN if the read failed
+  float humidity;       // SHT30 relative humidity in %, NAN if the read failed
+  float pressure;       // QMP6988 air pressure in Pa, NAN if the read failed
+} env_sample_t;
+
+// the fixed point formats (history, store and forward, fleet
+// packets, Modbus) code a missing value with a reserved code
+#define ENV_TEMPERATURE_MISSING INT16_MIN
+#define ENV_HUMIDITY_MISSING    0xFFFF
+#define ENV_PRESSURE_MISSING    0
+
+static inline bool env_value_valid(float value)
+{
+  return !isnan(value);
+}
+
+// temperature in 0.01 degC, a measured value never becomes the missing code
+static inline int16_t env_temperature_encode(float temperature)
+{
+  if(isnan(temperature))
+    return ENV_TEMPERATURE_MISSING;
+  float t = temperature * 100.0f;
+  if(t < -32767.0f)
+    t = -32767.0f;
+  if(t > 32767.0f)
+    t = 32767.0f;
+  return (int16_t)lroundf(t);
+}
+
+static inline float env_temperature_decode(int16_t t)
+{
+  return t == ENV_TEMPERATURE_MISSING ? NAN : t / 100.0f;
+}
+
+// humidity in 0.01 %
+static inline uint16_t env_humidity_encode(float humidity)
+{
+  if(isnan(humidity))
+    return ENV_HUMIDITY_MISSING;
+  float h = humidity * 100.0f;
+  if(h < 0.0f)
+    h = 0.0f;
+  if(h > 65534.0f)
+    h = 65534.0f;
+  return (uint16_t)lroundf(h);
+}
+
+static inline float env_humidity_decode(uint16_t h)
+{
+  return h == ENV_HUMIDITY_MISSING ? NAN : h / 100.0f;
+}
+
+// pressure in 0.01 Pa
+static inline uint32_t env_pressure_encode(float pressure)
+{
+  if(isnan(pressure))
+    return ENV_PRESSURE_MISSING;
+  float p = pressure * 100.0f;
+  if(p < 1.0f)
+    p = 1.0f;
+  if(p > 4.0e9f)
+    p = 4.0e9f;
+  return (uint32_t)(p + 0.5f);
+}
+
+static inline float env_pressure_decode(uint32_t p)
+{
+  return p == ENV_PRESSURE_MISSING ? NAN : p / 100.0f;
+}
+
+// metrics of a sample (/api/series, alert rules)
+#define SERIES_UNKNOWN      -1
+#define SERIES_TEMPERATURE   0
+#define SERIES_HUMIDITY      1
+#define SERIES_PRESSURE      2
+#define SERIES_COUNT         3
+
+static inline float env_sample_value(const env_sample_t* sample, int metric)
+{
+  switch(metric){
+    case SERIES_TEMPERATURE: return sample->temperature;
+    case SERIES_HUMIDITY: return sample->humidity;
+    default: return sample->pressure;
+  }
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "WiFi.h"
+#include "FleetNode.h"
+
+FleetNode::FleetNode()
+{
+  aggregator = false;
+  node_id = 0;
+  sent = 0;
+}
+
+void FleetNode::begin(bool aggregator_in)
+{
+  aggregator = aggregator_in;
+  // the first MAC octet is the lowest byte, the vendor part (OUI)
+  // is the same for all nodes, the last 4 octets tell them apart
+  node_id = (uint32_t)(ESP.getEfuseMac() >> 16);
+  udp.stop();
+  if(aggregator)
+    udp.beginMulticast(IPAddress(FLEET_MULTICAST_GROUP), FLEET_MULTICAST_PORT);
+}
+
+void FleetNode::publish(const env_sample_t* sample)
+{
+  fleet_packet_t packet;
+  uint8_t buf[FLEET_PACKET_SIZE];
+
+  packet.node_id = node_id;
+  packet.seq = sample->seq;
+  packet.uptime_ms = sample->time_ms;
+  packet.temperature = env_temperature_encode(sample->temperature);
+  packet.humidity = env_humidity_encode(sample->humidity);
+  packet.pressure = env_pressure_encode(sample->pressure);
+  fleet_packet_encode(&packet, buf);
+
+  if(udp.beginPacket(IPAddress(FLEET_MULTICAST_GROUP), FLEET_MULTICAST_PORT)){
+    udp.write(buf, sizeof(buf));
+    if(udp.endPacket())
+      sent++;
+  }
+  // the aggregator is part of its own table
+  if(aggregator)
+    peers.update(&packet, (uint32_t)WiFi.localIP(), millis());
+}
+
+void FleetNode::loop()
+{
+  uint8_t buf[FLEET_PACKET_SIZE];
+  fleet_packet_t packet;
+
+  if(!aggregator)
+    return;
+  // a few packets per call to keep loop() responsive
+  for(int i = 0; i < 8; i++){
+    int len = udp.parsePacket();
+    if(len <= 0)
+      return;
+    len = udp.read(buf, sizeof(buf));
+    if(fleet_packet_decode(buf, len, &packet) && packet.node_id != node_id)
+      peers.update(&packet, (uint32_t)udp.remoteIP(), millis());
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef __FLEET_NODE_H
+#define __FLEET_NODE_H
+
+#include "Arduino.h"
+#include "WiFiUdp.h"
+#include "EnvSample.h"
+#include "FleetPeers.h"
+
+// multicasts every sample as FleetPacket and, as aggregator,
+// collects the packets of all other monitors in a FleetPeers table
+class FleetNode
+{
+private:
+  WiFiUDP udp;
+  bool aggregator;
+  uint32_t node_id;
+
+public:
+  FleetPeers peers;
+  uint32_t sent;
+
+  FleetNode();
+  // (re)start after the WiFi connection is established
+  void begin(bool aggregator_in);
+  bool isAggregator() { return aggregator; }
+  uint32_t nodeId() { return node_id; }
+  // multicast a new measurement
+  void publish(const env_sample_t* sample);
+  // receive the packets of the peers, has to be called from loop()
+  void loop();
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __FLEET_PACKET_H
+#define __FLEET_PACKET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LittleEndian.h"
+
+// compact datagram every monitor multicasts after a measurement
+// (little endian, 24 bytes):
+//   uint8  magic 'A', 'E'
+//   uint8  version  FLEET_PACKET_VERSION
+//   uint8  flags    (reserved, 0)
+//   uint32 node id  (last 4 octets of the MAC address)
+//   uint32 seq      running sample number of the node
+//   uint32 uptime   millis() of the node at the measurement
+//   int16  temperature  0.01 degC, -32768 if the read failed
+//   uint16 humidity     0.01 %, 65535 if the read failed
+//   uint32 pressure     0.01 Pa, 0 if the read failed
+// fleet_sim sends and receives the same packets on the PC
+
+#define FLEET_PACKET_VERSION  1
+#define FLEET_PACKET_SIZE     24
+#define FLEET_MULTICAST_PORT  4269
+// organization-local scope multicast group
+#define FLEET_MULTICAST_GROUP 239, 255, 0, 69
+
+typedef struct _fleet_packet {
+  uint32_t node_id;
+  uint32_t seq;
+  uint32_t uptime_ms;
+  int16_t temperature;
+  uint16_t humidity;
+  uint32_t pressure;
+} fleet_packet_t;
+
+static inline size_t fleet_packet_encode(const fleet_packet_t* packet, uint8_t* buf)
+{
+  buf[0] = 'A';
+  buf[1] = 'E';
+  buf[2] = FLEET_PACKET_VERSION;
+  buf[3] = 0;
+  le_put_u32(&buf[4], packet->node_id);
+  le_put_u32(&buf[8], packet->seq);
+  le_put_u32(&buf[12], packet->uptime_ms);
+  le_put_u16(&buf[16], (uint16_t)packet->temperature);
+  le_put_u16(&buf[18], packet->humidity);
+  le_put_u32(&buf[20], packet->pressure);
+  return FLEET_PACKET_SIZE;
+}
+
+// returns false if the datagram is not a fleet packet
+static inline bool fleet_packet_decode(const uint8_t* buf, size_t len, fleet_packet_t* packet)
+{
+  if(len < FLEET_PACKET_SIZE || buf[0] != 'A' || buf[1] != 'E' || buf[2] != FLEET_PACKET_VERSION)
+    return false;
+  packet->node_id = le_get_u32(&buf[4]);
+  packet->seq = le_get_u32(&buf[8]);
+  packet->uptime_ms = le_get_u32(&buf[12]);
+  packet->temperature = (int16_t)le_get_u16(&buf[16]);
+  packet->humidity = le_get_u16(&buf[18]);
+  packet->pressure = le_get_u32(&buf[20]);
+  return true;
+}
+
+#endif
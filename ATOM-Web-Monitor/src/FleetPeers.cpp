@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <string.h>
+#include "FleetPeers.h"
+#include "EnvSample.h"
+
+FleetPeers::FleetPeers()
+{
+  memset(peers, 0, sizeof(peers));
+  rejected = 0;
+}
+
+void FleetPeers::update(const fleet_packet_t* packet, uint32_t ip, uint32_t now_ms)
+{
+  fleet_peer_t* entry = NULL;
+  fleet_peer_t* slot = NULL;
+
+  for(int i = 0; i < FLEET_MAX_PEERS && entry == NULL; i++){
+    fleet_peer_t* p = &peers[i];
+    if(p->active && p->last.node_id == packet->node_id)
+      entry = p;
+    // free slot or the peer that was not heard of the longest time
+    else if(slot == NULL || (slot->active && (!p->active ||
+            (now_ms - p->last_seen_ms) > (now_ms - slot->last_seen_ms))))
+      slot = p;
+  }
+
+  if(entry == NULL){
+    // new node: use a free slot or replace an expired one
+    if(slot->active && (now_ms - slot->last_seen_ms) < FLEET_PEER_EXPIRE_MS){
+      rejected++;
+      return;
+    }
+    memset(slot, 0, sizeof(*slot));
+    entry = slot;
+    entry->active = true;
+  } else {
+    if(packet->seq == entry->last.seq)
+      return; // duplicate
+    if(packet->seq > entry->last.seq)
+      entry->lost += packet->seq - entry->last.seq - 1;
+    else
+      entry->restarts++;
+  }
+  entry->ip = ip;
+  entry->last = *packet;
+  entry->last_seen_ms = now_ms;
+  entry->received++;
+}
+
+// fixed point value with two decimal places or null if it is missing
+static void fleet_json_value(char* buf, size_t size, bool valid, double value)
+{
+  if(valid)
+    snprintf(buf, size, "%.2f", value);
+  else
+    snprintf(buf, size, "null");
+}
+
+size_t FleetPeers::formatJson(int index, char* buf, size_t size, uint32_t now_ms)
+{
+  const fleet_peer_t* p;
+  char temperature[16], humidity[16], pressure[16];
+  int len;
+
+  if(index < 0 || index >= FLEET_MAX_PEERS)
+    return 0;
+  p = &peers[index];
+  if(!p->active)
+    return 0;
+  fleet_json_value(temperature, sizeof(temperature), p->last.temperature != ENV_TEMPERATURE_MISSING,
+                   p->last.temperature / 100.0);
+  fleet_json_value(humidity, sizeof(humidity), p->last.humidity != ENV_HUMIDITY_MISSING,
+                   p->last.humidity / 100.0);
+  fleet_json_value(pressure, sizeof(pressure), p->last.pressure != ENV_PRESSURE_MISSING,
+                   p->last.pressure / 100.0);
+  len = snprintf(buf, size,
+                 "{\"node\":\"%08x\",\"ip\":\"%u.%u.%u.%u\",\"seq\":%u,\"age_ms\":%u,"
+                 "\"temperature\":%s,\"humidity\":%s,\"pressure\":%s,"
+                 "\"received\":%u,\"lost\":%u,\"restarts\":%u}",
+                 (unsigned int)p->last.node_id,
+                 (unsigned int)(p->ip & 0xff), (unsigned int)((p->ip >> 8) & 0xff),
+                 (unsigned int)((p->ip >> 16) & 0xff), (unsigned int)(p->ip >> 24),
+                 (unsigned int)p->last.seq, (unsigned int)(now_ms - p->last_seen_ms),
+                 temperature, humidity, pressure,
+                 (unsigned int)p->received, (unsigned int)p->lost, (unsigned int)p->restarts);
+  if(len < 0 || (size_t)len >= size)
+    return 0;
+  return len;
+}
@@ -0,0 +1,42 @@
+#ifndef __FLEET_PEERS_H
+#define __FLEET_PEERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "FleetPacket.h"
+
+// size of the peer table
+#define FLEET_MAX_PEERS       16
+// a peer that was not heard of for this time can be replaced
+#define FLEET_PEER_EXPIRE_MS  600000
+
+typedef struct _fleet_peer {
+  bool active;
+  uint32_t ip;             // IPv4 address, first octet in the lowest byte
+  fleet_packet_t last;     // last received values
+  uint32_t last_seen_ms;
+  uint32_t received;       // number of received packets
+  uint32_t lost;           // packets missing in the seq numbers
+  uint32_t restarts;       // seq started again (reboot of the node)
+} fleet_peer_t;
+
+// fixed size table of the monitors in the same network
+// (the aggregator of fleet_sim runs the same table)
+class FleetPeers
+{
+private:
+  fleet_peer_t peers[FLEET_MAX_PEERS];
+
+public:
+  uint32_t rejected;       // packets dropped because the table was full
+
+  FleetPeers();
+  // take over a received packet
+  void update(const fleet_packet_t* packet, uint32_t ip, uint32_t now_ms);
+  int size() { return FLEET_MAX_PEERS; }
+  const fleet_peer_t* peer(int index) { return &peers[index]; }
+  // one peer as JSON object, returns the length or 0 if unused
+  size_t formatJson(int index, char* buf, size_t size, uint32_t now_ms);
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "History.h"
+
+// number of records encoded on the stack before they are
+// handed to the network stack
+#define HISTORY_WRITE_BLOCK 32
+
+History::History()
+{
+  next_seq = 0;
+  count = 0;
+}
+
+const history_record_t* History::record(uint32_t seq)
+{
+  if((seq < firstSeq()) || (seq >= next_seq))
+    return NULL;
+  return &records[seq % HISTORY_LENGTH];
+}
+
+uint32_t History::add(float temperature, float humidity, float pressure, uint32_t time_ms)
+{
+  history_record_t* rec = &records[next_seq % HISTORY_LENGTH];
+  // the values are clamped to the range of the fixed point representation
+  rec->time_ms = time_ms;
+  rec->temperature = env_temperature_encode(temperature);
+  rec->humidity = env_humidity_encode(humidity);
+  rec->pressure = env_pressure_encode(pressure);
+  if(count < HISTORY_LENGTH)
+    count++;
+  return next_seq++;
+}
+
+bool History::get(uint32_t seq, env_sample_t* sample)
+{
+  const history_record_t* rec = record(seq);
+  if(rec == NULL)
+    return false;
+  sample->seq = seq;
+  sample->time_ms = rec->time_ms;
+  sample->temperature = env_temperature_decode(rec->temperature);
+  sample->humidity = env_humidity_decode(rec->humidity);
+  sample->pressure = env_pressure_decode(rec->pressure);
+  return true;
+}
+
+uint32_t History::findSeq(uint32_t time_ms)
+{
+  // the samples are stored in time order: binary search
+  uint32_t low = firstSeq();
+  uint32_t high = next_seq;
+  while(low < high){
+    uint32_t mid = low + (high - low) / 2;
+    if(record(mid)->time_ms < time_ms)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+uint32_t History::clampSeq(uint32_t from_seq)
+{
+  // samples that are already overwritten can not be sent anymore
+  if(from_seq < firstSeq())
+    return firstSeq();
+  if(from_seq > next_seq)
+    return next_seq;
+  return from_seq;
+}
+
+size_t History::binarySize(uint32_t from_seq)
+{
+  return HISTORY_BIN_HEADER_SIZE + (next_seq - clampSeq(from_seq)) * HISTORY_BIN_RECORD_SIZE;
+}
+
+size_t History::writeBinary(Print* out, uint32_t from_seq, uint32_t now_ms)
+{
+  uint8_t buf[HISTORY_WRITE_BLOCK * HISTORY_BIN_RECORD_SIZE];
+  size_t written = 0;
+  uint32_t seq;
+  uint16_t n;
+
+  from_seq = clampSeq(from_seq);
+  n = next_seq - from_seq;
+
+  written += out->write(buf, history_bin_encode_header(n, from_seq, now_ms, buf));
+
+  seq = from_seq;
+  while(seq < next_seq){
+    size_t len = 0;
+    while((seq < next_seq) && (len < sizeof(buf))){
+      len += history_bin_encode_record(record(seq), &buf[len]);
+      seq++;
+    }
+    written += out->write(buf, len);
+  }
+  return written;
+}
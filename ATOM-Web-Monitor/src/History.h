@@ -0,0 +1,47 @@
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include "Arduino.h"
+#include "EnvSample.h"
+#include "HistoryFormat.h"
+
+// number of samples kept in RAM
+// 1200 samples * 12 bytes = 14.4 kB (one hour at a 3 s interval)
+#define HISTORY_LENGTH 1200
+
+class History
+{
+private:
+  history_record_t records[HISTORY_LENGTH];
+  // seq of the next sample that will be added
+  uint32_t next_seq;
+  uint16_t count;
+
+  const history_record_t* record(uint32_t seq);
+  uint32_t clampSeq(uint32_t from_seq);
+
+public:
+  History();
+  // store a new measurement and return its sequence number
+  uint32_t add(float temperature, float humidity, float pressure, uint32_t time_ms);
+
+  uint16_t size() { return count; }
+  uint32_t firstSeq() { return next_seq - count; }
+  uint32_t nextSeq() { return next_seq; }
+
+  // read back one sample, returns false if seq is not (or no longer) stored
+  bool get(uint32_t seq, env_sample_t* sample);
+
+  // seq of the first stored sample taken at or after time_ms
+  // (nextSeq() if there is none)
+  uint32_t findSeq(uint32_t time_ms);
+
+  // number of bytes writeBinary() will send for from_seq
+  size_t binarySize(uint32_t from_seq);
+
+  // write all samples with a sequence number >= from_seq
+  // in the binary wire format to the given stream
+  size_t writeBinary(Print* out, uint32_t from_seq, uint32_t now_ms);
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __HISTORY_FORMAT_H
+#define __HISTORY_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LittleEndian.h"
+
+// binary wire format (little endian) used by /history.bin and /update.bin:
+// header:
+//   uint8  version       HISTORY_BIN_VERSION
+//   uint8  record size   HISTORY_BIN_RECORD_SIZE
+//   uint16 record count
+//   uint32 seq of the first record
+//   uint32 millis() of the device when the blob was sent
+// record:
+//   uint32 time_ms       millis() at the time of the measurement
+//   int16  temperature   0.01 degC, -32768 if the read failed
+//   uint16 humidity      0.01 %, 65535 if the read failed
+//   uint32 pressure      0.01 Pa, 0 if the read failed
+// fleet_collector encodes (simulated devices) and decodes the same blobs
+#define HISTORY_BIN_VERSION      1
+#define HISTORY_BIN_HEADER_SIZE  12
+#define HISTORY_BIN_RECORD_SIZE  12
+
+typedef struct _history_record {
+  uint32_t time_ms;
+  int16_t temperature;
+  uint16_t humidity;
+  uint32_t pressure;
+} history_record_t;
+
+typedef struct _history_bin_header {
+  uint8_t record_size;
+  uint16_t count;
+  uint32_t first_seq;
+  uint32_t now_ms;
+} history_bin_header_t;
+
+static inline size_t history_bin_encode_header(uint16_t count, uint32_t first_seq, uint32_t now_ms, uint8_t* buf)
+{
+  buf[0] = HISTORY_BIN_VERSION;
+  buf[1] = HISTORY_BIN_RECORD_SIZE;
+  le_put_u16(&buf[2], count);
+  le_put_u32(&buf[4], first_seq);
+  le_put_u32(&buf[8], now_ms);
+  return HISTORY_BIN_HEADER_SIZE;
+}
+
+static inline size_t history_bin_encode_record(const history_record_t* rec, uint8_t* buf)
+{
+  le_put_u32(&buf[0], rec->time_ms);
+  le_put_u16(&buf[4], (uint16_t)rec->temperature);
+  le_put_u16(&buf[6], rec->humidity);
+  le_put_u32(&buf[8], rec->pressure);
+  return HISTORY_BIN_RECORD_SIZE;
+}
+
+// returns false if the blob does not start with a valid header
+// (newer versions may use larger records, the known fields stay in front)
+static inline bool history_bin_decode_header(const uint8_t* buf, size_t len, history_bin_header_t* header)
+{
+  if(len < HISTORY_BIN_HEADER_SIZE || buf[0] != HISTORY_BIN_VERSION || buf[1] < HISTORY_BIN_RECORD_SIZE)
+    return false;
+  header->record_size = buf[1];
+  header->count = le_get_u16(&buf[2]);
+  header->first_seq = le_get_u32(&buf[4]);
+  header->now_ms = le_get_u32(&buf[8]);
+  return true;
+}
+
+static inline void history_bin_decode_record(const uint8_t* buf, history_record_t* rec)
+{
+  rec->time_ms = le_get_u32(&buf[0]);
+  rec->temperature = (int16_t)le_get_u16(&buf[4]);
+  rec->humidity = le_get_u16(&buf[6]);
+  rec->pressure = le_get_u32(&buf[8]);
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __I2C_BUS_H
+#define __I2C_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// I2C bus of the sensor drivers (SHT3X, QMP6988), without Arduino
+// headers so i2c_bench runs the same drivers on I2CMock
+//
+// implementations:
+//   WireBus      TwoWire of the Arduino core (WireBus.h, firmware only)
+//   I2CMock      emulated SHT30 and QMP6988 with a virtual clock (I2CMock.h)
+//   I2CRecorder  logs every transaction of another bus (I2CRecorder.h)
+//   I2CQueue     queues the transfers of the drivers, merges adjacent
+//                register reads (I2CQueue.h)
+//
+// recover() frees the bus after a transfer that was interrupted
+// (a device holds SDA low): clocks on SCL, a STOP condition and a
+// new start of the controller; the devices keep their settings
+//
+// the drivers submit transfers with a completion callback, the
+// queue runs them later, all other buses run them at once;
+// flush() waits for the submitted transfers
+//
+// the bus also provides the time base of the drivers, so the
+// conversion times run on the virtual clock of the mock
+
+// results of write(), the codes of TwoWire::endTransmission()
+#define I2C_OK              0
+#define I2C_ERR_TOO_LONG    1
+#define I2C_ERR_ADDR_NACK   2
+#define I2C_ERR_DATA_NACK   3
+#define I2C_ERR_OTHER       4
+
+// completion of a submitted transfer: I2C_OK or an error code,
+// for reads the received bytes (in the buffer of the request)
+typedef void (*i2c_done_t)(void* context, uint8_t result, const uint8_t* data, size_t len);
+
+// result of a read with n of len bytes
+static inline uint8_t i2c_read_result(size_t n, size_t len)
+{
+  if(n == len)
+    return I2C_OK;
+  // no ACK of the address: the device did not answer at all
+  return n == 0 ? I2C_ERR_ADDR_NACK : I2C_ERR_DATA_NACK;
+}
+
+class I2CBus {
+public:
+  virtual ~I2CBus() {}
+  // one write transaction, without stop the next transaction
+  // starts with a repeated start, returns I2C_OK or an error code
+  virtual uint8_t write(uint8_t address, const uint8_t* data, size_t len, bool stop = true) = 0;
+  // one read transaction, returns the number of bytes received
+  // (0 if the device does not acknowledge its address)
+  virtual size_t read(uint8_t address, uint8_t* data, size_t len) = 0;
+  // time base of the drivers
+  virtual uint32_t micros() = 0;
+  virtual void delay(uint32_t ms) = 0;
+
+  // register read: address byte and a repeated start,
+  // returns I2C_OK or an error code
+  uint8_t readRegister(uint8_t address, uint8_t reg, uint8_t* data, size_t len){
+    uint8_t err = write(address, &reg, 1, false);
+    if(err != I2C_OK)
+      return err;
+    return i2c_read_result(read(address, data, len), len);
+  }
+
+  uint8_t writeRegister(uint8_t address, uint8_t reg, uint8_t value){
+    uint8_t data[2] = { reg, value };
+    return write(address, data, 2);
+  }
+
+  // submitted transfers, the buffer of a read has to stay valid
+  // until the callback; false if the transfer can not be queued
+  virtual bool submitWrite(uint8_t address, const uint8_t* data, size_t len, i2c_done_t done, void* context){
+    uint8_t err = write(address, data, len);
+    if(done)
+      done(context, err, NULL, 0);
+    return true;
+  }
+  virtual bool submitRead(uint8_t address, uint8_t* data, size_t len, i2c_done_t done, void* context){
+    size_t n = read(address, data, len);
+    if(done)
+      done(context, i2c_read_result(n, len), data, n);
+    return true;
+  }
+  virtual bool submitReadRegister(uint8_t address, uint8_t reg, uint8_t* data, size_t len,
+                                  i2c_done_t done, void* context){
+    uint8_t err = readRegister(address, reg, data, len);
+    if(done)
+      done(context, err, data, err == I2C_OK ? len : 0);
+    return true;
+  }
+  // complete all submitted transfers
+  virtual void flush() {}
+  // free a bus that is held by a device and start the controller
+  // again, true if SDA and SCL are released afterwards
+  virtual bool recover() { return false; }
+};
+
+#endif
@@ -0,0 +1,365 @@
+#include <string.h>
+#include "I2CMock.h"
+
+// made up but plausible calibration (same as qmp6988_bench)
+static const uint8_t default_otp[25] = {
+  0x4e, 0x20, 0x00, 0xc8, 0xf0, 0x60, 0x05, 0xdc, 0xfc, 0xe0, 0x09, 0xc4, 0x02,
+  0x58, 0xfe, 0xd4, 0x03, 0xe8, 0x19, 0x00, 0xfb, 0x50, 0x0b, 0xb8, 0x00
+};
+
+// SHT30 periodic commands (datasheet table 10): msb, high, medium, low
+static const uint8_t sht_periodic_cmd[5][4] = {
+  { 0x20, 0x32, 0x24, 0x2F },
+  { 0x21, 0x30, 0x26, 0x2D },
+  { 0x22, 0x36, 0x20, 0x2B },
+  { 0x23, 0x34, 0x22, 0x29 },
+  { 0x27, 0x37, 0x21, 0x2A }
+};
+static const uint32_t sht_period_us[5] = { 2000000, 1000000, 500000, 250000, 100000 };
+// typical conversion times per repeatability (datasheet table 4)
+static const uint32_t sht_conversion_us[3] = { 12500, 4500, 2500 };
+
+// QMP6988 standby times of IO_SETUP (t_standby) in ms
+static const uint16_t qmp_standby_ms[8] = { 1, 5, 50, 250, 500, 1000, 2000, 4000 };
+
+#define QMP_CHIP_ID     0xD1
+#define QMP_RESET       0xE0
+#define QMP_OTP         0xA0
+#define QMP_CONFIG      0xF1
+#define QMP_STATUS      0xF3
+#define QMP_CTRL_MEAS   0xF4
+#define QMP_IO_SETUP    0xF5
+#define QMP_DATA        0xF7
+
+I2CMock::I2CMock(uint32_t clock_hz)
+{
+  conversions = 0;
+  recoveries = 0;
+  _clock_hz = clock_hz;
+  _now_us = 0;
+  _values.sht30_temperature = 0x6148;
+  _values.sht30_humidity = 0x7333;
+  _values.qmp6988_pressure = 0xa3e050;
+  _values.qmp6988_temperature = 0x822a10;
+  _script = NULL;
+  _script_context = NULL;
+  _fail_address = 0;
+  _fail_count = 0;
+  _stuck = false;
+  _sht_mode = 0;
+  _sht_converting = false;
+  _sht_fetch = false;
+  _sht_new = false;
+  _sht_due_us = 0;
+  _sht_conversion_us = 0;
+  _sht_period_us = 0;
+  memset(_sht_result, 0, sizeof(_sht_result));
+  memset(_qmp_reg, 0, sizeof(_qmp_reg));
+  _qmp_reg[QMP_CHIP_ID] = 0x5C;
+  memcpy(&_qmp_reg[QMP_OTP], default_otp, sizeof(default_otp));
+  _qmp_pointer = 0;
+  _qmp_converting = false;
+  _qmp_due_us = 0;
+}
+
+void I2CMock::setScript(i2c_mock_script_t script, void* context)
+{
+  _script = script;
+  _script_context = context;
+}
+
+void I2CMock::setCalibration(const uint8_t* otp)
+{
+  memcpy(&_qmp_reg[QMP_OTP], otp, sizeof(default_otp));
+}
+
+void I2CMock::failNext(uint8_t address, uint16_t n)
+{
+  _fail_address = address;
+  _fail_count = n;
+}
+
+// nine clocks and a STOP at the bus clock
+bool I2CMock::recover()
+{
+  recoveries++;
+  _now_us += (11 * 1000000UL + _clock_hz - 1) / _clock_hz;
+  _stuck = false;
+  return true;
+}
+
+// start, address and data bytes with their ACK, stop
+// (without stop the repeated start follows at once)
+void I2CMock::transfer(size_t len, bool stop)
+{
+  uint32_t bits = (stop ? 2 : 1) + 9 * (1 + len);
+  _now_us += (bits * 1000000UL + _clock_hz - 1) / _clock_hz;
+}
+
+void I2CMock::script()
+{
+  conversions++;
+  if(_script)
+    _script(_script_context, _now_us, &_values);
+}
+
+uint8_t I2CMock::write(uint8_t address, const uint8_t* data, size_t len, bool stop)
+{
+  transfer(len, stop);
+  if(_stuck)
+    return I2C_ERR_OTHER;
+  if(_fail_count > 0 && address == _fail_address){
+    _fail_count--;
+    return I2C_ERR_ADDR_NACK;
+  }
+  if(address == I2C_MOCK_SHT30_ADDRESS){
+    if(len != 2)
+      return I2C_ERR_DATA_NACK;
+    return shtCommand((data[0] << 8) | data[1]);
+  }
+  if(address == I2C_MOCK_QMP6988_ADDRESS){
+    size_t i = 0;
+    // register/data pairs, a single byte sets the register address
+    for(; i + 1 < len; i += 2)
+      qmpWrite(data[i], data[i + 1]);
+    if(i < len)
+      _qmp_pointer = data[i];
+    return I2C_OK;
+  }
+  return I2C_ERR_ADDR_NACK;
+}
+
+size_t I2CMock::read(uint8_t address, uint8_t* data, size_t len)
+{
+  if(_stuck){
+    transfer(0);
+    return 0;
+  }
+  if(_fail_count > 0 && address == _fail_address){
+    transfer(0);
+    _fail_count--;
+    return 0;
+  }
+  if(address == I2C_MOCK_SHT30_ADDRESS){
+    size_t n = shtRead(data, len);
+    transfer(n);
+    return n;
+  }
+  if(address == I2C_MOCK_QMP6988_ADDRESS){
+    transfer(len);
+    qmpUpdate();
+    for(size_t i = 0; i < len; i++){
+      if(_qmp_pointer == QMP_STATUS)
+        data[i] = qmpMeasuring() ? 0x08 : 0x00;
+      else
+        data[i] = _qmp_reg[_qmp_pointer];
+      _qmp_pointer++;
+    }
+    return len;
+  }
+  transfer(0);
+  return 0;
+}
+
+// ---------------------------------------------------------------
+// SHT30
+
+static uint8_t sht_crc(const uint8_t* data)
+{
+  uint8_t crc = 0xFF;
+  for(int i = 0; i < 2; i++){
+    crc ^= data[i];
+    for(int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+  }
+  return crc;
+}
+
+void I2CMock::shtResult()
+{
+  script();
+  _sht_result[0] = _values.sht30_temperature >> 8;
+  _sht_result[1] = _values.sht30_temperature & 0xFF;
+  _sht_result[2] = sht_crc(&_sht_result[0]);
+  _sht_result[3] = _values.sht30_humidity >> 8;
+  _sht_result[4] = _values.sht30_humidity & 0xFF;
+  _sht_result[5] = sht_crc(&_sht_result[3]);
+}
+
+uint8_t I2CMock::shtCommand(uint16_t command)
+{
+  uint8_t msb = command >> 8, lsb = command & 0xFF;
+
+  // break and soft reset end the periodic mode
+  if(command == 0x3093 || command == 0x30A2){
+    _sht_mode = 0;
+    _sht_converting = false;
+    _sht_fetch = false;
+    return I2C_OK;
+  }
+  if(command == 0xE000){
+    if(_sht_mode == 0)
+      return I2C_ERR_DATA_NACK;
+    _sht_fetch = true;
+    return I2C_OK;
+  }
+  // other commands are ignored in the periodic mode
+  if(_sht_mode != 0)
+    return I2C_ERR_DATA_NACK;
+  // single shot with and without clock stretching
+  if(msb == 0x24 || msb == 0x2C){
+    uint8_t rep;
+    if(lsb == 0x00 || lsb == 0x06)
+      rep = 0;
+    else if(lsb == 0x0B || lsb == 0x0D)
+      rep = 1;
+    else if(lsb == 0x16 || lsb == 0x10)
+      rep = 2;
+    else
+      return I2C_ERR_DATA_NACK;
+    _sht_converting = true;
+    _sht_due_us = _now_us + sht_conversion_us[rep];
+    return I2C_OK;
+  }
+  // ART: 4 results per second
+  if(command == 0x2B32){
+    _sht_mode = 6;
+    _sht_period_us = 250000;
+    _sht_conversion_us = sht_conversion_us[0];
+    _sht_new = false;
+    _sht_due_us = _now_us + _sht_conversion_us;
+    return I2C_OK;
+  }
+  for(int m = 0; m < 5; m++){
+    if(msb != sht_periodic_cmd[m][0])
+      continue;
+    for(int rep = 0; rep < 3; rep++){
+      if(lsb != sht_periodic_cmd[m][1 + rep])
+        continue;
+      _sht_mode = 1 + m;
+      _sht_period_us = sht_period_us[m];
+      _sht_conversion_us = sht_conversion_us[rep];
+      _sht_new = false;
+      _sht_due_us = _now_us + _sht_conversion_us;
+      return I2C_OK;
+    }
+  }
+  return I2C_ERR_DATA_NACK;
+}
+
+// results of the periodic mode up to now, only the newest is kept
+void I2CMock::shtUpdate()
+{
+  if(_sht_mode == 0 || (int32_t)(_now_us - _sht_due_us) < 0)
+    return;
+  uint32_t late = _now_us - _sht_due_us;
+  _sht_due_us += (late / _sht_period_us + 1) * _sht_period_us;
+  shtResult();
+  _sht_new = true;
+}
+
+size_t I2CMock::shtRead(uint8_t* data, size_t len)
+{
+  if(_sht_mode == 0){
+    // no clock stretching: NACK during the conversion
+    if(!_sht_converting || (int32_t)(_now_us - _sht_due_us) < 0)
+      return 0;
+    _sht_converting = false;
+    shtResult();
+  } else {
+    shtUpdate();
+    bool fetch = _sht_fetch;
+    _sht_fetch = false;
+    if(!fetch || !_sht_new)
+      return 0;
+    _sht_new = false;
+  }
+  if(len > sizeof(_sht_result))
+    len = sizeof(_sht_result);
+  memcpy(data, _sht_result, len);
+  return len;
+}
+
+// ---------------------------------------------------------------
+// QMP6988
+
+// typical time, below the maximum the driver waits for
+uint32_t I2CMock::qmpConversionTime()
+{
+  uint8_t osrs_t = _qmp_reg[QMP_CTRL_MEAS] >> 5, osrs_p = (_qmp_reg[QMP_CTRL_MEAS] >> 2) & 0x07;
+  uint32_t samples = 0;
+
+  if(osrs_p)
+    samples += 1 << (osrs_p - 1);
+  if(osrs_t)
+    samples += 1 << (osrs_t - 1);
+  return 2000 + 1000 * samples;
+}
+
+// the status bit is set during the conversion, not in the standby
+bool I2CMock::qmpMeasuring()
+{
+  if(!_qmp_converting)
+    return false;
+  uint32_t start_us = _qmp_due_us - qmpConversionTime();
+  return (int32_t)(_now_us - start_us) >= 0 && (int32_t)(_now_us - _qmp_due_us) < 0;
+}
+
+void I2CMock::qmpStart()
+{
+  _qmp_converting = true;
+  _qmp_due_us = _now_us + qmpConversionTime();
+}
+
+void I2CMock::qmpWrite(uint8_t reg, uint8_t value)
+{
+  switch(reg){
+    case QMP_RESET:
+      if(value == 0xE6){
+        _qmp_reg[QMP_CTRL_MEAS] = 0;
+        _qmp_reg[QMP_CONFIG] = 0;
+        _qmp_reg[QMP_IO_SETUP] = 0;
+        _qmp_converting = false;
+      }
+      break;
+    case QMP_CTRL_MEAS:
+      qmpUpdate();
+      _qmp_reg[reg] = value;
+      // forced (01) and normal (11) mode start a conversion
+      if(value & 0x01)
+        qmpStart();
+      else
+        _qmp_converting = false;
+      break;
+    case QMP_CONFIG:
+    case QMP_IO_SETUP:
+      _qmp_reg[reg] = value;
+      break;
+    default:
+      // chip id, OTP and data are read only
+      break;
+  }
+}
+
+void I2CMock::qmpUpdate()
+{
+  if(!_qmp_converting || (int32_t)(_now_us - _qmp_due_us) < 0)
+    return;
+  if((_qmp_reg[QMP_CTRL_MEAS] & 0x03) == 0x03){
+    // normal mode: conversion and standby, only the newest result is kept
+    uint32_t cycle = qmpConversionTime() + qmp_standby_ms[_qmp_reg[QMP_IO_SETUP] >> 5] * 1000UL;
+    uint32_t late = _now_us - _qmp_due_us;
+    _qmp_due_us += (late / cycle + 1) * cycle;
+  } else {
+    // forced mode: back to sleep
+    _qmp_converting = false;
+    _qmp_reg[QMP_CTRL_MEAS] &= ~0x03;
+  }
+  script();
+  _qmp_reg[QMP_DATA + 0] = _values.qmp6988_pressure >> 16;
+  _qmp_reg[QMP_DATA + 1] = _values.qmp6988_pressure >> 8;
+  _qmp_reg[QMP_DATA + 2] = _values.qmp6988_pressure;
+  _qmp_reg[QMP_DATA + 3] = _values.qmp6988_temperature >> 16;
+  _qmp_reg[QMP_DATA + 4] = _values.qmp6988_temperature >> 8;
+  _qmp_reg[QMP_DATA + 5] = _values.qmp6988_temperature;
+}
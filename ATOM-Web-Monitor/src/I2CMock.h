@@ -0,0 +1,108 @@
+#ifndef __I2C_MOCK_H
+#define __I2C_MOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "I2CBus.h"
+
+// emulated ENV unit (SHT30 and QMP6988) on a virtual clock for i2c_bench
+//
+// SHT30: single shot and periodic/ART commands without clock stretching,
+//        break, fetch data, CRC of the results; a read during the
+//        conversion or without a new periodic result is not acknowledged
+// QMP6988: chip id, reset, OTP calibration at 0xA0, CTRL_MEAS and CONFIG,
+//        status register, forced and normal mode with the typical
+//        conversion time; writes are register/data pairs, reads
+//        increment the register address
+// stick() emulates a device that holds SDA low: every transaction
+// fails (I2C_ERR_OTHER, no bytes read) until recover()
+//
+// the clock advances with delay(), with the transfer time of every
+// transaction at the bus clock (a write without stop ends with the
+// repeated start of the next transaction) and by 1 us per micros() call,
+// so a polling loop of a driver ends as well
+
+#define I2C_MOCK_SHT30_ADDRESS    0x44
+#define I2C_MOCK_QMP6988_ADDRESS  0x70
+#define I2C_MOCK_CLOCK            400000
+
+// values of the emulated sensors as raw words
+typedef struct _i2c_mock_values {
+  uint16_t sht30_temperature;
+  uint16_t sht30_humidity;
+  uint32_t qmp6988_pressure;     // 24 bit ADC words
+  uint32_t qmp6988_temperature;
+} i2c_mock_values_t;
+
+// script of the values: called at the end of every conversion
+// with the virtual time, may change the values
+typedef void (*i2c_mock_script_t)(void* context, uint32_t time_us, i2c_mock_values_t* values);
+
+class I2CMock : public I2CBus {
+public:
+  // default values: 21.5 degC, 45 %RH, 1013.25 hPa
+  // with the default calibration
+  I2CMock(uint32_t clock_hz = I2C_MOCK_CLOCK);
+
+  void setValues(const i2c_mock_values_t* values) { _values = *values; }
+  const i2c_mock_values_t* values() const { return &_values; }
+  void setScript(i2c_mock_script_t script, void* context);
+  // the 25 OTP bytes of the QMP6988
+  void setCalibration(const uint8_t* otp);
+  // the next n transactions to the address are not acknowledged
+  void failNext(uint8_t address, uint16_t n);
+  // hold the bus until recover()
+  void stick() { _stuck = true; }
+  bool recover();
+  void advance(uint32_t us) { _now_us += us; }
+
+  uint8_t write(uint8_t address, const uint8_t* data, size_t len, bool stop = true);
+  size_t read(uint8_t address, uint8_t* data, size_t len);
+  uint32_t micros() { return _now_us++; }
+  void delay(uint32_t ms) { _now_us += ms * 1000; }
+
+  // state for the checks of the host tools
+  uint8_t qmp6988Register(uint8_t reg) { qmpUpdate(); return _qmp_reg[reg]; }
+  uint32_t conversions;
+  uint32_t recoveries;
+
+private:
+  uint32_t _clock_hz;
+  uint32_t _now_us;
+  i2c_mock_values_t _values;
+  i2c_mock_script_t _script;
+  void* _script_context;
+  uint8_t _fail_address;
+  uint16_t _fail_count;
+  bool _stuck;
+
+  // SHT30
+  uint8_t _sht_mode;          // 0: single shot, else periodic
+  bool _sht_converting;       // single shot started
+  bool _sht_fetch;            // fetch data command received
+  bool _sht_new;              // periodic result not fetched yet
+  uint32_t _sht_due_us;       // end of the conversion / next periodic result
+  uint32_t _sht_conversion_us;
+  uint32_t _sht_period_us;
+  uint8_t _sht_result[6];
+
+  // QMP6988
+  uint8_t _qmp_reg[256];
+  uint8_t _qmp_pointer;
+  bool _qmp_converting;
+  uint32_t _qmp_due_us;
+
+  void transfer(size_t len, bool stop = true);
+  void script();
+  uint8_t shtCommand(uint16_t command);
+  void shtUpdate();
+  void shtResult();
+  size_t shtRead(uint8_t* data, size_t len);
+  void qmpWrite(uint8_t reg, uint8_t value);
+  void qmpUpdate();
+  void qmpStart();
+  bool qmpMeasuring();
+  uint32_t qmpConversionTime();
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include <string.h>
+#include "I2CQueue.h"
+
+I2CQueue::I2CQueue(I2CBus* bus)
+{
+  _bus = bus;
+  _head = 0;
+  _count = 0;
+  _running = false;
+  clearStats();
+}
+
+void I2CQueue::clearStats()
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+i2c_request_t* I2CQueue::add(uint8_t type, uint8_t address, size_t len, i2c_done_t done, void* context)
+{
+  if(_count >= I2C_QUEUE_LENGTH || len > 255){
+    stats.refused++;
+    return NULL;
+  }
+  i2c_request_t* r = &_queue[(_head + _count) % I2C_QUEUE_LENGTH];
+  _count++;
+  if(_count > stats.max_fill)
+    stats.max_fill = _count;
+  stats.submitted++;
+  r->type = type;
+  r->address = address;
+  r->len = len;
+  r->data = NULL;
+  r->done = done;
+  r->context = context;
+  return r;
+}
+
+bool I2CQueue::submitWrite(uint8_t address, const uint8_t* data, size_t len, i2c_done_t done, void* context)
+{
+  if(len > I2C_QUEUE_WRITE_MAX){
+    stats.refused++;
+    return false;
+  }
+  i2c_request_t* r = add(I2C_REQUEST_WRITE, address, len, done, context);
+  if(r == NULL)
+    return false;
+  memcpy(r->tx, data, len);
+  return true;
+}
+
+bool I2CQueue::submitRead(uint8_t address, uint8_t* data, size_t len, i2c_done_t done, void* context)
+{
+  i2c_request_t* r = add(I2C_REQUEST_READ, address, len, done, context);
+  if(r == NULL)
+    return false;
+  r->data = data;
+  return true;
+}
+
+bool I2CQueue::submitReadRegister(uint8_t address, uint8_t reg, uint8_t* data, size_t len,
+                                  i2c_done_t done, void* context)
+{
+  i2c_request_t* r = add(I2C_REQUEST_READ_REG, address, len, done, context);
+  if(r == NULL)
+    return false;
+  r->reg = reg;
+  r->data = data;
+  return true;
+}
+
+// start, address and data bytes with their ACK, stop
+void I2CQueue::count(size_t len, uint8_t err, uint32_t start_us)
+{
+  stats.transfers++;
+  stats.bytes += len;
+  stats.bits += 2 + 9 * (1 + len);
+  if(err != I2C_OK)
+    stats.errors++;
+  stats.busy_us += _bus->micros() - start_us;
+}
+
+uint32_t I2CQueue::busTime(uint32_t clock_hz) const
+{
+  return (uint32_t)(((uint64_t)stats.bits * 1000000 + clock_hz - 1) / clock_hz);
+}
+
+// run the request at the head of the queue and the
+// register reads merged into its burst
+uint16_t I2CQueue::runHead()
+{
+  i2c_request_t* r = &_queue[_head];
+  uint32_t start_us = _bus->micros();
+
+  if(r->type == I2C_REQUEST_WRITE){
+    uint8_t err = _bus->write(r->address, r->tx, r->len);
+    count(r->len, err, start_us);
+    _head = (_head + 1) % I2C_QUEUE_LENGTH;
+    _count--;
+    if(r->done)
+      r->done(r->context, err, NULL, 0);
+    return 1;
+  }
+  if(r->type == I2C_REQUEST_READ){
+    size_t n = _bus->read(r->address, r->data, r->len);
+    uint8_t err = i2c_read_result(n, r->len);
+    count(n, err, start_us);
+    _head = (_head + 1) % I2C_QUEUE_LENGTH;
+    _count--;
+    if(r->done)
+      r->done(r->context, err, r->data, n);
+    return 1;
+  }
+
+  // following register reads of the same device that continue the range
+  uint8_t n_requests = 1;
+  size_t burst = r->len;
+  while(n_requests < _count){
+    const i2c_request_t* next = &_queue[(_head + n_requests) % I2C_QUEUE_LENGTH];
+    if(next->type != I2C_REQUEST_READ_REG || next->address != r->address ||
+       next->reg != (uint8_t)(r->reg + burst) || burst + next->len > I2C_QUEUE_BURST_MAX)
+      break;
+    burst += next->len;
+    n_requests++;
+  }
+  uint8_t err;
+  if(n_requests == 1){
+    err = _bus->readRegister(r->address, r->reg, r->data, r->len);
+  } else {
+    uint8_t buffer[I2C_QUEUE_BURST_MAX];
+    err = _bus->readRegister(r->address, r->reg, buffer, burst);
+    size_t pos = 0;
+    for(uint8_t i = 0; i < n_requests; i++){
+      i2c_request_t* part = &_queue[(_head + i) % I2C_QUEUE_LENGTH];
+      memcpy(part->data, &buffer[pos], part->len);
+      pos += part->len;
+    }
+    stats.merged += n_requests - 1;
+  }
+  // address write and the read with a repeated start
+  count(1, err, start_us);
+  stats.transfers++;
+  stats.bits += 1 + 9 * (1 + burst);
+  stats.bytes += burst;
+  // the queue may be filled again by the callbacks
+  i2c_request_t done[I2C_QUEUE_LENGTH];
+  for(uint8_t i = 0; i < n_requests; i++)
+    done[i] = _queue[(_head + i) % I2C_QUEUE_LENGTH];
+  _head = (_head + n_requests) % I2C_QUEUE_LENGTH;
+  _count -= n_requests;
+  for(uint8_t i = 0; i < n_requests; i++){
+    if(done[i].done)
+      done[i].done(done[i].context, err, done[i].data, err == I2C_OK ? done[i].len : 0);
+  }
+  return n_requests;
+}
+
+uint16_t I2CQueue::process(uint32_t budget_us)
+{
+  uint16_t completed = 0;
+  if(_running)
+    return 0;
+  _running = true;
+  uint32_t start_us = _bus->micros();
+  while(_count > 0){
+    completed += runHead();
+    if((uint32_t)(_bus->micros() - start_us) >= budget_us)
+      break;
+  }
+  _running = false;
+  return completed;
+}
+
+void I2CQueue::flush()
+{
+  // a callback can not wait for the queue it is called from
+  while(_count > 0 && !_running)
+    process(UINT32_MAX);
+}
+
+uint8_t I2CQueue::write(uint8_t address, const uint8_t* data, size_t len, bool stop)
+{
+  flush();
+  uint32_t start_us = _bus->micros();
+  uint8_t err = _bus->write(address, data, len, stop);
+  stats.blocking++;
+  count(len, err, start_us);
+  // a repeated start has no stop and start bits of its own
+  if(!stop)
+    stats.bits--;
+  return err;
+}
+
+size_t I2CQueue::read(uint8_t address, uint8_t* data, size_t len)
+{
+  flush();
+  uint32_t start_us = _bus->micros();
+  size_t n = _bus->read(address, data, len);
+  stats.blocking++;
+  count(n, i2c_read_result(n, len), start_us);
+  return n;
+}
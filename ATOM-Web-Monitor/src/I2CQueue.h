@@ -0,0 +1,93 @@
+#ifndef __I2C_QUEUE_H
+#define __I2C_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "I2CBus.h"
+
+// transfer queue in front of the bus of the drivers
+//
+// submit*() only queues a transfer, process() (called by loop())
+// runs them in their order and calls the completion callbacks.
+// Register reads of the same device that follow each other in the
+// queue and continue the register range of the first one are merged
+// into one burst read (i2c_bench shows it with one byte reads of the
+// QMP6988 calibration registers). The blocking calls of I2CBus
+// run the queued transfers first, so the order on the bus is kept.
+// The time on the bus is measured per transfer (stats.busy_us).
+
+#define I2C_QUEUE_LENGTH      32
+// largest write of a request and largest merged burst read
+// (the buffer of TwoWire has 128 bytes)
+#define I2C_QUEUE_WRITE_MAX   8
+#define I2C_QUEUE_BURST_MAX   32
+
+#define I2C_REQUEST_WRITE     0
+#define I2C_REQUEST_READ      1
+#define I2C_REQUEST_READ_REG  2
+
+typedef struct _i2c_request {
+  uint8_t type;
+  uint8_t address;
+  uint8_t reg;
+  uint8_t len;
+  uint8_t* data;        // buffer of a read
+  uint8_t tx[I2C_QUEUE_WRITE_MAX];
+  i2c_done_t done;
+  void* context;
+} i2c_request_t;
+
+typedef struct _i2c_queue_stats {
+  uint32_t submitted;   // queued requests
+  uint32_t blocking;    // transactions of the blocking calls
+  uint32_t transfers;   // transfers on the bus incl. the blocking ones
+  uint32_t merged;      // requests merged into the burst of another one
+  uint32_t bytes;       // data bytes written and read
+  uint32_t errors;
+  uint32_t refused;     // submit*() with a full queue
+  uint32_t busy_us;     // measured time on the bus
+  uint32_t bits;        // bus clocks incl. start, stop and ACK bits
+  uint8_t max_fill;
+} i2c_queue_stats_t;
+
+class I2CQueue : public I2CBus {
+public:
+  I2CQueue(I2CBus* bus);
+
+  bool submitWrite(uint8_t address, const uint8_t* data, size_t len, i2c_done_t done, void* context);
+  bool submitRead(uint8_t address, uint8_t* data, size_t len, i2c_done_t done, void* context);
+  bool submitReadRegister(uint8_t address, uint8_t reg, uint8_t* data, size_t len,
+                          i2c_done_t done, void* context);
+  // run queued transfers for up to budget_us (at least one),
+  // returns the number of completed requests
+  uint16_t process(uint32_t budget_us);
+  void flush();
+  uint8_t queued() const { return _count; }
+
+  // blocking transfers after the queued ones
+  uint8_t write(uint8_t address, const uint8_t* data, size_t len, bool stop = true);
+  size_t read(uint8_t address, uint8_t* data, size_t len);
+  uint32_t micros() { return _bus->micros(); }
+  void delay(uint32_t ms) { _bus->delay(ms); }
+  bool recover() { return _bus->recover(); }
+
+  // bus time of the counted transfers at a bus clock in microseconds
+  uint32_t busTime(uint32_t clock_hz) const;
+  void clearStats();
+
+  i2c_queue_stats_t stats;
+
+private:
+  I2CBus* _bus;
+  i2c_request_t _queue[I2C_QUEUE_LENGTH];
+  uint8_t _head;
+  uint8_t _count;
+  // process() is running (no flush() from a callback)
+  bool _running;
+
+  i2c_request_t* add(uint8_t type, uint8_t address, size_t len, i2c_done_t done, void* context);
+  uint16_t runHead();
+  void count(size_t len, uint8_t err, uint32_t start_us);
+};
+
+#endif
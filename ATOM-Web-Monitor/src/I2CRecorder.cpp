@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include "I2CRecorder.h"
+
+I2CRecorder::I2CRecorder(I2CBus* bus, i2c_transaction_t* log, size_t size, uint32_t clock_hz)
+{
+  _bus = bus;
+  _log = log;
+  _size = size;
+  _clock_hz = clock_hz;
+  clear();
+}
+
+void I2CRecorder::clear()
+{
+  _head = 0;
+  _count = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+i2c_transaction_t* I2CRecorder::add(uint32_t time_us, uint8_t address, uint8_t flags, size_t len)
+{
+  stats.transactions++;
+  // a repeated start follows a write without stop at once
+  stats.bits += (flags & I2C_RECORD_NOSTOP ? 1 : 2) + 9 * (1 + len);
+  if(_size == 0)
+    return NULL;
+  i2c_transaction_t* t = &_log[_head];
+  _head = (_head + 1) % _size;
+  if(_count < _size)
+    _count++;
+  t->time_us = time_us;
+  t->address = address;
+  t->flags = flags;
+  t->len = len > 255 ? 255 : len;
+  return t;
+}
+
+uint8_t I2CRecorder::write(uint8_t address, const uint8_t* data, size_t len, bool stop)
+{
+  uint32_t time_us = _bus->micros();
+  uint8_t err = _bus->write(address, data, len, stop);
+  i2c_transaction_t* t = add(time_us, address, stop ? 0 : I2C_RECORD_NOSTOP, len);
+  stats.bytes_written += len;
+  if(err != I2C_OK)
+    stats.errors++;
+  if(t){
+    t->result = err;
+    memcpy(t->data, data, len < I2C_RECORD_DATA ? len : I2C_RECORD_DATA);
+  }
+  return err;
+}
+
+size_t I2CRecorder::read(uint8_t address, uint8_t* data, size_t len)
+{
+  uint32_t time_us = _bus->micros();
+  size_t n = _bus->read(address, data, len);
+  // a read that is not acknowledged ends after the address
+  i2c_transaction_t* t = add(time_us, address, I2C_RECORD_READ, n);
+  stats.bytes_read += n;
+  if(n != len)
+    stats.errors++;
+  if(t){
+    t->len = len > 255 ? 255 : len;
+    t->result = n;
+    memcpy(t->data, data, n < I2C_RECORD_DATA ? n : I2C_RECORD_DATA);
+  }
+  return n;
+}
+
+const i2c_transaction_t* I2CRecorder::entry(size_t index) const
+{
+  if(index >= _count)
+    return NULL;
+  return &_log[(_head + _size - _count + index) % _size];
+}
+
+uint32_t I2CRecorder::busTime() const
+{
+  return (uint32_t)(((uint64_t)stats.bits * 1000000 + _clock_hz - 1) / _clock_hz);
+}
+
+int I2CRecorder::format(const i2c_transaction_t* t, char* buf, size_t size)
+{
+  bool read = t->flags & I2C_RECORD_READ;
+  size_t shown = read ? t->result : t->len;
+  int pos = snprintf(buf, size, "%10u %c 0x%02x", (unsigned int)t->time_us, read ? 'R' : 'W', t->address);
+  for(size_t i = 0; i < shown && i < I2C_RECORD_DATA && pos > 0 && (size_t)pos < size; i++)
+    pos += snprintf(buf + pos, size - pos, " %02x", t->data[i]);
+  if(shown > I2C_RECORD_DATA && pos > 0 && (size_t)pos < size)
+    pos += snprintf(buf + pos, size - pos, " ...");
+  if(pos <= 0 || (size_t)pos >= size)
+    return pos;
+  if(read)
+    pos += snprintf(buf + pos, size - pos, " -> %u/%u", t->result, t->len);
+  else
+    pos += snprintf(buf + pos, size - pos, " -> %u%s", t->result, t->flags & I2C_RECORD_NOSTOP ? " (no stop)" : "");
+  return pos;
+}
@@ -0,0 +1,70 @@
+#ifndef __I2C_RECORDER_H
+#define __I2C_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "I2CBus.h"
+
+// logs every transaction of another bus with its time
+//
+// the log is a ring of the newest transactions, the counters cover
+// everything since clear(); busTime() is the time the bus is occupied
+// at the bus clock (start, address and data bytes with ACK, stop)
+
+// bytes of a transaction kept in the log
+#define I2C_RECORD_DATA   8
+
+// flags of a logged transaction
+#define I2C_RECORD_READ     0x01
+#define I2C_RECORD_NOSTOP   0x02   // followed by a repeated start
+
+typedef struct _i2c_transaction {
+  uint32_t time_us;     // micros() of the bus at the start
+  uint8_t address;
+  uint8_t flags;
+  uint8_t result;       // write: error code, read: received bytes
+  uint8_t len;          // requested bytes
+  uint8_t data[I2C_RECORD_DATA];
+} i2c_transaction_t;
+
+typedef struct _i2c_record_stats {
+  uint32_t transactions;
+  uint32_t bytes_written;
+  uint32_t bytes_read;
+  uint32_t errors;      // not acknowledged writes and short reads
+  uint32_t bits;        // bus clocks incl. start, stop and ACK bits
+} i2c_record_stats_t;
+
+class I2CRecorder : public I2CBus {
+public:
+  I2CRecorder(I2CBus* bus, i2c_transaction_t* log, size_t size, uint32_t clock_hz = 400000);
+
+  uint8_t write(uint8_t address, const uint8_t* data, size_t len, bool stop = true);
+  size_t read(uint8_t address, uint8_t* data, size_t len);
+  uint32_t micros() { return _bus->micros(); }
+  void delay(uint32_t ms) { _bus->delay(ms); }
+  bool recover() { return _bus->recover(); }
+
+  void clear();
+  // transactions in the log, 0 is the oldest one
+  size_t count() const { return _count; }
+  const i2c_transaction_t* entry(size_t index) const;
+  // bus time of the counted transactions in microseconds
+  uint32_t busTime() const;
+  // one line per transaction like "      1234 W 0x70 f4 27 -> 0"
+  static int format(const i2c_transaction_t* t, char* buf, size_t size);
+
+  i2c_record_stats_t stats;
+
+private:
+  I2CBus* _bus;
+  i2c_transaction_t* _log;
+  size_t _size;
+  size_t _head;
+  size_t _count;
+  uint32_t _clock_hz;
+
+  i2c_transaction_t* add(uint32_t time_us, uint8_t address, uint8_t flags, size_t len);
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "InfluxUDP.h"
+#include "TimeSync.h"
+
+// append helpers, all of them return the new length
+// or size if the text does not fit
+
+static size_t append_str(char* buf, size_t len, size_t size, const char* str)
+{
+  while(*str){
+    if(len >= size)
+      return size;
+    buf[len++] = *str++;
+  }
+  return len;
+}
+
+static size_t append_uint64(char* buf, size_t len, size_t size, uint64_t value)
+{
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + (value % 10);
+    value /= 10;
+  } while(value > 0);
+  if(len + n > size)
+    return size;
+  while(n > 0)
+    buf[len++] = digits[--n];
+  return len;
+}
+
+// value with two decimal places, e.g. -3.05
+static size_t append_fixed2(char* buf, size_t len, size_t size, float value)
+{
+  int32_t centi = lroundf(value * 100.0f);
+  uint32_t abs_centi;
+  if(centi < 0){
+    len = append_str(buf, len, size, "-");
+    abs_centi = -centi;
+  } else {
+    abs_centi = centi;
+  }
+  len = append_uint64(buf, len, size, abs_centi / 100);
+  if(len + 3 > size)
+    return size;
+  buf[len++] = '.';
+  buf[len++] = '0' + (abs_centi % 100) / 10;
+  buf[len++] = '0' + (abs_centi % 10);
+  return len;
+}
+
+// field with two decimal places, a failed read (NAN) leaves the field out,
+// *separator is ' ' before the first field and ',' afterwards
+static size_t append_field(char* buf, size_t len, size_t size, char* separator, const char* name, float value)
+{
+  char prefix[2] = {*separator, 0};
+  if(!env_value_valid(value))
+    return len;
+  *separator = ',';
+  len = append_str(buf, len, size, prefix);
+  len = append_str(buf, len, size, name);
+  len = append_str(buf, len, size, "=");
+  return append_fixed2(buf, len, size, value);
+}
+
+InfluxUDP::InfluxUDP()
+{
+  host = NULL;
+  port = 8089;
+  measurement = "env";
+  tags = NULL;
+  max_age_ms = 10000;
+  len = 0;
+  first_ms = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void InfluxUDP::begin(const char* host_in, uint16_t port_in, const char* measurement_in,
+                      const char* tags_in, uint32_t max_age_ms_in)
+{
+  host = host_in;
+  port = port_in;
+  measurement = measurement_in;
+  tags = tags_in;
+  max_age_ms = max_age_ms_in;
+  len = 0;
+}
+
+size_t InfluxUDP::formatLine(char* line, size_t size, const env_sample_t* sample)
+{
+  size_t n = 0;
+  char separator = ' ';
+  uint64_t time_ns = time_epoch_ns(sample->time_ms);
+
+  n = append_str(line, n, size, measurement);
+  if(tags != NULL && tags[0] != 0){
+    n = append_str(line, n, size, ",");
+    n = append_str(line, n, size, tags);
+  }
+  n = append_field(line, n, size, &separator, "temperature", sample->temperature);
+  n = append_field(line, n, size, &separator, "humidity", sample->humidity);
+  n = append_field(line, n, size, &separator, "pressure", sample->pressure);
+  // a line without any field is not valid
+  if(separator == ' ')
+    return 0;
+  // without a valid clock the server time is used
+  if(time_ns != 0){
+    n = append_str(line, n, size, " ");
+    n = append_uint64(line, n, size, time_ns);
+  }
+  n = append_str(line, n, size, "\n");
+  // a truncated line is not sent at all
+  if(n >= size)
+    return 0;
+  return n;
+}
+
+void InfluxUDP::add(const env_sample_t* sample)
+{
+  char line[INFLUX_MAX_LINE];
+  size_t line_len;
+
+  if(!enabled())
+    return;
+  line_len = formatLine(line, sizeof(line), sample);
+  if(line_len == 0)
+    return;
+  if(len + line_len > sizeof(datagram))
+    flush();
+  if(len == 0)
+    first_ms = millis();
+  memcpy(&datagram[len], line, line_len);
+  len += line_len;
+  stats.lines++;
+}
+
+void InfluxUDP::flush()
+{
+  if(len == 0)
+    return;
+  if(udp.beginPacket(host, port) && (udp.write((const uint8_t*)datagram, len) == len) && udp.endPacket()){
+    stats.datagrams++;
+    stats.bytes += len;
+  } else {
+    stats.errors++;
+  }
+  len = 0;
+}
+
+void InfluxUDP::loop()
+{
+  if(len > 0 && (millis() - first_ms) >= max_age_ms)
+    flush();
+}
@@ -0,0 +1,55 @@
+#ifndef __INFLUX_UDP_H
+#define __INFLUX_UDP_H
+
+#include "Arduino.h"
+#include "WiFiUdp.h"
+#include "EnvSample.h"
+
+// largest datagram without IP fragmentation (1500 - 20 IP - 8 UDP)
+#define INFLUX_MAX_DATAGRAM  1472
+// longest line of one sample
+#define INFLUX_MAX_LINE      192
+
+typedef struct _influx_stats {
+  uint32_t datagrams;
+  uint32_t lines;
+  uint32_t bytes;
+  uint32_t errors;     // datagrams that could not be sent
+} influx_stats_t;
+
+// sends the samples as InfluxDB line protocol via UDP:
+// <measurement>,<tags> temperature=..,humidity=..,pressure=.. <ns>
+// Lines are collected until the next one would not fit into one
+// datagram or the oldest one is older than max_age_ms.
+// The lines are formatted into fixed buffers without printf.
+class InfluxUDP
+{
+private:
+  WiFiUDP udp;
+  const char* host;
+  uint16_t port;
+  const char* measurement;
+  const char* tags;
+  uint32_t max_age_ms;
+  char datagram[INFLUX_MAX_DATAGRAM];
+  size_t len;
+  uint32_t first_ms;
+
+public:
+  influx_stats_t stats;
+
+  InfluxUDP();
+  // tags: "key=value[,key=value]" or NULL
+  void begin(const char* host_in, uint16_t port_in, const char* measurement_in,
+             const char* tags_in, uint32_t max_age_ms_in);
+  bool enabled() { return host != NULL && host[0] != 0; }
+  // format one sample, returns the length of the line
+  size_t formatLine(char* line, size_t size, const env_sample_t* sample);
+  void add(const env_sample_t* sample);
+  // send the pending lines
+  void flush();
+  // flush on age, has to be called from loop()
+  void loop();
+};
+
+#endif
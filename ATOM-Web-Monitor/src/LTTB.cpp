@@ -0,0 +1,114 @@
+#include "LTTB.h"
+
+static const char* lttb_metric_names[] = {"temperature", "humidity", "pressure"};
+
+int lttb_metric(const char* name)
+{
+  for(int i = 0; i < SERIES_COUNT; i++){
+    if(strcmp(name, lttb_metric_names[i]) == 0)
+      return i;
+  }
+  return SERIES_UNKNOWN;
+}
+
+// samples with a missing value (failed read) are skipped like overwritten ones
+static bool lttb_get(History* history, uint32_t seq, int metric, env_sample_t* sample)
+{
+  return history->get(seq, sample) && env_value_valid(env_sample_value(sample, metric));
+}
+
+uint16_t lttb_downsample(History* history, int metric, uint32_t first_seq, uint32_t end_seq,
+                         uint16_t points, lttb_emit_t emit, void* context)
+{
+  env_sample_t sample;
+  uint32_t n, seq;
+  uint16_t emitted = 0;
+
+  if(end_seq <= first_seq || points == 0)
+    return 0;
+  n = end_seq - first_seq;
+
+  // nothing to reduce: send every sample
+  if(points >= n){
+    for(seq = first_seq; seq < end_seq; seq++){
+      if(lttb_get(history, seq, metric, &sample)){
+        emit(context, sample.time_ms, env_sample_value(&sample, metric));
+        emitted++;
+      }
+    }
+    return emitted;
+  }
+
+  // the x axis is the time relative to the first sample
+  // to keep the precision of the float area calculation,
+  // without a valid first sample the first valid one is used
+  for(seq = first_seq; seq < end_seq; seq++){
+    if(lttb_get(history, seq, metric, &sample))
+      break;
+  }
+  if(seq == end_seq)
+    return 0;
+  uint32_t anchor = seq - first_seq;
+  uint32_t t0 = sample.time_ms;
+  float a_x = 0.0f;
+  float a_y = env_sample_value(&sample, metric);
+  emit(context, sample.time_ms, a_y);
+  emitted++;
+  if(points == 1)
+    return emitted;
+
+  // the first and the last sample are always selected,
+  // the n-2 samples in between are split into points-2 buckets
+  float every = points > 2 ? (float)(n - 2) / (float)(points - 2) : 0.0f;
+  for(uint16_t i = 0; i < points - 2; i++){
+    uint32_t bucket_start = (uint32_t)(i * every) + 1;
+    uint32_t bucket_end = (uint32_t)((i + 1) * every) + 1;
+    uint32_t next_end = (uint32_t)((i + 2) * every) + 1;
+    if(next_end > n)
+      next_end = n;
+
+    // average point of the next bucket
+    float avg_x = 0.0f, avg_y = 0.0f;
+    uint32_t avg_n = 0;
+    for(seq = bucket_end; seq < next_end; seq++){
+      if(lttb_get(history, first_seq + seq, metric, &sample)){
+        avg_x += (float)(sample.time_ms - t0);
+        avg_y += env_sample_value(&sample, metric);
+        avg_n++;
+      }
+    }
+    if(avg_n > 0){
+      avg_x /= avg_n;
+      avg_y /= avg_n;
+    }
+
+    // point of this bucket with the largest triangle
+    // between the last selected point and the next average
+    float max_area = -1.0f;
+    env_sample_t selected;
+    for(seq = bucket_start > anchor ? bucket_start : anchor + 1; seq < bucket_end; seq++){
+      if(!lttb_get(history, first_seq + seq, metric, &sample))
+        continue;
+      float x = (float)(sample.time_ms - t0);
+      float y = env_sample_value(&sample, metric);
+      float area = fabsf((a_x - avg_x) * (y - a_y) - (a_x - x) * (avg_y - a_y));
+      if(area > max_area){
+        max_area = area;
+        selected = sample;
+      }
+    }
+    // a bucket without a valid sample emits nothing
+    if(max_area < 0.0f)
+      continue;
+    a_x = (float)(selected.time_ms - t0);
+    a_y = env_sample_value(&selected, metric);
+    emit(context, selected.time_ms, a_y);
+    emitted++;
+  }
+
+  if(anchor < n - 1 && lttb_get(history, end_seq - 1, metric, &sample)){
+    emit(context, sample.time_ms, env_sample_value(&sample, metric));
+    emitted++;
+  }
+  return emitted;
+}
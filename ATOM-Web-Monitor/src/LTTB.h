@@ -0,0 +1,23 @@
+#ifndef __LTTB_H
+#define __LTTB_H
+
+#include "Arduino.h"
+#include "History.h"
+
+// called once for every selected point, in time order
+typedef void (*lttb_emit_t)(void* context, uint32_t time_ms, float value);
+
+// returns the SERIES_xxx number (EnvSample.h) for a metric name or SERIES_UNKNOWN
+int lttb_metric(const char* name);
+
+// Largest-Triangle-Three-Buckets downsampling of the history samples
+// [first_seq, end_seq) to exactly "points" points (or all samples if
+// there are fewer), 1 point is the first sample, 2 points are the
+// first and the last one. The samples are read straight out of the history
+// ring and every selected point is emitted immediately, so the memory
+// needed is constant and independent of the length of the window.
+// returns the number of emitted points
+uint16_t lttb_downsample(History* history, int metric, uint32_t first_seq, uint32_t end_seq,
+                         uint16_t points, lttb_emit_t emit, void* context);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __LITTLE_ENDIAN_H
+#define __LITTLE_ENDIAN_H
+
+#include <stdint.h>
+
+// byte order of the binary formats (history blobs, fleet packets,
+// raw stream), independent of the byte order of the CPU
+static inline void le_put_u16(uint8_t* buf, uint16_t value)
+{
+  buf[0] = value & 0xff;
+  buf[1] = value >> 8;
+}
+
+static inline void le_put_u32(uint8_t* buf, uint32_t value)
+{
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = value >> 24;
+}
+
+static inline uint16_t le_get_u16(const uint8_t* buf)
+{
+  return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static inline uint32_t le_get_u32(const uint8_t* buf)
+{
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+#endif
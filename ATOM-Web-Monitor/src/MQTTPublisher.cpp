@@ -0,0 +1,419 @@
+#include "MQTTPublisher.h"
+
+// MQTT control packet types (upper nibble of the first byte)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+// a full batch always fits into one message, the length of a message
+// has to fit into its 16 bit field
+static_assert(MQTT_MAX_PAYLOAD >= MQTT_MAX_BATCH * (MQTT_MAX_SAMPLE + 1) + 2,
+              "MQTT_MAX_PAYLOAD is too small for MQTT_MAX_BATCH samples");
+static_assert(MQTT_MAX_PAYLOAD <= 0xFFFF, "MQTT_MAX_PAYLOAD does not fit into mqtt_message_t.len");
+
+size_t mqtt_encode_length(uint8_t* buf, uint32_t len)
+{
+  size_t n = 0;
+  do {
+    uint8_t digit = len % 128;
+    len /= 128;
+    if(len > 0)
+      digit |= 0x80;
+    buf[n++] = digit;
+  } while(len > 0);
+  return n;
+}
+
+size_t mqtt_encode_string(uint8_t* buf, const char* str)
+{
+  size_t len = strlen(str);
+  buf[0] = len >> 8;
+  buf[1] = len & 0xff;
+  memcpy(&buf[2], str, len);
+  return len + 2;
+}
+
+MQTTPublisher::MQTTPublisher()
+{
+  client = NULL;
+  memset(&config, 0, sizeof(config));
+  memset(&stats, 0, sizeof(stats));
+  state = MQTT_DISCONNECTED;
+  last_connect_ms = 0;
+  last_tx_ms = 0;
+  last_rx_ms = 0;
+  ping_pending = false;
+  next_packet_id = 1;
+  queue_head = 0;
+  queue_count = 0;
+  batch_count = 0;
+  rx_step = 0;
+}
+
+void MQTTPublisher::begin(Client* client_in, const mqtt_config_t* config_in)
+{
+  client = client_in;
+  config = *config_in;
+  if(config.batch < 1)
+    config.batch = 1;
+  if(config.batch > MQTT_MAX_BATCH)
+    config.batch = MQTT_MAX_BATCH;
+  if(config.qos > 1)
+    config.qos = 1;
+  // first connection attempt with the next loop()
+  last_connect_ms = millis() - MQTT_RECONNECT_MS;
+}
+
+bool MQTTPublisher::sendPacket(const uint8_t* data, size_t len)
+{
+  size_t written = client->write(data, len);
+  stats.bytes += written;
+  last_tx_ms = millis();
+  if(written != len){
+    disconnect();
+    return false;
+  }
+  return true;
+}
+
+bool MQTTPublisher::connect()
+{
+  uint8_t body[MQTT_MAX_PACKET];
+  size_t len = 0;
+  uint8_t flags = 0x02; // clean session
+
+  last_connect_ms = millis();
+  if(!client->connect(config.broker, config.port))
+    return false;
+
+  // variable header: protocol name, level, flags, keep alive
+  len += mqtt_encode_string(&body[len], "MQTT");
+  body[len++] = 4;
+  if(config.user != NULL)
+    flags |= 0x80;
+  if(config.password != NULL)
+    flags |= 0x40;
+  body[len++] = flags;
+  body[len++] = config.keep_alive_s >> 8;
+  body[len++] = config.keep_alive_s & 0xff;
+  // payload
+  len += mqtt_encode_string(&body[len], config.client_id);
+  if(config.user != NULL)
+    len += mqtt_encode_string(&body[len], config.user);
+  if(config.password != NULL)
+    len += mqtt_encode_string(&body[len], config.password);
+
+  packet[0] = MQTT_CONNECT;
+  size_t header = 1 + mqtt_encode_length(&packet[1], len);
+  memcpy(&packet[header], body, len);
+  state = MQTT_CONNECTING;
+  rx_step = 0;
+  // the CONNACK is handled by a later loop()
+  return sendPacket(packet, header + len);
+}
+
+// the broker accepted the connection
+void MQTTPublisher::connected()
+{
+  state = MQTT_CONNECTED;
+  ping_pending = false;
+  stats.connects++;
+
+  // messages that were in flight have to be sent again
+  for(uint8_t i = 0; i < queue_count; i++){
+    mqtt_message_t* msg = &queue[(queue_head + i) % MQTT_QUEUE_LENGTH];
+    if(msg->state == MQTT_MSG_INFLIGHT)
+      msg->sent_ms = millis() - MQTT_RETRY_MS;
+  }
+}
+
+void MQTTPublisher::disconnect()
+{
+  state = MQTT_DISCONNECTED;
+  client->stop();
+}
+
+mqtt_message_t* MQTTPublisher::enqueue()
+{
+  // a full queue drops the oldest message
+  if(queue_count == MQTT_QUEUE_LENGTH){
+    queue_head = (queue_head + 1) % MQTT_QUEUE_LENGTH;
+    queue_count--;
+    stats.dropped++;
+  }
+  mqtt_message_t* msg = &queue[(queue_head + queue_count) % MQTT_QUEUE_LENGTH];
+  queue_count++;
+  msg->state = MQTT_MSG_QUEUED;
+  msg->last_value = 0;
+  msg->packet_id = 0;
+  msg->len = 0;
+  msg->sent_ms = 0;
+  return msg;
+}
+
+// value with two decimal places or null for a failed read
+static void mqtt_format_value(char* buf, size_t size, float value)
+{
+  if(env_value_valid(value))
+    snprintf(buf, size, "%.2f", value);
+  else
+    snprintf(buf, size, "null");
+}
+
+// JSON object of one sample, 0 if it does not fit into size
+static size_t mqtt_format_sample(char* buf, size_t size, const env_sample_t* sample)
+{
+  char temp[16], hum[16], pres[16];
+  mqtt_format_value(temp, sizeof(temp), sample->temperature);
+  mqtt_format_value(hum, sizeof(hum), sample->humidity);
+  mqtt_format_value(pres, sizeof(pres), sample->pressure);
+  int len = snprintf(buf, size, "{\"seq\":%u,\"ms\":%u,\"temp\":%s,\"hum\":%s,\"pres\":%s}",
+                     (unsigned int)sample->seq, (unsigned int)sample->time_ms,
+                     temp, hum, pres);
+  if(len < 0 || (size_t)len >= size)
+    return 0;
+  return len;
+}
+
+void MQTTPublisher::publish(const env_sample_t* sample, bool live)
+{
+  if(client == NULL || config.broker == NULL || config.broker[0] == 0)
+    return;
+  batch[batch_count++] = *sample;
+  if(batch_count >= config.batch)
+    flushBatch();
+
+  if(live && config.last_topic != NULL){
+    char payload[MQTT_MAX_SAMPLE + 1];
+    size_t len = mqtt_format_sample(payload, sizeof(payload), sample);
+    if(len == 0)
+      return;
+    // only the newest last value is kept in the queue
+    mqtt_message_t* msg = NULL;
+    for(uint8_t i = 0; i < queue_count; i++){
+      mqtt_message_t* m = &queue[(queue_head + i) % MQTT_QUEUE_LENGTH];
+      if(m->last_value && m->state == MQTT_MSG_QUEUED)
+        msg = m;
+    }
+    if(msg == NULL){
+      msg = enqueue();
+      msg->last_value = 1;
+    }
+    memcpy(msg->payload, payload, len);
+    msg->len = len;
+  }
+}
+
+size_t MQTTPublisher::replayCapacity()
+{
+  if(!isConnected() || queue_count >= MQTT_QUEUE_LENGTH / 2)
+    return 0;
+  // the samples of the open batch are part of the first message
+  return (MQTT_QUEUE_LENGTH / 2 - queue_count) * config.batch - batch_count;
+}
+
+void MQTTPublisher::flushBatch()
+{
+  uint8_t i = 0;
+
+  // a sample that does not fit anymore starts the next message
+  // (only possible with values outside of the sensor ranges)
+  while(i < batch_count){
+    mqtt_message_t* msg = enqueue();
+    size_t len = 0;
+    uint8_t n = 0;
+    if(config.batch > 1)
+      msg->payload[len++] = '[';
+    for(; i < batch_count; i++){
+      // separator and the closing bracket
+      size_t space = MQTT_MAX_PAYLOAD - len - 2;
+      char* pos = &msg->payload[len + (n > 0 ? 1 : 0)];
+      size_t sample_len = mqtt_format_sample(pos, space, &batch[i]);
+      if(sample_len == 0){
+        if(n > 0)
+          break;
+        // a single sample that never fits is dropped
+        continue;
+      }
+      if(n > 0)
+        msg->payload[len++] = ',';
+      len += sample_len;
+      n++;
+    }
+    if(n == 0){
+      // nothing to send, the message is removed again
+      queue_count--;
+      break;
+    }
+    if(config.batch > 1)
+      msg->payload[len++] = ']';
+    msg->len = len;
+    stats.samples += n;
+  }
+  batch_count = 0;
+}
+
+bool MQTTPublisher::sendPublish(mqtt_message_t* msg, bool dup)
+{
+  const char* topic = msg->last_value ? config.last_topic : config.topic;
+  size_t topic_len = strlen(topic);
+  size_t remaining = 2 + topic_len + msg->len + (config.qos > 0 ? 2 : 0);
+  size_t len = 0;
+
+  packet[len] = MQTT_PUBLISH | (config.qos << 1);
+  if(dup)
+    packet[len] |= 0x08;
+  if(msg->last_value)
+    packet[len] |= 0x01; // retain
+  len++;
+  len += mqtt_encode_length(&packet[len], remaining);
+  len += mqtt_encode_string(&packet[len], topic);
+  if(config.qos > 0){
+    packet[len++] = msg->packet_id >> 8;
+    packet[len++] = msg->packet_id & 0xff;
+  }
+  memcpy(&packet[len], msg->payload, msg->len);
+  len += msg->len;
+  if(!sendPacket(packet, len))
+    return false;
+  msg->sent_ms = millis();
+  stats.messages++;
+  return true;
+}
+
+void MQTTPublisher::handlePacket(uint8_t type, const uint8_t* data, size_t len)
+{
+  last_rx_ms = millis();
+  switch(type & 0xF0){
+    case MQTT_CONNACK:
+      // return code 0: connection accepted
+      if(state != MQTT_CONNECTING)
+        break;
+      if(len < 2 || data[1] != 0)
+        disconnect();
+      else
+        connected();
+      break;
+    case MQTT_PUBACK: {
+      if(len < 2)
+        break;
+      uint16_t packet_id = (data[0] << 8) | data[1];
+      for(uint8_t i = 0; i < queue_count; i++){
+        mqtt_message_t* msg = &queue[(queue_head + i) % MQTT_QUEUE_LENGTH];
+        if(msg->state == MQTT_MSG_INFLIGHT && msg->packet_id == packet_id){
+          msg->state = MQTT_MSG_DONE;
+          stats.acked++;
+        }
+      }
+      break;
+    }
+    case MQTT_PINGRESP:
+      ping_pending = false;
+      break;
+    default:
+      break;
+  }
+}
+
+// reads the bytes that have arrived, a packet that is not
+// complete yet is continued with the next call
+void MQTTPublisher::readPackets()
+{
+  while(state != MQTT_DISCONNECTED && client->available() > 0){
+    int c = client->read();
+    if(c < 0)
+      return;
+    if(rx_step == 0){
+      rx_type = c;
+      rx_len = 0;
+      rx_multiplier = 1;
+      rx_pos = 0;
+      rx_step = 1;
+      continue;
+    }
+    if(rx_step == 1){
+      // remaining length
+      if(rx_multiplier > 128*128*128){
+        disconnect();
+        return;
+      }
+      rx_len += (c & 0x7f) * rx_multiplier;
+      rx_multiplier *= 128;
+      if(c & 0x80)
+        continue;
+      rx_step = 2;
+    } else {
+      // only small packets are expected, the rest is skipped
+      if(rx_pos < sizeof(rx_data))
+        rx_data[rx_pos] = c;
+      rx_pos++;
+    }
+    if(rx_pos == rx_len){
+      rx_step = 0;
+      handlePacket(rx_type, rx_data, rx_len < sizeof(rx_data) ? rx_len : sizeof(rx_data));
+    }
+  }
+}
+
+void MQTTPublisher::loop()
+{
+  uint32_t now;
+
+  if(client == NULL || config.broker == NULL || config.broker[0] == 0)
+    return;
+  if(state != MQTT_DISCONNECTED && !client->connected())
+    disconnect();
+  if(state == MQTT_DISCONNECTED){
+    if((millis() - last_connect_ms) < MQTT_RECONNECT_MS)
+      return;
+    if(!connect())
+      return;
+  }
+  readPackets();
+  if(state == MQTT_CONNECTING){
+    // no CONNACK yet
+    if((millis() - last_connect_ms) >= MQTT_CONNACK_TIMEOUT_MS)
+      disconnect();
+    return;
+  }
+
+  // send new messages and repeat unacknowledged ones
+  for(uint8_t i = 0; state == MQTT_CONNECTED && i < queue_count; i++){
+    mqtt_message_t* msg = &queue[(queue_head + i) % MQTT_QUEUE_LENGTH];
+    now = millis();
+    if(msg->state == MQTT_MSG_QUEUED){
+      if(config.qos > 0){
+        msg->packet_id = next_packet_id++;
+        if(next_packet_id == 0)
+          next_packet_id = 1;
+      }
+      if(sendPublish(msg, false))
+        msg->state = (config.qos > 0) ? MQTT_MSG_INFLIGHT : MQTT_MSG_DONE;
+    } else if(msg->state == MQTT_MSG_INFLIGHT && (now - msg->sent_ms) >= MQTT_RETRY_MS){
+      sendPublish(msg, true);
+    }
+  }
+  // remove the finished messages at the start of the queue
+  while(queue_count > 0 && queue[queue_head].state == MQTT_MSG_DONE){
+    queue_head = (queue_head + 1) % MQTT_QUEUE_LENGTH;
+    queue_count--;
+  }
+
+  // keep alive
+  if(state == MQTT_CONNECTED && config.keep_alive_s > 0){
+    now = millis();
+    uint32_t keep_alive_ms = config.keep_alive_s * 1000UL;
+    if(ping_pending && (now - last_rx_ms) > keep_alive_ms + keep_alive_ms / 2){
+      // no answer from the broker
+      disconnect();
+    } else if(!ping_pending && (now - last_tx_ms) >= keep_alive_ms / 2){
+      uint8_t ping[2] = {MQTT_PINGREQ, 0};
+      if(sendPacket(ping, 2))
+        ping_pending = true;
+    }
+  }
+}
@@ -0,0 +1,162 @@
+#ifndef __MQTT_PUBLISHER_H
+#define __MQTT_PUBLISHER_H
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include "Client.h"
+#else
+// host tools (mqtt_bench): the part of the Arduino Client
+// the publisher uses, the tool provides millis()
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+class Client {
+public:
+  virtual ~Client() {}
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+};
+uint32_t millis();
+#endif
+#include "EnvSample.h"
+
+// minimal MQTT 3.1.1 client that only publishes
+// QoS 0 and 1, keep alive, retained last value and a
+// bounded queue that survives short broker outages
+//
+// loop() never waits for the broker: the CONNACK and all other
+// packets are read as far as they have arrived, only the TCP
+// connect of the Client blocks (up to its connect timeout)
+
+// number of messages in the outbound queue
+#define MQTT_QUEUE_LENGTH     16
+// most samples combined in one message
+#define MQTT_MAX_BATCH        8
+// longest JSON object of one sample: 37 fixed characters,
+// seq and ms with 10 digits, the values with up to 10 characters
+// (-45.00 ... 130.00 degC, 0.00 ... 100.00 %RH, <= 1100000.00 Pa)
+#define MQTT_MAX_SAMPLE       96
+// largest payload of one message: a full batch as JSON array
+#define MQTT_MAX_PAYLOAD      (MQTT_MAX_BATCH * (MQTT_MAX_SAMPLE + 1) + 2)
+// largest complete packet (header + topic + payload)
+#define MQTT_MAX_PACKET       (MQTT_MAX_PAYLOAD + 128)
+// resend unacknowledged QoS 1 messages after
+#define MQTT_RETRY_MS         5000
+// wait between two connection attempts
+#define MQTT_RECONNECT_MS     5000
+// the broker has to answer the CONNECT within
+#define MQTT_CONNACK_TIMEOUT_MS  3000
+
+typedef struct _mqtt_config {
+  const char* broker;     // host name or IP, NULL or "" disables MQTT
+  uint16_t port;
+  const char* client_id;
+  const char* user;       // NULL: no authentication
+  const char* password;
+  const char* topic;      // samples are published to <topic>
+  const char* last_topic; // retained last value, NULL: disabled
+  uint8_t qos;            // 0 or 1
+  uint8_t batch;          // samples per message (1..MQTT_MAX_BATCH)
+  uint16_t keep_alive_s;
+} mqtt_config_t;
+
+typedef struct _mqtt_stats {
+  uint32_t messages;      // messages sent (incl. retries)
+  uint32_t acked;         // QoS 1 messages acknowledged by the broker
+  uint32_t dropped;       // messages lost because the queue was full
+  uint32_t samples;       // samples sent
+  uint32_t bytes;         // bytes sent (all packets)
+  uint32_t connects;      // successful connections
+} mqtt_stats_t;
+
+// state of a queue entry
+#define MQTT_MSG_QUEUED       0
+#define MQTT_MSG_INFLIGHT     1  // QoS 1, waiting for PUBACK
+#define MQTT_MSG_DONE         2
+
+// state of the connection
+#define MQTT_DISCONNECTED     0
+#define MQTT_CONNECTING       1  // CONNECT sent, waiting for the CONNACK
+#define MQTT_CONNECTED        2
+
+typedef struct _mqtt_message {
+  uint8_t state;
+  uint8_t last_value;     // retained message to last_topic
+  uint16_t packet_id;
+  uint16_t len;
+  uint32_t sent_ms;
+  char payload[MQTT_MAX_PAYLOAD];
+} mqtt_message_t;
+
+class MQTTPublisher
+{
+private:
+  Client* client;
+  mqtt_config_t config;
+  uint8_t state;
+  uint32_t last_connect_ms;
+  uint32_t last_tx_ms;
+  uint32_t last_rx_ms;
+  bool ping_pending;
+  uint16_t next_packet_id;
+
+  // ring of outbound messages (QoS 1 messages stay
+  // in the queue until the PUBACK was received)
+  mqtt_message_t queue[MQTT_QUEUE_LENGTH];
+  uint8_t queue_head;
+  uint8_t queue_count;
+
+  // samples collected for the next batch message
+  env_sample_t batch[MQTT_MAX_BATCH];
+  uint8_t batch_count;
+
+  uint8_t packet[MQTT_MAX_PACKET];
+
+  // received packet, read in parts over several loop() calls
+  uint8_t rx_step;        // 0: type, 1: remaining length, 2: body
+  uint8_t rx_type;
+  uint32_t rx_len;
+  uint32_t rx_multiplier;
+  uint32_t rx_pos;
+  uint8_t rx_data[8];     // only small packets are expected
+
+  bool connect();
+  void connected();
+  void disconnect();
+  bool sendPacket(const uint8_t* data, size_t len);
+  bool sendPublish(mqtt_message_t* msg, bool dup);
+  void readPackets();
+  void handlePacket(uint8_t type, const uint8_t* data, size_t len);
+  mqtt_message_t* enqueue();
+  void flushBatch();
+
+public:
+  mqtt_stats_t stats;
+
+  MQTTPublisher();
+  void begin(Client* client_in, const mqtt_config_t* config_in);
+  bool enabled() { return config.broker != NULL && config.broker[0] != 0; }
+  bool isConnected() { return state == MQTT_CONNECTED; }
+  uint8_t queued() { return queue_count; }
+  uint8_t batchSize() { return config.batch; }
+  // older samples that can be published now, half of the
+  // queue is kept free for the live samples
+  size_t replayCapacity();
+  // add one sample, it is published when the batch is full
+  // live: false for older samples (no update of the last value)
+  void publish(const env_sample_t* sample, bool live = true);
+  // connection handling, keep alive and (re)transmission
+  // has to be called from loop()
+  void loop();
+};
+
+// helpers of the MQTT wire format
+size_t mqtt_encode_length(uint8_t* buf, uint32_t len);
+size_t mqtt_encode_string(uint8_t* buf, const char* str);
+
+#endif
@@ -0,0 +1,166 @@
+#include "ModbusServer.h"
+
+#define MODBUS_MBAP_SIZE   7
+#define MODBUS_FC_READ_HOLDING_REGISTERS  0x03
+#define MODBUS_FC_READ_INPUT_REGISTERS    0x04
+
+#define MODBUS_EX_ILLEGAL_FUNCTION        0x01
+#define MODBUS_EX_ILLEGAL_DATA_ADDRESS    0x02
+#define MODBUS_EX_ILLEGAL_DATA_VALUE      0x03
+
+ModbusServer::ModbusServer(uint16_t port) : server(port)
+{
+  for(int i = 0; i < MODBUS_MAX_CLIENTS; i++){
+    connections[i].active = false;
+    connections[i].rx_len = 0;
+  }
+  memset(image, 0, sizeof(image));
+  requests = 0;
+}
+
+void ModbusServer::begin()
+{
+  server.begin();
+  server.setNoDelay(true);
+}
+
+void ModbusServer::setRegister(uint16_t reg, uint16_t value)
+{
+  image[reg * 2] = value >> 8;
+  image[reg * 2 + 1] = value & 0xff;
+}
+
+void ModbusServer::update(const env_sample_t* sample, uint16_t sht30_errors, uint16_t qmp6988_errors)
+{
+  uint32_t p = env_pressure_encode(sample->pressure);
+
+  setRegister(MODBUS_REG_TEMPERATURE, (uint16_t)env_temperature_encode(sample->temperature));
+  setRegister(MODBUS_REG_HUMIDITY, env_humidity_encode(sample->humidity));
+  setRegister(MODBUS_REG_PRESSURE_HI, p >> 16);
+  setRegister(MODBUS_REG_PRESSURE_LO, p & 0xffff);
+  setRegister(MODBUS_REG_SAMPLES_HI, (sample->seq + 1) >> 16);
+  setRegister(MODBUS_REG_SAMPLES_LO, (sample->seq + 1) & 0xffff);
+  setRegister(MODBUS_REG_SHT30_ERR, sht30_errors);
+  setRegister(MODBUS_REG_QMP6988_ERR, qmp6988_errors);
+}
+
+void ModbusServer::accept()
+{
+  while(server.hasClient()){
+    WiFiClient client = server.available();
+    modbus_connection_t* con = NULL;
+    for(int i = 0; i < MODBUS_MAX_CLIENTS && con == NULL; i++){
+      if(!connections[i].active)
+        con = &connections[i];
+    }
+    if(con == NULL){
+      // all slots in use
+      client.stop();
+      continue;
+    }
+    client.setNoDelay(true);
+    con->client = client;
+    con->active = true;
+    con->rx_len = 0;
+    con->last_rx_ms = millis();
+  }
+}
+
+// answer one complete ADU, returns the length of the response
+size_t ModbusServer::handleRequest(const uint8_t* adu, uint16_t len, uint8_t* out)
+{
+  const uint8_t* pdu = &adu[MODBUS_MBAP_SIZE];
+  uint16_t pdu_len = len - MODBUS_MBAP_SIZE;
+  uint8_t fc = pdu[0];
+  uint8_t exception = 0;
+  size_t out_len;
+
+  requests++;
+  // transaction id, protocol id and unit id are echoed
+  memcpy(out, adu, MODBUS_MBAP_SIZE);
+
+  if(fc != MODBUS_FC_READ_HOLDING_REGISTERS && fc != MODBUS_FC_READ_INPUT_REGISTERS){
+    exception = MODBUS_EX_ILLEGAL_FUNCTION;
+  } else if(pdu_len != 5){
+    exception = MODBUS_EX_ILLEGAL_DATA_VALUE;
+  } else {
+    uint16_t start = (pdu[1] << 8) | pdu[2];
+    uint16_t quantity = (pdu[3] << 8) | pdu[4];
+    if(quantity < 1 || quantity > 125){
+      exception = MODBUS_EX_ILLEGAL_DATA_VALUE;
+    } else if((uint32_t)start + quantity > MODBUS_REGISTERS){
+      exception = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+    } else {
+      out[MODBUS_MBAP_SIZE] = fc;
+      out[MODBUS_MBAP_SIZE + 1] = quantity * 2;
+      memcpy(&out[MODBUS_MBAP_SIZE + 2], &image[start * 2], quantity * 2);
+      out_len = MODBUS_MBAP_SIZE + 2 + quantity * 2;
+    }
+  }
+  if(exception != 0){
+    out[MODBUS_MBAP_SIZE] = fc | 0x80;
+    out[MODBUS_MBAP_SIZE + 1] = exception;
+    out_len = MODBUS_MBAP_SIZE + 2;
+  }
+  // length field: unit id + PDU
+  out[4] = (out_len - 6) >> 8;
+  out[5] = (out_len - 6) & 0xff;
+  return out_len;
+}
+
+void ModbusServer::serve(modbus_connection_t* con)
+{
+  size_t tx_len = 0;
+  uint16_t pos = 0;
+
+  if(!con->client.connected() || (millis() - con->last_rx_ms) > MODBUS_IDLE_TIMEOUT_MS){
+    con->client.stop();
+    con->active = false;
+    return;
+  }
+  int available = con->client.available();
+  if(available <= 0)
+    return;
+  if(available > MODBUS_MAX_ADU - con->rx_len)
+    available = MODBUS_MAX_ADU - con->rx_len;
+  con->rx_len += con->client.read(&con->rx[con->rx_len], available);
+  con->last_rx_ms = millis();
+
+  // answer all complete requests in the buffer (pipelining)
+  while(con->rx_len - pos >= MODBUS_MBAP_SIZE + 1){
+    const uint8_t* adu = &con->rx[pos];
+    uint16_t protocol = (adu[2] << 8) | adu[3];
+    uint16_t length = (adu[4] << 8) | adu[5];
+    if(protocol != 0 || length < 2 || length > MODBUS_MAX_ADU - 6){
+      // not Modbus: close the connection
+      con->client.stop();
+      con->active = false;
+      return;
+    }
+    if(con->rx_len - pos < 6 + length)
+      break;
+    // the responses are sent together
+    if(tx_len + MODBUS_MAX_ADU > sizeof(tx)){
+      con->client.write(tx, tx_len);
+      tx_len = 0;
+    }
+    tx_len += handleRequest(adu, 6 + length, &tx[tx_len]);
+    pos += 6 + length;
+  }
+  if(tx_len > 0)
+    con->client.write(tx, tx_len);
+  // keep an incomplete request for the next call
+  if(pos > 0){
+    memmove(con->rx, &con->rx[pos], con->rx_len - pos);
+    con->rx_len -= pos;
+  }
+}
+
+void ModbusServer::loop()
+{
+  accept();
+  for(int i = 0; i < MODBUS_MAX_CLIENTS; i++){
+    if(connections[i].active)
+      serve(&connections[i]);
+  }
+}
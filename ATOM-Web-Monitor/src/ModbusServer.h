@@ -0,0 +1,64 @@
+#ifndef __MODBUS_SERVER_H
+#define __MODBUS_SERVER_H
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "EnvSample.h"
+
+#define MODBUS_DEFAULT_PORT    502
+// number of masters that can be connected at the same time
+#define MODBUS_MAX_CLIENTS     4
+// largest Modbus TCP ADU (MBAP header + PDU)
+#define MODBUS_MAX_ADU         260
+// connections without a request are closed after
+#define MODBUS_IDLE_TIMEOUT_MS 60000
+
+// input register map (function code 4, mirrored for function code 3)
+#define MODBUS_REG_TEMPERATURE   0  // int16   0.01 degC, -32768 if missing
+#define MODBUS_REG_HUMIDITY      1  // uint16  0.01 %, 65535 if missing
+#define MODBUS_REG_PRESSURE_HI   2  // uint32  0.01 Pa, high word first, 0 if missing
+#define MODBUS_REG_PRESSURE_LO   3
+#define MODBUS_REG_SAMPLES_HI    4  // uint32  sample counter
+#define MODBUS_REG_SAMPLES_LO    5
+#define MODBUS_REG_SHT30_ERR     6  // uint16  SHT30 read errors
+#define MODBUS_REG_QMP6988_ERR   7  // uint16  QMP6988 read errors
+#define MODBUS_REGISTERS         8
+
+typedef struct _modbus_connection {
+  WiFiClient client;
+  bool active;
+  uint32_t last_rx_ms;
+  uint16_t rx_len;
+  uint8_t rx[MODBUS_MAX_ADU];
+} modbus_connection_t;
+
+// Modbus TCP server for the ENV values
+// The register image is kept in Modbus byte order (big endian)
+// and updated once per measurement, a read request is answered
+// with a straight copy out of the image. Several masters can be
+// connected and each one can send pipelined requests.
+class ModbusServer
+{
+private:
+  WiFiServer server;
+  modbus_connection_t connections[MODBUS_MAX_CLIENTS];
+  uint8_t image[MODBUS_REGISTERS * 2];
+  uint8_t tx[MODBUS_MAX_ADU * 2];
+
+  void setRegister(uint16_t reg, uint16_t value);
+  void accept();
+  void serve(modbus_connection_t* con);
+  size_t handleRequest(const uint8_t* adu, uint16_t len, uint8_t* out);
+
+public:
+  uint32_t requests;
+
+  ModbusServer(uint16_t port = MODBUS_DEFAULT_PORT);
+  void begin();
+  // copy a new measurement into the register image
+  void update(const env_sample_t* sample, uint16_t sht30_errors, uint16_t qmp6988_errors);
+  // accept masters and answer their requests, has to be called from loop()
+  void loop();
+};
+
+#endif
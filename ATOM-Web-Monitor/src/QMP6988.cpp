@@ -1,4 +1,5 @@
 #include <math.h>
+#include <string.h>
 #include "stdint.h"
 #include "stdio.h"
 #include "QMP6988.h"
@@ -13,28 +14,19 @@
 
 void QMP6988::delayMS(unsigned int ms)
 {
-  delay(ms);
+  bus->delay(ms);
 }
 
 uint8_t QMP6988::writeReg(uint8_t slave, uint8_t reg_add,uint8_t reg_dat)
 {
-  device_wire->beginTransmission(slave);
-  device_wire->write(reg_add);
-  device_wire->write(reg_dat);
-  device_wire->endTransmission();
-  return 1;
+  last_error = bus->writeRegister(slave, reg_add, reg_dat);
+  return last_error == I2C_OK ? 1 : 0;
 }
 
 uint8_t QMP6988::readData(uint16_t slave, uint8_t reg_add, unsigned char* Read, uint8_t num)
 {
-  device_wire->beginTransmission(slave);
-  device_wire->write(reg_add);
-  device_wire->endTransmission();
-  device_wire->requestFrom(slave, num);
-  for (int i = 0; i < num; i++) {
-    *(Read + i) = device_wire->read();
-  }
-  return 1;
+  last_error = bus->readRegister(slave, reg_add, Read, num);
+  return last_error == I2C_OK ? 1 : 0;
 }
 
 uint8_t QMP6988::deviceCheck()
@@ -63,42 +55,18 @@ uint8_t QMP6988::deviceCheck()
 
 int QMP6988::getCalibrationData()
 {
-  int status = 0;
   //BITFIELDS temp_COE;
   uint8_t a_data_uint8_tr[QMP6988_CALIBRATION_DATA_LENGTH] = {0};
-  int len;
 
-  for(len = 0; len < QMP6988_CALIBRATION_DATA_LENGTH; len += 1)
+  // all coefficients in one burst read
+  if(readData(slave_addr, QMP6988_CALIBRATION_DATA_START, a_data_uint8_tr, QMP6988_CALIBRATION_DATA_LENGTH) == 0)
   {
-    status = readData(slave_addr,QMP6988_CALIBRATION_DATA_START+len,&a_data_uint8_tr[len],1);
-    if (status == 0)
-    {
-      QMP6988_LOG("qmp6988 read 0xA0 error!");
-      return status;
-    }
+    QMP6988_LOG("qmp6988 read 0xA0 error!");
+    return 0;
   }
 
-  qmp6988.qmp6988_cali.COE_a0 = (QMP6988_S32_t)(((a_data_uint8_tr[18] << SHIFT_LEFT_12_POSITION) \
-              | (a_data_uint8_tr[19] << SHIFT_LEFT_4_POSITION) \
-              | (a_data_uint8_tr[24] & 0x0f))<<12);
-  qmp6988.qmp6988_cali.COE_a0 = qmp6988.qmp6988_cali.COE_a0>>12;
-  
-  qmp6988.qmp6988_cali.COE_a1 = (QMP6988_S16_t)(((a_data_uint8_tr[20]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[21]);
-  qmp6988.qmp6988_cali.COE_a2 = (QMP6988_S16_t)(((a_data_uint8_tr[22]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[23]);
-  
-  qmp6988.qmp6988_cali.COE_b00 = (QMP6988_S32_t)(((a_data_uint8_tr[0] << SHIFT_LEFT_12_POSITION) \
-              | (a_data_uint8_tr[1] << SHIFT_LEFT_4_POSITION) \
-              | ((a_data_uint8_tr[24] & 0xf0) >> SHIFT_RIGHT_4_POSITION))<<12);
-  qmp6988.qmp6988_cali.COE_b00 = qmp6988.qmp6988_cali.COE_b00>>12;
-
-  qmp6988.qmp6988_cali.COE_bt1 = (QMP6988_S16_t)(((a_data_uint8_tr[2]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[3]);
-  qmp6988.qmp6988_cali.COE_bt2 = (QMP6988_S16_t)(((a_data_uint8_tr[4]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[5]);
-  qmp6988.qmp6988_cali.COE_bp1 = (QMP6988_S16_t)(((a_data_uint8_tr[6]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[7]);
-  qmp6988.qmp6988_cali.COE_b11 = (QMP6988_S16_t)(((a_data_uint8_tr[8]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[9]);
-  qmp6988.qmp6988_cali.COE_bp2 = (QMP6988_S16_t)(((a_data_uint8_tr[10]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[11]);
-  qmp6988.qmp6988_cali.COE_b12 = (QMP6988_S16_t)(((a_data_uint8_tr[12]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[13]);		
-  qmp6988.qmp6988_cali.COE_b21 = (QMP6988_S16_t)(((a_data_uint8_tr[14]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[15]);
-  qmp6988.qmp6988_cali.COE_bp3 = (QMP6988_S16_t)(((a_data_uint8_tr[16]) << SHIFT_LEFT_8_POSITION) | a_data_uint8_tr[17]);			
+  memcpy(qmp6988.cali_raw, a_data_uint8_tr, QMP6988_CALIBRATION_DATA_LENGTH);
+  qmp6988_cali_decode(a_data_uint8_tr, &qmp6988.qmp6988_cali);
 
   QMP6988_LOG("<-----------calibration data-------------->\r\n");
   QMP6988_LOG("COE_a0[%d]	COE_a1[%d]	COE_a2[%d]	COE_b00[%d]\r\n",
@@ -109,83 +77,11 @@ int QMP6988::getCalibrationData()
       qmp6988.qmp6988_cali.COE_bp2,qmp6988.qmp6988_cali.COE_b12,qmp6988.qmp6988_cali.COE_b21,qmp6988.qmp6988_cali.COE_bp3);
   QMP6988_LOG("<-----------calibration data-------------->\r\n");
 
-  qmp6988.ik.a0 = qmp6988.qmp6988_cali.COE_a0; // 20Q4
-  qmp6988.ik.b00 = qmp6988.qmp6988_cali.COE_b00; // 20Q4
-
-  qmp6988.ik.a1 = 3608L * (QMP6988_S32_t)qmp6988.qmp6988_cali.COE_a1 - 1731677965L; // 31Q23
-  qmp6988.ik.a2 = 16889L * (QMP6988_S32_t) qmp6988.qmp6988_cali.COE_a2 - 87619360L; // 30Q47
-
-  qmp6988.ik.bt1 = 2982L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_bt1 + 107370906L; // 28Q15
-  qmp6988.ik.bt2 = 329854L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_bt2 + 108083093L; // 34Q38
-  qmp6988.ik.bp1 = 19923L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_bp1 + 1133836764L; // 31Q20
-  qmp6988.ik.b11 = 2406L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_b11+ 118215883L; // 28Q34
-  qmp6988.ik.bp2 = 3079L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_bp2 - 181579595L; // 29Q43
-  qmp6988.ik.b12 = 6846L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_b12 + 85590281L; // 29Q53
-  qmp6988.ik.b21 = 13836L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_b21 + 79333336L; // 29Q60
-  qmp6988.ik.bp3 = 2915L * (QMP6988_S64_t)qmp6988.qmp6988_cali.COE_bp3 + 157155561L; // 28Q65
-  QMP6988_LOG("<----------- int calibration data -------------->\r\n");
-  QMP6988_LOG("a0[%d]	a1[%d] a2[%d] b00[%d]\r\n",qmp6988.ik.a0,qmp6988.ik.a1,qmp6988.ik.a2,qmp6988.ik.b00);
-  QMP6988_LOG("bt1[%lld]	bt2[%lld]	bp1[%lld]	b11[%lld]\r\n",qmp6988.ik.bt1,qmp6988.ik.bt2,qmp6988.ik.bp1,qmp6988.ik.b11);
-  QMP6988_LOG("bp2[%lld]	b12[%lld]	b21[%lld]	bp3[%lld]\r\n",qmp6988.ik.bp2,qmp6988.ik.b12,qmp6988.ik.b21,qmp6988.ik.bp3);
-  QMP6988_LOG("<----------- int calibration data -------------->\r\n");
+  QMP6988Compensation::init(&qmp6988.qmp6988_cali, &qmp6988.k);
   return 1;
 }
 
-QMP6988_S16_t QMP6988::convTx02e(qmp6988_ik_data_t *ik, QMP6988_S32_t dt) 
-{
-  QMP6988_S16_t ret;
-  QMP6988_S64_t wk1, wk2;
-
-  // wk1: 60Q4 // bit size
-  wk1 = ((QMP6988_S64_t)ik->a1 * (QMP6988_S64_t)dt); // 31Q23+24-1=54 (54Q23)
-  wk2 = ((QMP6988_S64_t)ik->a2 * (QMP6988_S64_t)dt) >> 14; // 30Q47+24-1=53 (39Q33)
-  wk2 = (wk2 * (QMP6988_S64_t)dt) >> 10; // 39Q33+24-1=62 (52Q23)
-  wk2 = ((wk1 + wk2) / 32767) >> 19; // 54,52->55Q23 (20Q04)
-  ret = (QMP6988_S16_t)((ik->a0 + wk2) >> 4); // 21Q4 -> 17Q0
-  return ret;
-}
-
-QMP6988_S32_t QMP6988::getPressure02e(qmp6988_ik_data_t *ik, QMP6988_S32_t dp, QMP6988_S16_t tx)
-{
-  QMP6988_S32_t ret;
-  QMP6988_S64_t wk1, wk2, wk3;
-
-  // wk1 = 48Q16 // bit size
-  wk1 = ((QMP6988_S64_t)ik->bt1 * (QMP6988_S64_t)tx); // 28Q15+16-1=43 (43Q15)
-  wk2 = ((QMP6988_S64_t)ik->bp1 * (QMP6988_S64_t)dp) >> 5; // 31Q20+24-1=54 (49Q15)
-  wk1 += wk2; // 43,49->50Q15
-  wk2 = ((QMP6988_S64_t)ik->bt2 * (QMP6988_S64_t)tx) >> 1; // 34Q38+16-1=49 (48Q37)
-  wk2 = (wk2 * (QMP6988_S64_t)tx) >> 8; // 48Q37+16-1=63 (55Q29)
-  wk3 = wk2; // 55Q29
-  wk2 = ((QMP6988_S64_t)ik->b11 * (QMP6988_S64_t)tx) >> 4; // 28Q34+16-1=43 (39Q30)
-  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q30+24-1=62 (61Q29)
-  wk3 += wk2; // 55,61->62Q29
-  wk2 = ((QMP6988_S64_t)ik->bp2 * (QMP6988_S64_t)dp) >> 13; // 29Q43+24-1=52 (39Q30)
-  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q30+24-1=62 (61Q29)
-  wk3 += wk2; // 62,61->63Q29
-  wk1 += wk3 >> 14; // Q29 >> 14 -> Q15
-  wk2 = ((QMP6988_S64_t)ik->b12 * (QMP6988_S64_t)tx); // 29Q53+16-1=45 (45Q53)
-  wk2 = (wk2 * (QMP6988_S64_t)tx) >> 22; // 45Q53+16-1=61 (39Q31)
-  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q31+24-1=62 (61Q30)
-  wk3 = wk2; // 61Q30
-  wk2 = ((QMP6988_S64_t)ik->b21 * (QMP6988_S64_t)tx) >> 6; // 29Q60+16-1=45 (39Q54)
-  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 23; // 39Q54+24-1=62 (39Q31)
-  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q31+24-1=62 (61Q20)
-  wk3 += wk2; // 61,61->62Q30
-  wk2 = ((QMP6988_S64_t)ik->bp3 * (QMP6988_S64_t)dp) >> 12; // 28Q65+24-1=51 (39Q53)
-  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 23; // 39Q53+24-1=62 (39Q30)
-  wk2 = (wk2 * (QMP6988_S64_t)dp); // 39Q30+24-1=62 (62Q30)
-  wk3 += wk2; // 62,62->63Q30
-  wk1 += wk3 >> 15; // Q30 >> 15 = Q15
-  wk1 /= 32767L;
-  wk1 >>= 11; // Q15 >> 7 = Q4
-  wk1 += ik->b00; // Q4 + 20Q4
-  //wk1 >>= 4; // 28Q4 -> 24Q0
-  ret = (QMP6988_S32_t)wk1;
-  return ret;
-}
-
-void QMP6988::softwareReset()
+uint8_t QMP6988::softwareReset()
 {
   uint8_t ret = 0; 
 
@@ -195,67 +91,143 @@ void QMP6988::softwareReset()
     QMP6988_LOG("softwareReset fail!!! \r\n");
   }
   delayMS(20);
+  // the chip may reset before it acknowledges the command,
+  // this write shows that it answers after the reset
   ret = writeReg(slave_addr, QMP6988_RESET_REG, 0x00);
+  // the reset clears all control registers
+  qmp6988.ctrl_meas = 0x00;
+  qmp6988.config = 0x00;
+  qmp6988.power_mode = QMP6988_SLEEP_MODE;
+  qmp6988.shadow_valid = ret != 0;
+  return ret;
 }
 
+// the setters change one field of the shadow registers,
+// a change takes effect with the next conversion
+
 void QMP6988::setpPowermode(int power_mode)
 {
-  uint8_t data;
-
   QMP6988_LOG("qmp_set_powermode %d \r\n", power_mode);
-
-  qmp6988.power_mode = power_mode;
-  readData(slave_addr, QMP6988_CTRLMEAS_REG, &data, 1);
-  data = data&0xfc;
-  if(power_mode == QMP6988_SLEEP_MODE)
-  {
-    data |= 0x00;
-  }
-  else if(power_mode == QMP6988_FORCED_MODE)
-  {
-    data |= 0x01;
-  }
-  else if(power_mode == QMP6988_NORMAL_MODE)
-  {
-    data |= 0x03;
-  }
-  writeReg(slave_addr, QMP6988_CTRLMEAS_REG, data);
-
-  QMP6988_LOG("qmp_set_powermode 0xf4=0x%x \r\n", data);
-  
-  delayMS(20);
+  configure(power_mode, (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRSP__MSK) >> QMP6988_CTRLMEAS_REG_OSRSP__POS,
+            (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRST__MSK) >> QMP6988_CTRLMEAS_REG_OSRST__POS,
+            qmp6988.config & QMP6988_CONFIG_REG_FILTER__MSK);
 }
 
 void QMP6988::setFilter(unsigned char filter)
 {	
-  uint8_t data;
+  configure(qmp6988.power_mode, (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRSP__MSK) >> QMP6988_CTRLMEAS_REG_OSRSP__POS,
+            (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRST__MSK) >> QMP6988_CTRLMEAS_REG_OSRST__POS, filter);
+}
 
-  data = (filter&0x03);
-  writeReg(slave_addr, QMP6988_CONFIG_REG, data);
+void QMP6988::setOversamplingP(unsigned char oversampling_p)
+{
+  configure(qmp6988.power_mode, oversampling_p,
+            (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRST__MSK) >> QMP6988_CTRLMEAS_REG_OSRST__POS,
+            qmp6988.config & QMP6988_CONFIG_REG_FILTER__MSK);
+}
 
-  delayMS(20);
+void QMP6988::setOversamplingT(unsigned char oversampling_t)
+{
+  configure(qmp6988.power_mode, (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRSP__MSK) >> QMP6988_CTRLMEAS_REG_OSRSP__POS,
+            oversampling_t, qmp6988.config & QMP6988_CONFIG_REG_FILTER__MSK);
 }
 
-void QMP6988::setOversamplingP(unsigned char oversampling_p)
+uint8_t QMP6988::configure(uint8_t power_mode, uint8_t oversampling_p, uint8_t oversampling_t, uint8_t filter)
 {
-  uint8_t data;
+  uint8_t ctrl_meas, config;
+
+  ctrl_meas = ((oversampling_t << QMP6988_CTRLMEAS_REG_OSRST__POS) & QMP6988_CTRLMEAS_REG_OSRST__MSK) |
+              ((oversampling_p << QMP6988_CTRLMEAS_REG_OSRSP__POS) & QMP6988_CTRLMEAS_REG_OSRSP__MSK) |
+              (power_mode & QMP6988_CTRLMEAS_REG_MODE__MSK);
+  config = filter & QMP6988_CONFIG_REG_FILTER__MSK;
+  // a forced conversion is started by every write of the mode
+  if(qmp6988.shadow_valid && power_mode != QMP6988_FORCED_MODE &&
+     ctrl_meas == qmp6988.ctrl_meas && config == qmp6988.config)
+    return 1;
+
+  // register address and data pairs in one transaction:
+  // stop the conversions, set the filter, then oversampling
+  // and mode, so no conversion runs with mixed settings
+  uint8_t data[6] = {
+    QMP6988_CTRLMEAS_REG, (uint8_t)(ctrl_meas & ~QMP6988_CTRLMEAS_REG_MODE__MSK),
+    QMP6988_CONFIG_REG, config,
+    QMP6988_CTRLMEAS_REG, ctrl_meas
+  };
+  last_error = bus->write(slave_addr, data, sizeof(data));
+  if(last_error != I2C_OK){
+    QMP6988_ERR("qmp6988 configure failed\r\n");
+    // the state of the registers is unknown now
+    qmp6988.shadow_valid = false;
+    return 0;
+  }
+  QMP6988_LOG("qmp6988 configure 0xf4=0x%x 0xf1=0x%x\r\n", ctrl_meas, config);
+  qmp6988.ctrl_meas = ctrl_meas;
+  qmp6988.config = config;
+  qmp6988.power_mode = power_mode;
+  qmp6988.shadow_valid = true;
+  // the result registers are valid after the first conversion
+  qmp6988.conversion_pending = power_mode == QMP6988_NORMAL_MODE;
+  qmp6988.conversion_start_us = bus->micros();
+  qmp6988.conversion_time_us = conversionTime();
+  return 1;
+}
 
-  readData(slave_addr, QMP6988_CTRLMEAS_REG, &data, 1);
-  data &= 0xe3;
-  data |= (oversampling_p << 2);
-  writeReg(slave_addr, QMP6988_CTRLMEAS_REG, data);
-  delayMS(20);
+// the measurement times of the datasheet (5.5 ms for P 2x/T 1x up to
+// 40 ms for P 32x/T 4x) are met by a fixed part and 1.05 ms per sample
+uint32_t QMP6988::conversionTime(uint8_t oversampling_p, uint8_t oversampling_t)
+{
+  uint32_t samples = 0;
+
+  if(oversampling_p != QMP6988_OVERSAMPLING_SKIPPED)
+    samples += 1 << (oversampling_p - QMP6988_OVERSAMPLING_1X);
+  if(oversampling_t != QMP6988_OVERSAMPLING_SKIPPED)
+    samples += 1 << (oversampling_t - QMP6988_OVERSAMPLING_1X);
+  return 3000 + 1050 * samples;
 }
 
-void QMP6988::setOversamplingT(unsigned char oversampling_t)
+uint32_t QMP6988::conversionTime()
 {
-  uint8_t data;
+  return conversionTime((qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRSP__MSK) >> QMP6988_CTRLMEAS_REG_OSRSP__POS,
+                        (qmp6988.ctrl_meas & QMP6988_CTRLMEAS_REG_OSRST__MSK) >> QMP6988_CTRLMEAS_REG_OSRST__POS);
+}
 
-  readData(slave_addr, QMP6988_CTRLMEAS_REG, &data, 1);
-  data &= 0x1f;
-  data |= (oversampling_t<<5);
-  writeReg(slave_addr, QMP6988_CTRLMEAS_REG, data);
-  delayMS(20);
+uint8_t QMP6988::startForced()
+{
+  uint8_t ctrl_meas = (qmp6988.ctrl_meas & ~QMP6988_CTRLMEAS_REG_MODE__MSK) | QMP6988_FORCED_MODE;
+
+  qmp6988.conversion_pending = false;
+  // the oversampling is taken from the shadow register,
+  // one write of CTRL_MEAS starts the conversion
+  last_error = bus->writeRegister(slave_addr, QMP6988_CTRLMEAS_REG, ctrl_meas);
+  if(last_error != I2C_OK){
+    QMP6988_ERR("qmp6988 forced start failed\r\n");
+    return 0;
+  }
+  qmp6988.ctrl_meas = ctrl_meas;
+  qmp6988.power_mode = QMP6988_FORCED_MODE;
+  qmp6988.conversion_pending = true;
+  qmp6988.conversion_start_us = bus->micros();
+  qmp6988.conversion_time_us = conversionTime();
+  return 1;
+}
+
+bool QMP6988::ready()
+{
+  if(!qmp6988.conversion_pending)
+    return true;
+  if((uint32_t)(bus->micros() - qmp6988.conversion_start_us) < qmp6988.conversion_time_us)
+    return false;
+  qmp6988.conversion_pending = false;
+  return true;
+}
+
+bool QMP6988::conversionDone()
+{
+  uint8_t status;
+
+  if(readData(slave_addr, QMP6988_DEVICE_STAT_REG, &status, 1) == 0)
+    return false;
+  return (status & QMP6988_DEVICE_STAT_MEASURE) == 0;
 }
 
 float QMP6988::calcAltitude(float pressure, float temp)
@@ -267,53 +239,97 @@ float QMP6988::calcAltitude(float pressure, float temp)
   return altitude;
 }
 
-float QMP6988::calcPressure()
+static void decode_raw(const uint8_t* a_data_uint8_tr, uint32_t* p_read, uint32_t* t_read)
+{
+  *p_read = (QMP6988_U32_t)(
+  (((QMP6988_U32_t)(a_data_uint8_tr[0])) << SHIFT_LEFT_16_POSITION) |
+  (((QMP6988_U16_t)(a_data_uint8_tr[1])) << SHIFT_LEFT_8_POSITION) | (a_data_uint8_tr[2]));
+
+  *t_read = (QMP6988_U32_t)(
+  (((QMP6988_U32_t)(a_data_uint8_tr[3])) << SHIFT_LEFT_16_POSITION) |
+  (((QMP6988_U16_t)(a_data_uint8_tr[4])) << SHIFT_LEFT_8_POSITION) | (a_data_uint8_tr[5]));
+}
+
+uint8_t QMP6988::readRaw(uint32_t* p_read, uint32_t* t_read)
 {
   uint8_t err = 0;
-  QMP6988_U32_t P_read, T_read;
-  QMP6988_S32_t P_raw, T_raw;
   uint8_t a_data_uint8_tr[6] = {0};
-  QMP6988_S32_t T_int, P_int;
 
-  // press
+  // press and temp in one burst
   err = readData(slave_addr, QMP6988_PRESSURE_MSB_REG, a_data_uint8_tr, 6);
   if(err == 0)
   {
     QMP6988_LOG("qmp6988 read press raw error! \r\n");
-    return 0.0f;
+    return 0;
   }
-  P_read = (QMP6988_U32_t)(
-  (((QMP6988_U32_t)(a_data_uint8_tr[0])) << SHIFT_LEFT_16_POSITION) |
-  (((QMP6988_U16_t)(a_data_uint8_tr[1])) << SHIFT_LEFT_8_POSITION) | (a_data_uint8_tr[2]));
-  P_raw = (QMP6988_S32_t)(P_read - SUBTRACTOR);
+  decode_raw(a_data_uint8_tr, p_read, t_read);
+  return 1;
+}
 
-  T_read = (QMP6988_U32_t)(
-  (((QMP6988_U32_t)(a_data_uint8_tr[3])) << SHIFT_LEFT_16_POSITION) |
-  (((QMP6988_U16_t)(a_data_uint8_tr[4])) << SHIFT_LEFT_8_POSITION) | (a_data_uint8_tr[5]));
-  T_raw = (QMP6988_S32_t)(T_read - SUBTRACTOR);
+float QMP6988::calcPressure()
+{
+  uint32_t P_read, T_read;
 
-  T_int = convTx02e(&(qmp6988.ik), T_raw);
-  P_int = getPressure02e(&(qmp6988.ik), P_raw, T_int);
-  qmp6988.temperature = (float)T_int / 256.0f;
-  qmp6988.pressure = (float)P_int/16.0f;
+  if(readRaw(&P_read, &T_read) == 0)
+    return 0.0f;
+  QMP6988Compensation::compensate(&qmp6988.k, P_read, T_read, &qmp6988.temperature, &qmp6988.pressure);
 
   return qmp6988.pressure;
 }
 
+uint8_t QMP6988::requestPressure(qmp6988_done_t done_in, void* context)
+{
+  if(reading)
+    return 0;
+  reading = true;
+  done = done_in;
+  done_context = context;
+  if(!bus->submitReadRegister(slave_addr, QMP6988_PRESSURE_MSB_REG, raw_data, 6, onRaw, this)){
+    reading = false;
+    return 0;
+  }
+  return 1;
+}
+
+void QMP6988::onRaw(void* context, uint8_t result, const uint8_t* data, size_t /* len */)
+{
+  QMP6988* qmp = (QMP6988*)context;
+  uint32_t P_read, T_read;
+  float pressure = 0.0f;
+
+  qmp->reading = false;
+  qmp->last_error = result;
+  if(result == I2C_OK){
+    decode_raw(data, &P_read, &T_read);
+    QMP6988Compensation::compensate(&qmp->qmp6988.k, P_read, T_read, &qmp->qmp6988.temperature, &qmp->qmp6988.pressure);
+    pressure = qmp->qmp6988.pressure;
+  } else {
+    QMP6988_LOG("qmp6988 read press raw error! \r\n");
+  }
+  if(qmp->done)
+    qmp->done(qmp->done_context, pressure);
+}
+
+#ifdef ARDUINO
 uint8_t QMP6988::init(uint8_t slave_addr_in, TwoWire* wire_in)
 {
-  device_wire = wire_in;
+  wire_bus.setWire(wire_in);
+  return init(&wire_bus, slave_addr_in);
+}
+#endif
+
+uint8_t QMP6988::init(I2CBus* bus_in, uint8_t slave_addr_in)
+{
+  bus = bus_in;
+  reading = false;
+  last_error = I2C_OK;
   uint8_t ret;
   slave_addr = slave_addr_in;
   ret = deviceCheck();
   if(ret == 0) {
     return 0;
   }
-  softwareReset();
-  getCalibrationData();
-  setpPowermode(QMP6988_NORMAL_MODE);
-  setFilter(QMP6988_FILTERCOEFF_4);
-  setOversamplingP(QMP6988_OVERSAMPLING_8X);
-  setOversamplingT(QMP6988_OVERSAMPLING_1X);
-  return 1;
+  if(softwareReset() == 0 || getCalibrationData() == 0)
+    return 0;
+  return configure(QMP6988_NORMAL_MODE, QMP6988_OVERSAMPLING_8X, QMP6988_OVERSAMPLING_1X, QMP6988_FILTERCOEFF_4);
 }
@@ -1,24 +1,35 @@
 #ifndef __QMP6988_H
 #define __QMP6988_H
 
+#ifdef ARDUINO
 #include "Arduino.h"
-#include "Wire.h"
+#include "WireBus.h"
+#endif
+#include "I2CBus.h"
+#include "QMP6988Compensation.h"
+
+// compensation used by calcPressure():
+// 0: 64 bit fixed point (default), 1: single precision float
+// (ATOM-Host-Tools/qmp6988_bench compares both)
+#ifndef QMP6988_FLOAT_COMPENSATION
+#define QMP6988_FLOAT_COMPENSATION 0
+#endif
+#if QMP6988_FLOAT_COMPENSATION
+typedef QMP6988FloatCompensation QMP6988Compensation;
+#else
+typedef QMP6988IntegerCompensation QMP6988Compensation;
+#endif
 
 #define QMP6988_SLAVE_ADDRESS_L  (0x70)
 #define QMP6988_SLAVE_ADDRESS_H  (0x56)
 
-#define QMP6988_U16_t unsigned short
-#define QMP6988_S16_t short
-#define QMP6988_U32_t unsigned int
-#define QMP6988_S32_t int
-#define QMP6988_U64_t unsigned long long
-#define QMP6988_S64_t long long
-
 #define QMP6988_CHIP_ID							0x5C
 
 #define QMP6988_CHIP_ID_REG					0xD1
 #define QMP6988_RESET_REG						0xE0  /* Device reset register */
 #define QMP6988_DEVICE_STAT_REG			0xF3  /* Device state register */
+#define QMP6988_DEVICE_STAT_MEASURE       0x08  /* conversion running */
+#define QMP6988_DEVICE_STAT_OTP_UPDATE    0x01  /* OTP data being copied */
 #define QMP6988_CTRLMEAS_REG				0xF4  /* Measurement Condition Control Register */
 /* data */
 #define QMP6988_PRESSURE_MSB_REG    0xF7  /* Pressure MSB Register */
@@ -26,7 +37,6 @@
 
 /* compensation calculation */
 #define QMP6988_CALIBRATION_DATA_START    0xA0 /* QMP6988 compensation coefficients */
-#define QMP6988_CALIBRATION_DATA_LENGTH		25
 
 #define SHIFT_RIGHT_4_POSITION 		4
 #define SHIFT_LEFT_2_POSITION			2
@@ -76,34 +86,6 @@
 #define QMP6988_CONFIG_REG_FILTER__MSK		0x07
 #define QMP6988_CONFIG_REG_FILTER__LEN		3
 
-#define SUBTRACTOR 8388608
-
-typedef struct _qmp6988_cali_data {
-  QMP6988_S32_t COE_a0;
-  QMP6988_S16_t COE_a1;
-  QMP6988_S16_t COE_a2;
-  QMP6988_S32_t COE_b00;
-  QMP6988_S16_t COE_bt1;
-  QMP6988_S16_t COE_bt2;
-  QMP6988_S16_t COE_bp1;
-  QMP6988_S16_t COE_b11;
-  QMP6988_S16_t COE_bp2;
-  QMP6988_S16_t COE_b12;
-  QMP6988_S16_t COE_b21;
-  QMP6988_S16_t COE_bp3;
-} qmp6988_cali_data_t;
-
-typedef struct _qmp6988_fk_data {
-  float a0, b00;
-  float a1, a2, bt1, bt2, bp1, b11, bp2, b12, b21, bp3;
-} qmp6988_fk_data_t;
-
-typedef struct _qmp6988_ik_data {
-  QMP6988_S32_t a0, b00;
-  QMP6988_S32_t a1, a2;
-  QMP6988_S64_t bt1, bt2, bp1, b11, bp2, b12, b21, bp3;
-} qmp6988_ik_data_t;
-
 typedef struct _qmp6988_data {
   uint8_t slave;
   uint8_t chip_id;
@@ -112,36 +94,91 @@ typedef struct _qmp6988_data {
   float pressure;
   float altitude;
   qmp6988_cali_data_t qmp6988_cali;
-  qmp6988_ik_data_t ik;
+  // coefficients of the selected compensation
+  QMP6988Compensation::coefficients_t k;
+  // calibration data as read from the OTP
+  uint8_t cali_raw[QMP6988_CALIBRATION_DATA_LENGTH];
+  // shadow copies of the written registers,
+  // the settings are changed without reading them back
+  uint8_t ctrl_meas;
+  uint8_t config;
+  bool shadow_valid;
+  // running forced conversion or the first one of the normal mode
+  bool conversion_pending;
+  uint32_t conversion_start_us;
+  uint32_t conversion_time_us;
 } qmp6988_data_t;
 
+// completion of requestPressure(), 0.0 if the sensor could not be read
+typedef void (*qmp6988_done_t)(void* context, float pressure);
+
 class QMP6988 
 {
 private:
   qmp6988_data_t qmp6988;
   uint8_t slave_addr;
-  TwoWire* device_wire;
+  I2CBus* bus;
+#ifdef ARDUINO
+  // bus of the TwoWire given to init()
+  WireBus wire_bus;
+#endif
   void delayMS(unsigned int ms);
 
   // read calibration data from otp
   int getCalibrationData();
-  QMP6988_S32_t getPressure02e(qmp6988_ik_data_t *ik, QMP6988_S32_t dp, QMP6988_S16_t tx);
-  QMP6988_S16_t convTx02e(qmp6988_ik_data_t *ik, QMP6988_S32_t dt);
 
-  void softwareReset();
+  uint8_t softwareReset();
+  // I2C result of the last transfer that failed or succeeded
+  uint8_t last_error;
+
+  // submitted read of the raw words
+  uint8_t raw_data[6];
+  bool reading;
+  qmp6988_done_t done;
+  void* done_context;
+  static void onRaw(void* context, uint8_t result, const uint8_t* data, size_t len);
 
 public:
+  // 0 if the chip does not answer or a transfer of the
+  // reset, the calibration read or the configuration fails
+  uint8_t init(I2CBus* bus_in, uint8_t slave_addr=0x56);
+#ifdef ARDUINO
   uint8_t init(uint8_t slave_addr=0x56, TwoWire* wire_in=&Wire);
+#endif
   uint8_t deviceCheck();
 
+  // reference formula with pow(), per sample see AltitudeTable (Altitude.h)
   float calcAltitude(float pressure, float temp);
   float calcPressure();
+  // calcPressure() with the read submitted to the bus, done is called
+  // when the transfer is completed (at once if the bus has no queue)
+  uint8_t requestPressure(qmp6988_done_t done, void* context);
+  // raw 24 bit ADC words of the last conversion
+  uint8_t readRaw(uint32_t* p_read, uint32_t* t_read);
+  const uint8_t* calibrationData() { return qmp6988.cali_raw; }
+  // I2C_OK or the error code of the last transfer
+  uint8_t lastError() { return last_error; }
 
   void setpPowermode(int power_mode);
   void setFilter(unsigned char filter);
   void setOversamplingP(unsigned char oversampling_p);
   void setOversamplingT(unsigned char oversampling_t);
-
+  // all settings in one write burst, unchanged settings are not written
+  uint8_t configure(uint8_t power_mode, uint8_t oversampling_p, uint8_t oversampling_t, uint8_t filter);
+
+  // forced mode: one conversion with the configured oversampling,
+  // afterwards the sensor sleeps until the next startForced()
+  uint8_t startForced();
+  // true when the conversion time of the forced conversion
+  // (or of the first conversion after configure()) is over
+  bool ready();
+  // true if the status register reports no running conversion
+  bool conversionDone();
+  // maximum time of one conversion in microseconds
+  uint32_t conversionTime();
+  static uint32_t conversionTime(uint8_t oversampling_p, uint8_t oversampling_t);
+
+  // 1 on success, 0 on an I2C error (see lastError())
   uint8_t writeReg(uint8_t slave, uint8_t reg_add,uint8_t reg_dat);
   uint8_t readData(uint16_t slave, uint8_t reg_add, unsigned char* Read, uint8_t num);
 };
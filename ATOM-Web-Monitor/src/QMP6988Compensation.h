@@ -0,0 +1,260 @@
+#ifndef __QMP6988_COMPENSATION_H
+#define __QMP6988_COMPENSATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// compensation of the raw QMP6988 ADC words with the OTP calibration data,
+// qmp6988_bench compares the implementations, raw_capture runs them offline
+//
+// two implementations with the same interface:
+//   QMP6988IntegerCompensation  64 bit fixed point chain of the QST driver
+//   QMP6988FloatCompensation    single precision (FPU of the ESP32),
+//                               the formulas of the datasheet
+// the firmware uses the one selected by QMP6988_FLOAT_COMPENSATION (QMP6988.h)
+//
+// for logged raw words there are batch functions over arrays
+// (structure of arrays: one array per raw word and per result)
+
+// the arrays of a batch do not overlap
+#define QMP6988_RESTRICT __restrict
+
+#define QMP6988_U16_t unsigned short
+#define QMP6988_S16_t short
+#define QMP6988_U32_t unsigned int
+#define QMP6988_S32_t int
+#define QMP6988_U64_t unsigned long long
+#define QMP6988_S64_t long long
+
+#define QMP6988_CALIBRATION_DATA_LENGTH		25
+
+// the raw ADC words are offset binary
+#define SUBTRACTOR 8388608
+
+typedef struct _qmp6988_cali_data {
+  QMP6988_S32_t COE_a0;
+  QMP6988_S16_t COE_a1;
+  QMP6988_S16_t COE_a2;
+  QMP6988_S32_t COE_b00;
+  QMP6988_S16_t COE_bt1;
+  QMP6988_S16_t COE_bt2;
+  QMP6988_S16_t COE_bp1;
+  QMP6988_S16_t COE_b11;
+  QMP6988_S16_t COE_bp2;
+  QMP6988_S16_t COE_b12;
+  QMP6988_S16_t COE_b21;
+  QMP6988_S16_t COE_bp3;
+} qmp6988_cali_data_t;
+
+typedef struct _qmp6988_fk_data {
+  float a0, b00;
+  float a1, a2, bt1, bt2, bp1, b11, bp2, b12, b21, bp3;
+} qmp6988_fk_data_t;
+
+typedef struct _qmp6988_ik_data {
+  QMP6988_S32_t a0, b00;
+  QMP6988_S32_t a1, a2;
+  QMP6988_S64_t bt1, bt2, bp1, b11, bp2, b12, b21, bp3;
+} qmp6988_ik_data_t;
+
+// coefficients from the 25 bytes of the OTP (0xA0 ... 0xB8)
+static inline void qmp6988_cali_decode(const uint8_t* otp, qmp6988_cali_data_t* cali)
+{
+  // a0 and b00 are 20 bit signed, the low nibbles are in byte 24
+  cali->COE_a0 = (QMP6988_S32_t)(((otp[18] << 12) | (otp[19] << 4) | (otp[24] & 0x0f)) << 12);
+  cali->COE_a0 = cali->COE_a0 >> 12;
+  cali->COE_a1 = (QMP6988_S16_t)((otp[20] << 8) | otp[21]);
+  cali->COE_a2 = (QMP6988_S16_t)((otp[22] << 8) | otp[23]);
+  cali->COE_b00 = (QMP6988_S32_t)(((otp[0] << 12) | (otp[1] << 4) | ((otp[24] & 0xf0) >> 4)) << 12);
+  cali->COE_b00 = cali->COE_b00 >> 12;
+  cali->COE_bt1 = (QMP6988_S16_t)((otp[2] << 8) | otp[3]);
+  cali->COE_bt2 = (QMP6988_S16_t)((otp[4] << 8) | otp[5]);
+  cali->COE_bp1 = (QMP6988_S16_t)((otp[6] << 8) | otp[7]);
+  cali->COE_b11 = (QMP6988_S16_t)((otp[8] << 8) | otp[9]);
+  cali->COE_bp2 = (QMP6988_S16_t)((otp[10] << 8) | otp[11]);
+  cali->COE_b12 = (QMP6988_S16_t)((otp[12] << 8) | otp[13]);
+  cali->COE_b21 = (QMP6988_S16_t)((otp[14] << 8) | otp[15]);
+  cali->COE_bp3 = (QMP6988_S16_t)((otp[16] << 8) | otp[17]);
+}
+
+// fixed point coefficients, the comments give bits and Q format
+static inline void qmp6988_ik_init(const qmp6988_cali_data_t* cali, qmp6988_ik_data_t* ik)
+{
+  ik->a0 = cali->COE_a0; // 20Q4
+  ik->b00 = cali->COE_b00; // 20Q4
+
+  ik->a1 = 3608L * (QMP6988_S32_t)cali->COE_a1 - 1731677965L; // 31Q23
+  ik->a2 = 16889L * (QMP6988_S32_t)cali->COE_a2 - 87619360L; // 30Q47
+
+  ik->bt1 = 2982L * (QMP6988_S64_t)cali->COE_bt1 + 107370906L; // 28Q15
+  ik->bt2 = 329854L * (QMP6988_S64_t)cali->COE_bt2 + 108083093L; // 34Q38
+  ik->bp1 = 19923L * (QMP6988_S64_t)cali->COE_bp1 + 1133836764L; // 31Q20
+  ik->b11 = 2406L * (QMP6988_S64_t)cali->COE_b11 + 118215883L; // 28Q34
+  ik->bp2 = 3079L * (QMP6988_S64_t)cali->COE_bp2 - 181579595L; // 29Q43
+  ik->b12 = 6846L * (QMP6988_S64_t)cali->COE_b12 + 85590281L; // 29Q53
+  ik->b21 = 13836L * (QMP6988_S64_t)cali->COE_b21 + 79333336L; // 29Q60
+  ik->bp3 = 2915L * (QMP6988_S64_t)cali->COE_bp3 + 157155561L; // 28Q65
+}
+
+// temperature in 1/256 degC from the raw word minus SUBTRACTOR
+static inline QMP6988_S16_t qmp6988_ik_temperature(const qmp6988_ik_data_t* ik, QMP6988_S32_t dt)
+{
+  QMP6988_S16_t ret;
+  QMP6988_S64_t wk1, wk2;
+
+  // wk1: 60Q4 // bit size
+  wk1 = ((QMP6988_S64_t)ik->a1 * (QMP6988_S64_t)dt); // 31Q23+24-1=54 (54Q23)
+  wk2 = ((QMP6988_S64_t)ik->a2 * (QMP6988_S64_t)dt) >> 14; // 30Q47+24-1=53 (39Q33)
+  wk2 = (wk2 * (QMP6988_S64_t)dt) >> 10; // 39Q33+24-1=62 (52Q23)
+  wk2 = ((wk1 + wk2) / 32767) >> 19; // 54,52->55Q23 (20Q04)
+  ret = (QMP6988_S16_t)((ik->a0 + wk2) >> 4); // 21Q4 -> 17Q0
+  return ret;
+}
+
+// pressure in 1/16 Pa from the raw word minus SUBTRACTOR
+// and the temperature in 1/256 degC
+static inline QMP6988_S32_t qmp6988_ik_pressure(const qmp6988_ik_data_t* ik, QMP6988_S32_t dp, QMP6988_S16_t tx)
+{
+  QMP6988_S32_t ret;
+  QMP6988_S64_t wk1, wk2, wk3;
+
+  // wk1 = 48Q16 // bit size
+  wk1 = ((QMP6988_S64_t)ik->bt1 * (QMP6988_S64_t)tx); // 28Q15+16-1=43 (43Q15)
+  wk2 = ((QMP6988_S64_t)ik->bp1 * (QMP6988_S64_t)dp) >> 5; // 31Q20+24-1=54 (49Q15)
+  wk1 += wk2; // 43,49->50Q15
+  wk2 = ((QMP6988_S64_t)ik->bt2 * (QMP6988_S64_t)tx) >> 1; // 34Q38+16-1=49 (48Q37)
+  wk2 = (wk2 * (QMP6988_S64_t)tx) >> 8; // 48Q37+16-1=63 (55Q29)
+  wk3 = wk2; // 55Q29
+  wk2 = ((QMP6988_S64_t)ik->b11 * (QMP6988_S64_t)tx) >> 4; // 28Q34+16-1=43 (39Q30)
+  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q30+24-1=62 (61Q29)
+  wk3 += wk2; // 55,61->62Q29
+  wk2 = ((QMP6988_S64_t)ik->bp2 * (QMP6988_S64_t)dp) >> 13; // 29Q43+24-1=52 (39Q30)
+  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q30+24-1=62 (61Q29)
+  wk3 += wk2; // 62,61->63Q29
+  wk1 += wk3 >> 14; // Q29 >> 14 -> Q15
+  wk2 = ((QMP6988_S64_t)ik->b12 * (QMP6988_S64_t)tx); // 29Q53+16-1=45 (45Q53)
+  wk2 = (wk2 * (QMP6988_S64_t)tx) >> 22; // 45Q53+16-1=61 (39Q31)
+  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q31+24-1=62 (61Q30)
+  wk3 = wk2; // 61Q30
+  wk2 = ((QMP6988_S64_t)ik->b21 * (QMP6988_S64_t)tx) >> 6; // 29Q60+16-1=45 (39Q54)
+  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 23; // 39Q54+24-1=62 (39Q31)
+  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 1; // 39Q31+24-1=62 (61Q20)
+  wk3 += wk2; // 61,61->62Q30
+  wk2 = ((QMP6988_S64_t)ik->bp3 * (QMP6988_S64_t)dp) >> 12; // 28Q65+24-1=51 (39Q53)
+  wk2 = (wk2 * (QMP6988_S64_t)dp) >> 23; // 39Q53+24-1=62 (39Q30)
+  wk2 = (wk2 * (QMP6988_S64_t)dp); // 39Q30+24-1=62 (62Q30)
+  wk3 += wk2; // 62,62->63Q30
+  wk1 += wk3 >> 15; // Q30 >> 15 = Q15
+  wk1 /= 32767L;
+  wk1 >>= 11; // Q15 >> 7 = Q4
+  wk1 += ik->b00; // Q4 + 20Q4
+  //wk1 >>= 4; // 28Q4 -> 24Q0
+  ret = (QMP6988_S32_t)wk1;
+  return ret;
+}
+
+// conversion factors of the datasheet: k = A + S * OTP / 32767
+static inline void qmp6988_fk_init(const qmp6988_cali_data_t* cali, qmp6988_fk_data_t* fk)
+{
+  fk->a0 = cali->COE_a0 / 16.0f;
+  fk->b00 = cali->COE_b00 / 16.0f;
+
+  fk->a1 = -6.30E-03f + 4.30E-04f * cali->COE_a1 / 32767.0f;
+  fk->a2 = -1.90E-11f + 1.20E-10f * cali->COE_a2 / 32767.0f;
+
+  fk->bt1 = 1.00E-01f + 9.10E-02f * cali->COE_bt1 / 32767.0f;
+  fk->bt2 = 1.20E-08f + 1.20E-06f * cali->COE_bt2 / 32767.0f;
+  fk->bp1 = 3.30E-02f + 1.90E-02f * cali->COE_bp1 / 32767.0f;
+  fk->b11 = 2.10E-07f + 1.40E-07f * cali->COE_b11 / 32767.0f;
+  fk->bp2 = -6.30E-10f + 3.50E-10f * cali->COE_bp2 / 32767.0f;
+  fk->b12 = 2.90E-13f + 7.60E-13f * cali->COE_b12 / 32767.0f;
+  fk->b21 = 2.10E-15f + 1.20E-14f * cali->COE_b21 / 32767.0f;
+  fk->bp3 = 1.30E-16f + 7.90E-17f * cali->COE_bp3 / 32767.0f;
+}
+
+// temperature in 1/256 degC: Tr = a0 + a1 Dt + a2 Dt^2
+static inline float qmp6988_fk_temperature(const qmp6988_fk_data_t* fk, float dt)
+{
+  return fk->a0 + dt * (fk->a1 + fk->a2 * dt);
+}
+
+// pressure in Pa:
+// Pr = b00 + bt1 Tr + bp1 Dp + b11 Tr Dp + bt2 Tr^2 + bp2 Dp^2
+//    + b12 Dp Tr^2 + b21 Dp^2 Tr + bp3 Dp^3
+static inline float qmp6988_fk_pressure(const qmp6988_fk_data_t* fk, float dp, float tr)
+{
+  return fk->b00 + tr * (fk->bt1 + fk->bt2 * tr) +
+         dp * (fk->bp1 + tr * (fk->b11 + fk->b12 * tr) +
+               dp * (fk->bp2 + fk->b21 * tr + fk->bp3 * dp));
+}
+
+// the compensation policies: raw ADC words to degC and Pa
+struct QMP6988IntegerCompensation {
+  typedef qmp6988_ik_data_t coefficients_t;
+  static const char* name() { return "integer"; }
+  static void init(const qmp6988_cali_data_t* cali, coefficients_t* k)
+  {
+    qmp6988_ik_init(cali, k);
+  }
+  static void compensate(const coefficients_t* k, uint32_t p_read, uint32_t t_read,
+                         float* temperature, float* pressure)
+  {
+    QMP6988_S16_t t = qmp6988_ik_temperature(k, (QMP6988_S32_t)(t_read - SUBTRACTOR));
+    QMP6988_S32_t p = qmp6988_ik_pressure(k, (QMP6988_S32_t)(p_read - SUBTRACTOR), t);
+    *temperature = (float)t / 256.0f;
+    *pressure = (float)p / 16.0f;
+  }
+};
+
+struct QMP6988FloatCompensation {
+  typedef qmp6988_fk_data_t coefficients_t;
+  static const char* name() { return "float"; }
+  static void init(const qmp6988_cali_data_t* cali, coefficients_t* k)
+  {
+    qmp6988_fk_init(cali, k);
+  }
+  static void compensate(const coefficients_t* k, uint32_t p_read, uint32_t t_read,
+                         float* temperature, float* pressure)
+  {
+    float t = qmp6988_fk_temperature(k, (float)(QMP6988_S32_t)(t_read - SUBTRACTOR));
+    *pressure = qmp6988_fk_pressure(k, (float)(QMP6988_S32_t)(p_read - SUBTRACTOR), t);
+    *temperature = t / 256.0f;
+  }
+};
+
+// batch reference: one call of the policy per sample
+template <class C>
+static inline void qmp6988_compensate_batch_ref(const typename C::coefficients_t* k,
+                                                const uint32_t* p_read, const uint32_t* t_read,
+                                                float* pressure, float* temperature, size_t n)
+{
+  for(size_t i = 0; i < n; i++)
+    C::compensate(k, p_read[i], t_read[i], &temperature[i], &pressure[i]);
+}
+
+// batch of the float path written for auto-vectorization: the coefficients
+// are kept in locals, the loop body has no calls and no branches and the
+// arrays are restrict; the results are the same as of the reference
+// (the operations and their order are the same)
+static inline void qmp6988_fk_compensate_batch(const qmp6988_fk_data_t* fk,
+                                               const uint32_t* QMP6988_RESTRICT p_read,
+                                               const uint32_t* QMP6988_RESTRICT t_read,
+                                               float* QMP6988_RESTRICT pressure,
+                                               float* QMP6988_RESTRICT temperature, size_t n)
+{
+  const float a0 = fk->a0, a1 = fk->a1, a2 = fk->a2;
+  const float b00 = fk->b00, bt1 = fk->bt1, bt2 = fk->bt2, bp1 = fk->bp1, b11 = fk->b11;
+  const float bp2 = fk->bp2, b12 = fk->b12, b21 = fk->b21, bp3 = fk->bp3;
+
+  for(size_t i = 0; i < n; i++){
+    float dt = (float)(QMP6988_S32_t)(t_read[i] - SUBTRACTOR);
+    float dp = (float)(QMP6988_S32_t)(p_read[i] - SUBTRACTOR);
+    float tr = a0 + dt * (a1 + a2 * dt);
+    pressure[i] = b00 + tr * (bt1 + bt2 * tr) +
+                  dp * (bp1 + tr * (b11 + b12 * tr) +
+                        dp * (bp2 + b21 * tr + bp3 * dp));
+    temperature[i] = tr / 256.0f;
+  }
+}
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef __RAW_STREAM_H
+#define __RAW_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LittleEndian.h"
+
+// binary stream of the raw sensor words over the serial port
+// Every packet is protected by a CRC-16/CCITT (poly 0x1021, init
+// 0xFFFF, big endian at the end of the packet) and framed with
+// COBS, so a 0x00 byte only appears as frame delimiter and the
+// receiver can resynchronize at any point of the stream.
+//
+// packet header (little endian, all packets):
+//   uint8  type      RAW_PACKET_xxx
+//   uint8  flags     RAW_FLAG_xxx
+//   uint16 seq       running packet number (all types), gaps = lost packets
+//   uint32 time_us   micros() of the device
+// RAW_PACKET_SAMPLE:
+//   uint16 SHT30 temperature word
+//   uint16 SHT30 humidity word
+//   uint24 QMP6988 pressure ADC word
+//   uint24 QMP6988 temperature ADC word
+// RAW_PACKET_INFO (at the start and then every RAW_INFO_INTERVAL packets):
+//   uint32 baud rate
+//   uint8  QMP6988 oversampling P, oversampling T, filter (register codes)
+//   uint8  reserved
+//   uint8  QMP6988 calibration data (OTP 0xA0..0xB8, 25 bytes)
+// raw_capture decodes the frames on the PC
+
+#define RAW_STREAM_DEFAULT_BAUD  921600
+#define RAW_INFO_INTERVAL        1000
+
+#define RAW_PACKET_SAMPLE  1
+#define RAW_PACKET_INFO    2
+
+#define RAW_FLAG_SHT30     0x01  // SHT30 words are valid
+#define RAW_FLAG_QMP6988   0x02  // QMP6988 words are valid
+
+#define RAW_HEADER_SIZE    8
+#define RAW_SAMPLE_SIZE    (RAW_HEADER_SIZE + 10)
+#define RAW_CALI_SIZE      25
+#define RAW_INFO_SIZE      (RAW_HEADER_SIZE + 8 + RAW_CALI_SIZE)
+#define RAW_CRC_SIZE       2
+#define RAW_MAX_PACKET     (RAW_INFO_SIZE + RAW_CRC_SIZE)
+// COBS adds one byte per 254 bytes (plus one) and the delimiter
+#define RAW_MAX_FRAME      (RAW_MAX_PACKET + RAW_MAX_PACKET / 254 + 2)
+
+typedef struct _raw_sample {
+  uint8_t flags;
+  uint16_t seq;
+  uint32_t time_us;
+  uint16_t sht30_temperature;
+  uint16_t sht30_humidity;
+  uint32_t qmp6988_pressure;
+  uint32_t qmp6988_temperature;
+} raw_sample_t;
+
+typedef struct _raw_info {
+  uint16_t seq;
+  uint32_t time_us;
+  uint32_t baud;
+  uint8_t oversampling_p;
+  uint8_t oversampling_t;
+  uint8_t filter;
+  uint8_t calibration[RAW_CALI_SIZE];
+} raw_info_t;
+
+static inline uint16_t raw_crc16(const uint8_t* data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  for(size_t i = 0; i < len; i++){
+    crc ^= (uint16_t)data[i] << 8;
+    for(int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// COBS encoding incl. the 0x00 delimiter, returns the frame length
+static inline size_t raw_cobs_encode(const uint8_t* data, size_t len, uint8_t* frame)
+{
+  size_t code_pos = 0, out = 1;
+  uint8_t code = 1;
+  for(size_t i = 0; i < len; i++){
+    if(data[i] == 0){
+      frame[code_pos] = code;
+      code_pos = out++;
+      code = 1;
+    } else {
+      frame[out++] = data[i];
+      if(++code == 0xFF){
+        frame[code_pos] = code;
+        code_pos = out++;
+        code = 1;
+      }
+    }
+  }
+  frame[code_pos] = code;
+  frame[out++] = 0;
+  return out;
+}
+
+// decode a frame without its delimiter, returns 0 if it is invalid
+static inline size_t raw_cobs_decode(const uint8_t* frame, size_t len, uint8_t* data, size_t size)
+{
+  size_t in = 0, out = 0;
+  while(in < len){
+    uint8_t code = frame[in++];
+    if(code == 0 || in + code - 1 > len)
+      return 0;
+    for(uint8_t i = 1; i < code; i++){
+      if(out >= size)
+        return 0;
+      data[out++] = frame[in++];
+    }
+    if(code < 0xFF && in < len){
+      if(out >= size)
+        return 0;
+      data[out++] = 0;
+    }
+  }
+  return out;
+}
+
+static inline void raw_put_header(uint8_t* buf, uint8_t type, uint8_t flags, uint16_t seq, uint32_t time_us)
+{
+  buf[0] = type;
+  buf[1] = flags;
+  le_put_u16(&buf[2], seq);
+  le_put_u32(&buf[4], time_us);
+}
+
+static inline size_t raw_put_crc(uint8_t* packet, size_t len)
+{
+  uint16_t crc = raw_crc16(packet, len);
+  packet[len] = crc >> 8;
+  packet[len + 1] = crc & 0xff;
+  return len + RAW_CRC_SIZE;
+}
+
+// frame needs RAW_MAX_FRAME bytes, returns the frame length
+static inline size_t raw_frame_sample(const raw_sample_t* sample, uint8_t* frame)
+{
+  uint8_t packet[RAW_MAX_PACKET];
+  raw_put_header(packet, RAW_PACKET_SAMPLE, sample->flags, sample->seq, sample->time_us);
+  uint8_t* p = &packet[RAW_HEADER_SIZE];
+  le_put_u16(&p[0], sample->sht30_temperature);
+  le_put_u16(&p[2], sample->sht30_humidity);
+  for(int i = 0; i < 3; i++){
+    p[4 + i] = (sample->qmp6988_pressure >> (8 * i)) & 0xff;
+    p[7 + i] = (sample->qmp6988_temperature >> (8 * i)) & 0xff;
+  }
+  return raw_cobs_encode(packet, raw_put_crc(packet, RAW_SAMPLE_SIZE), frame);
+}
+
+static inline size_t raw_frame_info(const raw_info_t* info, uint8_t* frame)
+{
+  uint8_t packet[RAW_MAX_PACKET];
+  raw_put_header(packet, RAW_PACKET_INFO, 0, info->seq, info->time_us);
+  uint8_t* p = &packet[RAW_HEADER_SIZE];
+  le_put_u32(&p[0], info->baud);
+  p[4] = info->oversampling_p;
+  p[5] = info->oversampling_t;
+  p[6] = info->filter;
+  p[7] = 0;
+  for(int i = 0; i < RAW_CALI_SIZE; i++)
+    p[8 + i] = info->calibration[i];
+  return raw_cobs_encode(packet, raw_put_crc(packet, RAW_INFO_SIZE), frame);
+}
+
+// check a decoded packet, returns its type or 0 if the CRC or length is wrong
+static inline uint8_t raw_packet_type(const uint8_t* packet, size_t len)
+{
+  if(len < RAW_HEADER_SIZE + RAW_CRC_SIZE)
+    return 0;
+  uint16_t crc = raw_crc16(packet, len - RAW_CRC_SIZE);
+  if(packet[len - 2] != (crc >> 8) || packet[len - 1] != (crc & 0xff))
+    return 0;
+  if(packet[0] == RAW_PACKET_SAMPLE && len == RAW_SAMPLE_SIZE + RAW_CRC_SIZE)
+    return RAW_PACKET_SAMPLE;
+  if(packet[0] == RAW_PACKET_INFO && len == RAW_INFO_SIZE + RAW_CRC_SIZE)
+    return RAW_PACKET_INFO;
+  return 0;
+}
+
+static inline uint16_t raw_packet_seq(const uint8_t* packet)
+{
+  return le_get_u16(&packet[2]);
+}
+
+static inline uint32_t raw_packet_time(const uint8_t* packet)
+{
+  return le_get_u32(&packet[4]);
+}
+
+static inline void raw_parse_sample(const uint8_t* packet, raw_sample_t* sample)
+{
+  const uint8_t* p = &packet[RAW_HEADER_SIZE];
+  sample->flags = packet[1];
+  sample->seq = raw_packet_seq(packet);
+  sample->time_us = raw_packet_time(packet);
+  sample->sht30_temperature = le_get_u16(&p[0]);
+  sample->sht30_humidity = le_get_u16(&p[2]);
+  sample->qmp6988_pressure = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16);
+  sample->qmp6988_temperature = (uint32_t)p[7] | ((uint32_t)p[8] << 8) | ((uint32_t)p[9] << 16);
+}
+
+static inline void raw_parse_info(const uint8_t* packet, raw_info_t* info)
+{
+  const uint8_t* p = &packet[RAW_HEADER_SIZE];
+  info->seq = raw_packet_seq(packet);
+  info->time_us = raw_packet_time(packet);
+  info->baud = le_get_u32(&p[0]);
+  info->oversampling_p = p[4];
+  info->oversampling_t = p[5];
+  info->filter = p[6];
+  for(int i = 0; i < RAW_CALI_SIZE; i++)
+    info->calibration[i] = p[8 + i];
+}
+
+#endif
@@ -1,49 +1,233 @@
 #include "SHT3X.h"
 
-/* Motor()
+// single shot commands without clock stretching (datasheet table 9)
+// and the maximum conversion times (datasheet table 4, low VDD)
+static const uint8_t single_shot_lsb[3] = { 0x00, 0x0B, 0x16 };
+static const uint32_t conversion_us[3] = { 15500, 6500, 4500 };
 
-*/
-SHT3X::SHT3X(uint8_t address)
+// periodic commands (datasheet table 10) per mode and repeatability
+static const uint8_t periodic_cmd[5][4] = {
+  // msb, high, medium, low
+  { 0x20, 0x32, 0x24, 0x2F },  // 0.5 mps
+  { 0x21, 0x30, 0x26, 0x2D },  // 1 mps
+  { 0x22, 0x36, 0x20, 0x2B },  // 2 mps
+  { 0x23, 0x34, 0x22, 0x29 },  // 4 mps
+  { 0x27, 0x37, 0x21, 0x2A }   // 10 mps
+};
+static const uint32_t period_us[7] = { 0, 2000000, 1000000, 500000, 250000, 100000, 250000 };
+
+// the bus is started by the application (Wire.begin() with the pins)
+SHT3X::SHT3X(uint8_t address, I2CBus* bus)
 {
-  Wire.begin();
+  _bus=bus;
   _address=address;
 }
 
+uint32_t SHT3X::conversionTime(uint8_t repeatability)
+{
+  if (repeatability > SHT3X_REPEATABILITY_LOW)
+    repeatability = SHT3X_REPEATABILITY_HIGH;
+  return conversion_us[repeatability];
+}
 
+uint32_t SHT3X::period(uint8_t mode)
+{
+  if (mode > SHT3X_MODE_ART)
+    return 0;
+  return period_us[mode];
+}
 
-byte SHT3X::get()
+// CRC-8 of the sensor: polynomial 0x31, init 0xFF
+static uint8_t sht3x_crc(const uint8_t* data)
 {
-  unsigned int data[6];
+  uint8_t crc = 0xFF;
+  for (int i=0;i<2;i++) {
+    crc ^= data[i];
+    for (int bit=0;bit<8;bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+  }
+  return crc;
+}
 
-  // Start I2C Transmission
-  Wire.beginTransmission(_address);
+byte SHT3X::command(uint8_t msb, uint8_t lsb)
+{
+  uint8_t cmd[2] = { msb, lsb };
+  if (_bus->write(_address, cmd, 2) != I2C_OK)
+    return 1;
+  return 0;
+}
+
+byte SHT3X::start(uint8_t repeatability)
+{
+  if (repeatability > SHT3X_REPEATABILITY_LOW)
+    repeatability = SHT3X_REPEATABILITY_HIGH;
+  _started = false;
+  // the sensor ignores single shot commands in the periodic mode
+  if (_mode != SHT3X_MODE_SINGLE_SHOT && stop() != 0)
+    return 1;
   // Send measurement command
-  Wire.write(0x2C);
-  Wire.write(0x06);
-  // Stop I2C transmission
-  if (Wire.endTransmission()!=0) 
-    return 1;  
+  if (command(0x24, single_shot_lsb[repeatability]) != 0)
+    return 1;
 
-  delay(200);
+  _started = true;
+  _start_us = _bus->micros();
+  _conversion_us = conversion_us[repeatability];
+  return 0;
+}
 
-  // Request 6 bytes of data
-  Wire.requestFrom(_address, 6);
+byte SHT3X::startPeriodic(uint8_t mode, uint8_t repeatability)
+{
+  if (mode == SHT3X_MODE_SINGLE_SHOT || mode > SHT3X_MODE_ART)
+    return stop();
+  if (repeatability > SHT3X_REPEATABILITY_LOW)
+    repeatability = SHT3X_REPEATABILITY_HIGH;
+  _started = false;
+  // a new periodic command needs a break first
+  if (_mode != SHT3X_MODE_SINGLE_SHOT && stop() != 0)
+    return 1;
+  byte ret;
+  if (mode == SHT3X_MODE_ART)
+    ret = command(0x2B, 0x32);
+  else
+    ret = command(periodic_cmd[mode - SHT3X_MODE_0_5_MPS][0], periodic_cmd[mode - SHT3X_MODE_0_5_MPS][1 + repeatability]);
+  if (ret != 0)
+    return 1;
 
-  // Read 6 bytes of data
-  // cTemp msb, cTemp lsb, cTemp crc, humidity msb, humidity lsb, humidity crc
-  for (int i=0;i<6;i++) {
-    data[i]=Wire.read();
-  };
-  
-  delay(50);
-  
-  if (Wire.available()!=0) 
-    return 2;
-
-  // Convert the data
-  cTemp = ((((data[0] * 256.0) + data[1]) * 175) / 65535.0) - 45;
-  fTemp = (cTemp * 1.8) + 32;
-  humidity = ((((data[3] * 256.0) + data[4]) * 100) / 65535.0);
+  _mode = mode;
+  _started = true;
+  // the first result is there after one conversion
+  _start_us = _bus->micros() + conversion_us[repeatability];
+  _conversion_us = period_us[mode];
+  return 0;
+}
+
+byte SHT3X::stop()
+{
+  _started = false;
+  if (_mode == SHT3X_MODE_SINGLE_SHOT)
+    return 0;
+  // break: the sensor needs 1 ms to return to single shot
+  if (command(0x30, 0x93) != 0)
+    return 1;
+  _mode = SHT3X_MODE_SINGLE_SHOT;
+  _bus->delay(1);
+  return 0;
+}
+
+byte SHT3X::reset()
+{
+  // complete a submitted read first
+  _bus->flush();
+  _started = false;
+  // the sensor may still be in a periodic mode that
+  // was started before, the result of the break is of no use
+  command(0x30, 0x93);
+  _mode = SHT3X_MODE_SINGLE_SHOT;
+  _bus->delay(1);
+  if (command(0x30, 0xA2) != 0)
+    return 1;
+  // the soft reset takes up to 1.5 ms
+  _bus->delay(2);
+  return 0;
+}
+
+bool SHT3X::poll()
+{
+  if (!_started || _reading)
+    return false;
+  if (_mode != SHT3X_MODE_SINGLE_SHOT)
+    return (int32_t)(_bus->micros() - _start_us) >= 0;
+  return (uint32_t)(_bus->micros() - _start_us) >= _conversion_us;
+}
+
+static void store_result(void* context, byte result)
+{
+  *(byte*)context = result;
+}
 
+byte SHT3X::read()
+{
+  byte ret = 1;
+
+  if (requestRead(store_result, &ret) != 0)
+    return 1;
+  _bus->flush();
+  return ret;
+}
+
+byte SHT3X::requestRead(sht3x_done_t done, void* context)
+{
+  if (!_started || _reading)
+    return 1;
+  _fetch_failed = false;
+  if (_mode == SHT3X_MODE_SINGLE_SHOT) {
+    _started = false;
+  } else {
+    uint32_t now = _bus->micros();
+    // the next result is due one period later, a late
+    // fetch takes the schedule along to stay in step
+    _start_us += _conversion_us;
+    if ((int32_t)(now - _start_us) >= 0)
+      _start_us = now + _conversion_us;
+    // fetch data
+    static const uint8_t fetch[2] = { 0xE0, 0x00 };
+    if (!_bus->submitWrite(_address, fetch, 2, onFetch, this))
+      return 1;
+  }
+  _reading = true;
+  _done = done;
+  _done_context = context;
+  // cTemp msb, cTemp lsb, cTemp crc, humidity msb, humidity lsb, humidity crc
+  // (the sensor does not acknowledge the read during the
+  // conversion or if there is no new periodic result)
+  if (!_bus->submitRead(_address, _data, 6, onResult, this)) {
+    _reading = false;
+    return 1;
+  }
   return 0;
 }
+
+void SHT3X::onFetch(void* context, uint8_t result, const uint8_t* /* data */, size_t /* len */)
+{
+  SHT3X* sht = (SHT3X*)context;
+  if (result != I2C_OK)
+    sht->_fetch_failed = true;
+}
+
+void SHT3X::onResult(void* context, uint8_t result, const uint8_t* data, size_t /* len */)
+{
+  SHT3X* sht = (SHT3X*)context;
+  byte ret = 0;
+
+  sht->_reading = false;
+  if (sht->_fetch_failed) {
+    ret = 1;
+  } else if (result != I2C_OK) {
+    // the result of the sensor clock is a little late
+    if (sht->_mode != SHT3X_MODE_SINGLE_SHOT)
+      sht->_start_us = sht->_bus->micros() + SHT3X_FETCH_RETRY_US;
+    ret = SHT3X_NO_DATA;
+  } else if (sht3x_crc(&data[0]) != data[2] || sht3x_crc(&data[3]) != data[5]) {
+    ret = 3;
+  } else {
+    sht->rawTemperature = (data[0] << 8) | data[1];
+    sht->rawHumidity = (data[3] << 8) | data[4];
+
+    // Convert the data
+    sht->cTemp = ((((data[0] * 256.0) + data[1]) * 175) / 65535.0) - 45;
+    sht->fTemp = (sht->cTemp * 1.8) + 32;
+    sht->humidity = ((((data[3] * 256.0) + data[4]) * 100) / 65535.0);
+  }
+  if (sht->_done)
+    sht->_done(sht->_done_context, ret);
+}
+
+byte SHT3X::get()
+{
+  byte ret = start(SHT3X_REPEATABILITY_HIGH);
+  if (ret != 0)
+    return ret;
+  while (!poll())
+    _bus->delay(1);
+  return read();
+}
@@ -1,25 +1,103 @@
 #ifndef __SHT3X_H
-#define __HT3X_H
+#define __SHT3X_H
 
 
+#ifdef ARDUINO
 #if ARDUINO >= 100
  #include "Arduino.h"
 #else
  #include "WProgram.h"
 #endif
+#include "WireBus.h"
+#else
+// host tools: the bus is always given
+#include <stdint.h>
+typedef uint8_t byte;
+#endif
+
+#include "I2CBus.h"
+
+// repeatability of a measurement
+#define SHT3X_REPEATABILITY_HIGH   0
+#define SHT3X_REPEATABILITY_MEDIUM 1
+#define SHT3X_REPEATABILITY_LOW    2
 
-#include "Wire.h"
+// acquisition modes: single shot or periodic with
+// 0.5 ... 10 measurements per second or ART (4 per second)
+#define SHT3X_MODE_SINGLE_SHOT 0
+#define SHT3X_MODE_0_5_MPS     1
+#define SHT3X_MODE_1_MPS       2
+#define SHT3X_MODE_2_MPS       3
+#define SHT3X_MODE_4_MPS       4
+#define SHT3X_MODE_10_MPS      5
+#define SHT3X_MODE_ART         6
+
+// result of read() if the sensor has no (new) data,
+// in the periodic mode poll() retries after SHT3X_FETCH_RETRY_US
+#define SHT3X_NO_DATA      2
+#define SHT3X_FETCH_RETRY_US 1000
+
+// completion of requestRead() with the result code of read()
+typedef void (*sht3x_done_t)(void* context, byte result);
 
 class SHT3X{
 public:
-  SHT3X(uint8_t address=0x44);
+#ifdef ARDUINO
+  SHT3X(uint8_t address=0x44, I2CBus* bus=&wire_bus);
+#else
+  SHT3X(uint8_t address, I2CBus* bus);
+#endif
+  void setBus(I2CBus* bus) { _bus = bus; }
+  // blocking measurement: start(), wait for the conversion, read()
   byte get(void);
+  // start a single shot measurement and return at once
+  // (ends a running periodic mode)
+  byte start(uint8_t repeatability=SHT3X_REPEATABILITY_HIGH);
+  // start the periodic mode, the sensor measures on its own
+  byte startPeriodic(uint8_t mode, uint8_t repeatability=SHT3X_REPEATABILITY_HIGH);
+  // end the periodic mode (break command)
+  byte stop(void);
+  // break and soft reset, afterwards the sensor is idle
+  // in the single shot mode (after a bus recovery)
+  byte reset(void);
+  uint8_t mode(void) { return _mode; }
+  // single shot: true as soon as the conversion time is over
+  // periodic: true when the next result is due
+  bool poll(void);
+  // read the result of the single shot measurement
+  // or fetch the latest result of the periodic mode
+  byte read(void);
+  // the same submitted to the bus, done is called when the
+  // transfers are completed (at once if the bus has no queue)
+  byte requestRead(sht3x_done_t done, void* context);
+  // maximum conversion time of a repeatability in microseconds
+  static uint32_t conversionTime(uint8_t repeatability);
+  // interval of a periodic mode in microseconds
+  static uint32_t period(uint8_t mode);
   float cTemp=0;
   float fTemp=0;
   float humidity=0;
+  // raw words of the last measurement
+  uint16_t rawTemperature=0;
+  uint16_t rawHumidity=0;
 
 private:
+  byte command(uint8_t msb, uint8_t lsb);
+  static void onFetch(void* context, uint8_t result, const uint8_t* data, size_t len);
+  static void onResult(void* context, uint8_t result, const uint8_t* data, size_t len);
+  I2CBus* _bus;
   uint8_t _address;
+  uint8_t _mode=SHT3X_MODE_SINGLE_SHOT;
+  bool _started=false;
+  // single shot: start of the conversion, periodic: due time of the next result
+  uint32_t _start_us=0;
+  uint32_t _conversion_us=0;
+  // submitted read
+  bool _reading=false;
+  bool _fetch_failed=false;
+  uint8_t _data[6];
+  sht3x_done_t _done=NULL;
+  void* _done_context=NULL;
 
 };
 
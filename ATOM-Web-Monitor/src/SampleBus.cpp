@@ -0,0 +1,86 @@
+#include "SampleBus.h"
+
+static const char* bus_policy_names[] = {"drop_oldest", "drop_newest", "coalesce_latest"};
+
+const char* bus_policy_name(uint8_t policy)
+{
+  return policy <= BUS_COALESCE_LATEST ? bus_policy_names[policy] : "unknown";
+}
+
+SampleBus::SampleBus()
+{
+  pool_used = 0;
+  n_subscribers = 0;
+  published = 0;
+}
+
+int SampleBus::subscribe(const char* name, bus_handler_t handler, void* context, uint8_t depth, uint8_t policy)
+{
+  if(policy == BUS_COALESCE_LATEST || depth < 1)
+    depth = 1;
+  if(n_subscribers >= BUS_MAX_SUBSCRIBERS || pool_used + depth > BUS_POOL_LENGTH || policy > BUS_COALESCE_LATEST)
+    return -1;
+  bus_subscriber_t* sub = &subscribers[n_subscribers];
+  sub->name = name;
+  sub->handler = handler;
+  sub->context = context;
+  sub->policy = policy;
+  sub->depth = depth;
+  sub->head = 0;
+  sub->count = 0;
+  sub->queue = &pool[pool_used];
+  sub->stats.delivered = 0;
+  sub->stats.dropped = 0;
+  sub->stats.coalesced = 0;
+  sub->stats.refused = 0;
+  sub->stats.max_fill = 0;
+  pool_used += depth;
+  return n_subscribers++;
+}
+
+void SampleBus::publish(const env_sample_t* sample)
+{
+  published++;
+  for(uint8_t i = 0; i < n_subscribers; i++){
+    bus_subscriber_t* sub = &subscribers[i];
+    if(sub->count == sub->depth){
+      switch(sub->policy){
+        case BUS_DROP_NEWEST:
+          sub->stats.dropped++;
+          continue;
+        case BUS_COALESCE_LATEST:
+          sub->stats.coalesced++;
+          break;
+        default:
+          sub->stats.dropped++;
+          break;
+      }
+      // make room: the oldest sample is replaced
+      sub->head = (sub->head + 1) % sub->depth;
+      sub->count--;
+    }
+    sub->queue[(sub->head + sub->count) % sub->depth] = *sample;
+    sub->count++;
+    if(sub->count > sub->stats.max_fill)
+      sub->stats.max_fill = sub->count;
+  }
+}
+
+uint16_t SampleBus::dispatch()
+{
+  uint16_t delivered = 0;
+  for(uint8_t i = 0; i < n_subscribers; i++){
+    bus_subscriber_t* sub = &subscribers[i];
+    while(sub->count > 0){
+      if(!sub->handler(sub->context, &sub->queue[sub->head])){
+        sub->stats.refused++;
+        break;
+      }
+      sub->head = (sub->head + 1) % sub->depth;
+      sub->count--;
+      sub->stats.delivered++;
+      delivered++;
+    }
+  }
+  return delivered;
+}
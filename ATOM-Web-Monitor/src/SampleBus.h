@@ -0,0 +1,77 @@
+#ifndef __SAMPLE_BUS_H
+#define __SAMPLE_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "EnvSample.h"
+
+// fixed capacity publish/subscribe bus for the samples
+// publish() only copies the sample into the queue of every
+// subscriber, the handlers are called later by dispatch().
+// Every subscriber has its own queue depth and overflow policy,
+// so a slow sink neither delays the acquisition nor the others.
+
+#define BUS_MAX_SUBSCRIBERS  12
+// queue entries of all subscribers together
+#define BUS_POOL_LENGTH      64
+
+// overflow policies:
+// a full queue discards its oldest sample for the new one
+#define BUS_DROP_OLDEST      0
+// a full queue discards the new sample
+#define BUS_DROP_NEWEST      1
+// only the newest sample is kept (queue depth 1)
+#define BUS_COALESCE_LATEST  2
+
+// returns false if the sink can not take the sample now,
+// it stays in the queue and is offered again with the next dispatch()
+typedef bool (*bus_handler_t)(void* context, const env_sample_t* sample);
+
+typedef struct _bus_stats {
+  uint32_t delivered;
+  uint32_t dropped;     // discarded by the overflow policy
+  uint32_t coalesced;   // replaced by a newer sample
+  uint32_t refused;     // handler calls that returned false
+  uint8_t max_fill;     // highest queue fill level
+} bus_stats_t;
+
+typedef struct _bus_subscriber {
+  const char* name;
+  bus_handler_t handler;
+  void* context;
+  uint8_t policy;
+  uint8_t depth;
+  uint8_t head;
+  uint8_t count;
+  env_sample_t* queue;  // depth entries of the pool
+  bus_stats_t stats;
+} bus_subscriber_t;
+
+class SampleBus
+{
+private:
+  env_sample_t pool[BUS_POOL_LENGTH];
+  uint8_t pool_used;
+  bus_subscriber_t subscribers[BUS_MAX_SUBSCRIBERS];
+  uint8_t n_subscribers;
+
+public:
+  uint32_t published;
+
+  SampleBus();
+  // returns the subscriber number or -1 if the bus or the pool is full
+  int subscribe(const char* name, bus_handler_t handler, void* context, uint8_t depth, uint8_t policy);
+  // copy the sample into the queues, never calls a handler
+  void publish(const env_sample_t* sample);
+  // call the handlers with the queued samples, oldest first,
+  // until every queue is empty or its handler refuses a sample
+  // returns the number of delivered samples
+  uint16_t dispatch();
+
+  uint8_t size() { return n_subscribers; }
+  const bus_subscriber_t* subscriber(uint8_t index) { return &subscribers[index]; }
+};
+
+const char* bus_policy_name(uint8_t policy);
+
+#endif
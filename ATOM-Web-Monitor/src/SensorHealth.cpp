@@ -0,0 +1,92 @@
+#include <string.h>
+#include "SensorHealth.h"
+
+static const char* health_state_names[] = {"ok", "retry", "failed"};
+
+const char* health_state_name(uint8_t state)
+{
+  return state <= HEALTH_FAILED ? health_state_names[state] : "unknown";
+}
+
+SensorHealth::SensorHealth()
+{
+  health_config_t defaults = { 1, 3, 10000, 10000 };
+  begin(&defaults, 0);
+}
+
+void SensorHealth::begin(const health_config_t* config_in, uint32_t now_ms)
+{
+  config = *config_in;
+  state_ = HEALTH_OK;
+  failures = 0;
+  retries = 0;
+  pending = false;
+  has_value = false;
+  last_ok_ms = now_ms;
+  outage_start_ms = now_ms;
+  next_ms = now_ms;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void SensorHealth::success(uint32_t now_ms)
+{
+  stats.reads++;
+  if(failures > 0 && has_value){
+    stats.outage_ms = now_ms - outage_start_ms;
+    if(stats.outage_ms > stats.max_outage_ms)
+      stats.max_outage_ms = stats.outage_ms;
+  }
+  state_ = HEALTH_OK;
+  failures = 0;
+  pending = false;
+  has_value = true;
+  last_ok_ms = now_ms;
+}
+
+void SensorHealth::failure(uint32_t now_ms)
+{
+  stats.reads++;
+  stats.failures++;
+  if(failures == 0){
+    outage_start_ms = now_ms;
+    if(has_value)
+      stats.outages++;
+  }
+  if(failures < 255)
+    failures++;
+  if(state_ == HEALTH_FAILED)
+    return;
+  if(failures >= config.failures){
+    state_ = HEALTH_FAILED;
+    pending = false;
+    next_ms = now_ms + config.backoff_ms;
+    return;
+  }
+  // the first failure already recovers the bus
+  state_ = HEALTH_RETRY;
+  pending = retries < config.retries;
+}
+
+bool SensorHealth::needsRecovery(uint32_t now_ms)
+{
+  if(state_ == HEALTH_FAILED)
+    return (int32_t)(now_ms - next_ms) >= 0;
+  return pending;
+}
+
+void SensorHealth::recovered(bool ok, uint32_t now_ms)
+{
+  stats.recoveries++;
+  if(!ok)
+    stats.recovery_failures++;
+  pending = false;
+  if(retries < 255)
+    retries++;
+  if(state_ == HEALTH_FAILED)
+    next_ms = now_ms + config.backoff_ms;
+}
+
+bool SensorHealth::stale(uint32_t now_ms)
+{
+  return !has_value || now_ms - last_ok_ms > config.stale_ms;
+}
@@ -0,0 +1,84 @@
+#ifndef __SENSOR_HEALTH_H
+#define __SENSOR_HEALTH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// health of a sensor on the I2C bus, fed with the result of every read,
+// the time is passed in (the fault scenario of i2c_bench runs it on the
+// virtual clock of the mock)
+//
+// OK --failure--> RETRY: needsRecovery() asks at once for a bus
+//   recovery and a new init of the sensor, the read is repeated within
+//   the same sample (retries times per sample, see startSample())
+// RETRY --failures consecutive failed reads--> FAILED: the sensor is
+//   unhealthy, needsRecovery() asks for a new init every backoff_ms only
+// every state --success--> OK
+//
+// independent of the state a value is stale if the last good read is
+// older than stale_ms, the value should not be served any longer
+
+#define HEALTH_OK       0
+#define HEALTH_RETRY    1
+#define HEALTH_FAILED   2
+
+typedef struct _health_config {
+  uint8_t retries;      // recoveries and repeated reads per sample
+  uint8_t failures;     // consecutive failed reads before FAILED
+  uint32_t backoff_ms;  // interval of the attempts in FAILED
+  uint32_t stale_ms;    // age of the last good read of a stale value
+} health_config_t;
+
+typedef struct _health_stats {
+  uint32_t reads;
+  uint32_t failures;
+  uint32_t recoveries;  // recoveries and new inits that were run
+  uint32_t recovery_failures;   // ... of them that failed at once
+  uint32_t outages;     // failures after a good read
+  uint32_t outage_ms;   // first failure to the next good read, last outage
+  uint32_t max_outage_ms;
+} health_stats_t;
+
+class SensorHealth
+{
+private:
+  health_config_t config;
+  uint8_t state_;
+  uint8_t failures;     // consecutive failed reads
+  uint8_t retries;      // recoveries in the current sample
+  bool pending;         // recovery requested
+  bool has_value;
+  uint32_t last_ok_ms;
+  uint32_t outage_start_ms;
+  uint32_t next_ms;     // next attempt in FAILED
+
+public:
+  health_stats_t stats;
+
+  SensorHealth();
+  void begin(const health_config_t* config_in, uint32_t now_ms);
+  // the stale time follows the sample period
+  void setStaleTime(uint32_t stale_ms) { config.stale_ms = stale_ms; }
+
+  // a new sample starts, the retries are available again
+  void startSample() { retries = 0; }
+  // result of a read
+  void success(uint32_t now_ms);
+  void failure(uint32_t now_ms);
+  // true if the bus should be recovered and the sensor
+  // initialized again, recovered() reports the result
+  bool needsRecovery(uint32_t now_ms);
+  // ok: the bus is free and the init of the sensor succeeded,
+  // the read should be repeated, its result decides about the state
+  void recovered(bool ok, uint32_t now_ms);
+
+  uint8_t state() { return state_; }
+  uint8_t consecutiveFailures() { return failures; }
+  bool stale(uint32_t now_ms);
+  // time since the last good read (since begin() without one)
+  uint32_t age(uint32_t now_ms) { return now_ms - last_ok_ms; }
+};
+
+const char* health_state_name(uint8_t state);
+
+#endif
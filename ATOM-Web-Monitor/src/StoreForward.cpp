@@ -0,0 +1,189 @@
+#include <SPIFFS.h>
+#include "StoreForward.h"
+
+static void sf_pack(const env_sample_t* sample, uint8_t* buf)
+{
+  int16_t t = env_temperature_encode(sample->temperature);
+  uint16_t h = env_humidity_encode(sample->humidity);
+  uint32_t p = env_pressure_encode(sample->pressure);
+  memcpy(&buf[0], &sample->seq, 4);
+  memcpy(&buf[4], &sample->time_ms, 4);
+  memcpy(&buf[8], &t, 2);
+  memcpy(&buf[10], &h, 2);
+  memcpy(&buf[12], &p, 4);
+}
+
+static void sf_unpack(const uint8_t* buf, env_sample_t* sample)
+{
+  int16_t t;
+  uint16_t h;
+  uint32_t p;
+  memcpy(&sample->seq, &buf[0], 4);
+  memcpy(&sample->time_ms, &buf[4], 4);
+  memcpy(&t, &buf[8], 2);
+  memcpy(&h, &buf[10], 2);
+  memcpy(&p, &buf[12], 4);
+  sample->temperature = env_temperature_decode(t);
+  sample->humidity = env_humidity_decode(h);
+  sample->pressure = env_pressure_decode(p);
+}
+
+StoreForward::StoreForward()
+{
+  exporter = NULL;
+  flash_ok = false;
+  replay_batch = 32;
+  replay_interval_ms = 1000;
+  last_replay_ms = 0;
+  ram_head = 0;
+  ram_count = 0;
+  flash_head = 0;
+  flash_count = 0;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void StoreForward::begin(sf_export_t exporter_in, uint16_t replay_batch_in, uint32_t replay_interval_ms_in)
+{
+  exporter = exporter_in;
+  replay_batch = replay_batch_in;
+  replay_interval_ms = replay_interval_ms_in;
+  // an empty ring file (format the SPIFFS at the first start)
+  flash_ok = SPIFFS.begin(true);
+  if(flash_ok){
+    File file = SPIFFS.open(SF_FLASH_FILE, FILE_WRITE);
+    flash_ok = (bool)file;
+    file.close();
+  }
+  if(!flash_ok)
+    Serial.println("[ERR] store-and-forward: no flash queue");
+}
+
+void StoreForward::enqueue(const env_sample_t* sample)
+{
+  if(ram_count == SF_RAM_LENGTH && !spill()){
+    // no flash: the oldest sample in RAM is lost
+    ram_head = (ram_head + 1) % SF_RAM_LENGTH;
+    ram_count--;
+    stats.dropped++;
+  }
+  sf_pack(sample, &ram[((ram_head + ram_count) % SF_RAM_LENGTH) * SF_RECORD_SIZE]);
+  ram_count++;
+  stats.queued++;
+}
+
+// move the oldest SF_SPILL_BLOCK samples of the RAM ring to the flash
+bool StoreForward::spill()
+{
+  uint8_t block[SF_SPILL_BLOCK * SF_RECORD_SIZE];
+  uint32_t pos;
+  uint16_t i;
+
+  if(!flash_ok)
+    return false;
+  // a full flash ring drops its oldest block
+  if(flash_count + SF_SPILL_BLOCK > SF_FLASH_LENGTH){
+    flash_head = (flash_head + SF_SPILL_BLOCK) % SF_FLASH_LENGTH;
+    flash_count -= SF_SPILL_BLOCK;
+    stats.dropped += SF_SPILL_BLOCK;
+  }
+  for(i = 0; i < SF_SPILL_BLOCK; i++)
+    memcpy(&block[i * SF_RECORD_SIZE], &ram[((ram_head + i) % SF_RAM_LENGTH) * SF_RECORD_SIZE], SF_RECORD_SIZE);
+
+  // SF_FLASH_LENGTH is a multiple of SF_SPILL_BLOCK, a block never wraps
+  pos = (flash_head + flash_count) % SF_FLASH_LENGTH;
+  File file = SPIFFS.open(SF_FLASH_FILE, "r+");
+  if(!file || !file.seek(pos * SF_RECORD_SIZE) || file.write(block, sizeof(block)) != sizeof(block)){
+    file.close();
+    flash_ok = false;
+    Serial.println("[ERR] store-and-forward: flash write failed");
+    return false;
+  }
+  file.close();
+  flash_count += SF_SPILL_BLOCK;
+  ram_head = (ram_head + SF_SPILL_BLOCK) % SF_RAM_LENGTH;
+  ram_count -= SF_SPILL_BLOCK;
+  stats.spilled += SF_SPILL_BLOCK;
+  return true;
+}
+
+// read up to n of the oldest samples without removing them
+size_t StoreForward::peek(env_sample_t* samples, size_t n, bool* from_flash)
+{
+  uint8_t buf[SF_RECORD_SIZE];
+  size_t i;
+
+  *from_flash = (flash_count > 0);
+  if(*from_flash){
+    File file = SPIFFS.open(SF_FLASH_FILE, FILE_READ);
+    if(!file)
+      return 0;
+    if(n > flash_count)
+      n = flash_count;
+    for(i = 0; i < n; i++){
+      uint32_t pos = (flash_head + i) % SF_FLASH_LENGTH;
+      if((i == 0 || pos == 0) && !file.seek(pos * SF_RECORD_SIZE))
+        break;
+      if(file.read(buf, SF_RECORD_SIZE) != SF_RECORD_SIZE)
+        break;
+      sf_unpack(buf, &samples[i]);
+    }
+    file.close();
+    return i;
+  }
+  if(n > ram_count)
+    n = ram_count;
+  for(i = 0; i < n; i++)
+    sf_unpack(&ram[((ram_head + i) % SF_RAM_LENGTH) * SF_RECORD_SIZE], &samples[i]);
+  return n;
+}
+
+void StoreForward::remove(size_t n, bool from_flash)
+{
+  if(from_flash){
+    flash_head = (flash_head + n) % SF_FLASH_LENGTH;
+    flash_count -= n;
+  } else {
+    ram_head = (ram_head + n) % SF_RAM_LENGTH;
+    ram_count -= n;
+  }
+}
+
+void StoreForward::add(const env_sample_t* sample)
+{
+  if(exporter == NULL)
+    return;
+  // live samples are not held back by the replay of the queue
+  if(exporter(sample, 1, true) == 1){
+    stats.live++;
+    return;
+  }
+  enqueue(sample);
+}
+
+void StoreForward::loop()
+{
+  env_sample_t batch[32];
+  bool from_flash;
+  size_t n;
+
+  if(exporter == NULL || backlog() == 0)
+    return;
+  if((millis() - last_replay_ms) < replay_interval_ms)
+    return;
+  last_replay_ms = millis();
+
+  n = replay_batch;
+  if(n > sizeof(batch) / sizeof(batch[0]))
+    n = sizeof(batch) / sizeof(batch[0]);
+  n = peek(batch, n, &from_flash);
+  if(n == 0)
+    return;
+  // the samples stay in the queue until the exporter took them
+  n = exporter(batch, n, false);
+  if(n > 0){
+    remove(n, from_flash);
+    stats.replayed += n;
+    if(backlog() == 0)
+      Serial.printf("[OK] store-and-forward: %u samples replayed\n", (unsigned int)stats.replayed);
+  }
+}
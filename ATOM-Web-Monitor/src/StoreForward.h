@@ -0,0 +1,74 @@
+#ifndef __STORE_FORWARD_H
+#define __STORE_FORWARD_H
+
+#include "Arduino.h"
+#include "EnvSample.h"
+
+// samples kept in RAM before they are moved to the flash
+#define SF_RAM_LENGTH       256
+// samples moved to the flash at once
+#define SF_SPILL_BLOCK      64
+// size of the flash queue (8192 * 16 bytes = 128 kB)
+#define SF_FLASH_LENGTH     8192
+#define SF_FLASH_FILE       "/sf_queue.bin"
+#define SF_RECORD_SIZE      16
+
+// sends a batch of samples to the exporter
+// live: false for samples replayed out of the queue
+// returns the number of samples the exporter took (the first ones),
+// 0 if it can not take samples now
+typedef size_t (*sf_export_t)(const env_sample_t* samples, size_t n, bool live);
+
+typedef struct _sf_stats {
+  uint32_t live;        // samples sent directly
+  uint32_t queued;      // samples that went into the queue
+  uint32_t replayed;    // samples sent out of the queue
+  uint32_t spilled;     // samples moved to the flash
+  uint32_t dropped;     // samples lost because the flash queue was full
+} sf_stats_t;
+
+// store-and-forward queue in front of an exporter
+// While the exporter is not reachable the samples are kept in a
+// RAM ring, full blocks of the ring are moved to a ring file in the
+// SPIFFS. Once the exporter accepts samples again the queue is
+// replayed oldest first in batches of replay_batch samples at most
+// every replay_interval_ms, new samples are sent directly in between.
+// The queue is cleared at boot, since the millis() timestamps of
+// the samples are only valid until the next reset.
+class StoreForward
+{
+private:
+  sf_export_t exporter;
+  bool flash_ok;
+  uint16_t replay_batch;
+  uint32_t replay_interval_ms;
+  uint32_t last_replay_ms;
+
+  // RAM ring (newer samples)
+  uint8_t ram[SF_RAM_LENGTH * SF_RECORD_SIZE];
+  uint16_t ram_head;
+  uint16_t ram_count;
+
+  // flash ring (older samples)
+  uint32_t flash_head;
+  uint32_t flash_count;
+
+  void enqueue(const env_sample_t* sample);
+  bool spill();
+  size_t peek(env_sample_t* samples, size_t n, bool* from_flash);
+  void remove(size_t n, bool from_flash);
+
+public:
+  sf_stats_t stats;
+
+  StoreForward();
+  void begin(sf_export_t exporter_in, uint16_t replay_batch_in, uint32_t replay_interval_ms_in);
+  // new measurement: send it or keep it in the queue
+  void add(const env_sample_t* sample);
+  uint32_t backlog() { return ram_count + flash_count; }
+  uint32_t flashBacklog() { return flash_count; }
+  // replay the queue, has to be called from loop()
+  void loop();
+};
+
+#endif
@@ -0,0 +1,31 @@
+#include <sys/time.h>
+#include "TimeSync.h"
+
+// every date before 2021 means the clock was not set
+#define TIME_SYNC_VALID_AFTER 1609459200UL
+
+void time_sync_begin(const char* ntp_server)
+{
+  // UTC, no daylight saving
+  configTime(0, 0, ntp_server);
+}
+
+bool time_synced()
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec > (time_t)TIME_SYNC_VALID_AFTER;
+}
+
+uint64_t time_epoch_ns(uint32_t time_ms)
+{
+  struct timeval now;
+  uint32_t age_ms;
+
+  gettimeofday(&now, NULL);
+  age_ms = millis() - time_ms;
+  if(now.tv_sec <= (time_t)TIME_SYNC_VALID_AFTER)
+    return 0;
+  uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_usec * 1000ULL;
+  return now_ns - (uint64_t)age_ms * 1000000ULL;
+}
@@ -0,0 +1,18 @@
+#ifndef __TIME_SYNC_H
+#define __TIME_SYNC_H
+
+#include "Arduino.h"
+
+// wall clock time via SNTP
+// the measurements are stamped with millis(), these helpers
+// convert such a timestamp into UTC once the clock is set
+
+// start the SNTP client (runs in the background)
+void time_sync_begin(const char* ntp_server);
+// true as soon as the clock was set by SNTP
+bool time_synced();
+// UTC time of a millis() timestamp in ns since 1.1.1970
+// returns 0 if the clock is not set
+uint64_t time_epoch_ns(uint32_t time_ms);
+
+#endif
@@ -0,0 +1,72 @@
+#include "WireBus.h"
+
+WireBus wire_bus(&Wire);
+
+uint8_t WireBus::write(uint8_t address, const uint8_t* data, size_t len, bool stop)
+{
+  _wire->beginTransmission(address);
+  if(_wire->write(data, len) != len){
+    // the transmit buffer of TwoWire is too small
+    _wire->endTransmission();
+    return I2C_ERR_TOO_LONG;
+  }
+  uint8_t err = _wire->endTransmission(stop);
+  // the ESP32 core reports timeouts and bus errors with codes above 4
+  return err > I2C_ERR_OTHER ? I2C_ERR_OTHER : err;
+}
+
+size_t WireBus::read(uint8_t address, uint8_t* data, size_t len)
+{
+  size_t n = _wire->requestFrom(address, (uint8_t)len);
+  for(size_t i = 0; i < n; i++)
+    data[i] = _wire->read();
+  return n;
+}
+
+void WireBus::begin(int sda, int scl, uint32_t clock_hz)
+{
+  _sda = sda;
+  _scl = scl;
+  _clock_hz = clock_hz;
+  _wire->begin(sda, scl);
+  _wire->setClock(clock_hz);
+  _wire->setTimeOut(WIRE_BUS_TIMEOUT_MS);
+}
+
+// a device that was interrupted in the middle of a read holds SDA low
+// until it has shifted out the rest of its byte: up to nine clocks on
+// SCL (5 us low/high, 100 kHz) until SDA is released, then a STOP
+// condition ends the transfer for every device on the bus
+bool WireBus::recover()
+{
+  if(_sda < 0 || _scl < 0)
+    return false;
+  recoveries++;
+  _wire->end();
+  pinMode(_sda, INPUT_PULLUP);
+  pinMode(_scl, OUTPUT_OPEN_DRAIN);
+  digitalWrite(_scl, HIGH);
+  delayMicroseconds(5);
+  for(int i = 0; i < 9 && digitalRead(_sda) == LOW; i++){
+    digitalWrite(_scl, LOW);
+    delayMicroseconds(5);
+    digitalWrite(_scl, HIGH);
+    delayMicroseconds(5);
+  }
+  // STOP: SDA rises while SCL is high
+  digitalWrite(_scl, LOW);
+  pinMode(_sda, OUTPUT_OPEN_DRAIN);
+  digitalWrite(_sda, LOW);
+  delayMicroseconds(5);
+  digitalWrite(_scl, HIGH);
+  delayMicroseconds(5);
+  digitalWrite(_sda, HIGH);
+  delayMicroseconds(5);
+  pinMode(_sda, INPUT_PULLUP);
+  pinMode(_scl, INPUT_PULLUP);
+  bool released = digitalRead(_sda) == HIGH && digitalRead(_scl) == HIGH;
+  if(!released)
+    recovery_failures++;
+  begin(_sda, _scl, _clock_hz);
+  return released;
+}
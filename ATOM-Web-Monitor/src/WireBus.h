@@ -0,0 +1,40 @@
+#ifndef __WIRE_BUS_H
+#define __WIRE_BUS_H
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "I2CBus.h"
+
+// timeout of a transfer, a held SCL ends the transfer
+// with an error instead of blocking loop()
+#define WIRE_BUS_TIMEOUT_MS  10
+
+// I2CBus over a TwoWire of the Arduino core
+class WireBus : public I2CBus {
+public:
+  WireBus(TwoWire* wire = &Wire) : _wire(wire) {}
+  void setWire(TwoWire* wire) { _wire = wire; }
+  // start the TwoWire on the pins, recover() needs them
+  void begin(int sda, int scl, uint32_t clock_hz);
+
+  uint8_t write(uint8_t address, const uint8_t* data, size_t len, bool stop = true);
+  size_t read(uint8_t address, uint8_t* data, size_t len);
+  uint32_t micros() { return ::micros(); }
+  void delay(uint32_t ms) { ::delay(ms); }
+  bool recover();
+
+  // calls of recover() and the ones that left the bus held
+  uint32_t recoveries = 0;
+  uint32_t recovery_failures = 0;
+
+private:
+  TwoWire* _wire;
+  int _sda = -1;
+  int _scl = -1;
+  uint32_t _clock_hz = 100000;
+};
+
+// the bus of Wire, default of the drivers
+extern WireBus wire_bus;
+
+#endif
@@ -40,16 +40,73 @@ unsigned long next_millis;
 
 
 #include "UNIT_ENV.h"
+#include "I2CQueue.h"
+// both sensors support the 400 kHz fast mode
+#define I2C_CLOCK 400000
+// time of queued transfers per loop() in microseconds
+#define I2C_BUDGET_US 2000
+// the drivers submit their transfers to the queue, loop()
+// runs them and the callbacks complete the measurement
+I2CQueue i2c_queue(&wire_bus);
 // ENVIII:
 // SHT30:   temperature and humidity sensor  I2C: 0x44
 // QMP6988: absolute air pressure sensor     I2C: 0x70
-SHT3X sht30;
+SHT3X sht30(0x44, &i2c_queue);
 QMP6988 qmp6988;
 
 float qmp_Pressure = 0.0;
 float sht30_Temperature = 0.0;
 float sht30_Humidity = 0.0;
 int n_average = 1;
+// the pressure is averaged over the good reads only
+int n_pressure_average = 1;
+// number of failed sensor readings
+uint16_t sht30_errors = 0;
+uint16_t qmp6988_errors = 0;
+
+#include "SensorHealth.h"
+// the first failed read recovers the I2C bus, initializes the sensor
+// again and repeats the read within the same sample (once per sample),
+// 3 failed reads in a row: the sensor failed, a new init every 10 s
+// (the stale time follows the period)
+const health_config_t sensor_health_config = { 1, 3, 10000, 0 };
+SensorHealth sht30_health;
+SensorHealth qmp6988_health;
+// periods without a good read until the value of a sensor is stale
+#define SENSOR_STALE_PERIODS 3
+// the calibration of the QMP6988 was read
+bool qmp6988_ready = false;
+// duration of the last bus recovery incl. the new init of the sensors
+uint32_t i2c_recovery_us = 0;
+
+#include "Altitude.h"
+// altitude and vertical speed of every sample (no pow() per sample),
+// the sea level pressure (QNH) can be set via /api/altitude
+AltitudeTable altitude_table;
+VerticalSpeed vertical_speed;
+float baro_Altitude = 0.0;
+// air temperature of the altitude, the last good SHT30 read
+float altitude_Temperature = ALTITUDE_TEMPERATURE;
+// valid range of the QNH in Pa
+#define SEA_LEVEL_MIN 80000
+#define SEA_LEVEL_MAX 115000
+
+#include "AcquisitionConfig.h"
+// measurement interval, averaging and QMP6988 settings
+// can be changed at runtime via /api/config
+AcquisitionConfig acq_config;
+
+#include "History.h"
+// ring of the last measurements for the chart dashboard
+History history;
+
+#include "LTTB.h"
+// upper limit of points for /api/series
+#define SERIES_MAX_POINTS 1000
+
+#include "CsvExport.h"
+// only one CSV export can run at a time
+CsvExport csv_export;
 
 // WIFI and https client librarys:
 #include "WiFi.h"
@@ -64,13 +121,144 @@ const char* password = "YourPassword";
 WiFiClient myclient;
 WiFiServer server(80);
 
+#include "MQTTPublisher.h"
+// MQTT broker configuration (an empty broker disables MQTT):
+// every sample is published to mqtt_topic (as JSON array if more than
+// one sample is batched) and the newest one as retained message
+// to mqtt_last_topic
+const mqtt_config_t mqtt_config = {
+  "",                 // broker
+  1883,               // port
+  "atom-env",         // client id
+  NULL, NULL,         // user, password
+  "atom/env",         // topic
+  "atom/env/last",    // retained last value
+  1,                  // QoS
+  1,                  // samples per message
+  60                  // keep alive in seconds
+};
+WiFiClient mqtt_wifi_client;
+MQTTPublisher mqtt;
+
+#include "TimeSync.h"
+// time server for the UTC timestamps of the exporters
+const char* ntp_server = "pool.ntp.org";
+
+#include "InfluxUDP.h"
+// InfluxDB UDP listener (an empty host disables the export):
+// the samples are sent as line protocol, several lines per datagram
+const char* influx_host = "";
+const uint16_t influx_port = 8089;
+const char* influx_measurement = "env";
+const char* influx_tags = "device=atom-env";
+// send the collected lines at least every 10 seconds
+const uint32_t influx_max_age_ms = 10000;
+InfluxUDP influx;
+
+#include "CoapServer.h"
+// CoAP server with Observe on UDP port 5683
+// notifications as confirmable (true) or non-confirmable (false) messages
+const bool coap_confirmable = false;
+CoapServer coap;
+
+#include "ModbusServer.h"
+// Modbus TCP server on port 502 (see ModbusServer.h for the registers)
+ModbusServer modbus;
+
+#include "FleetNode.h"
+// every monitor multicasts its samples to 239.255.0.69:4269
+// an aggregator collects the samples of all monitors in the
+// network and serves them with /api/fleet
+const bool fleet_aggregator = true;
+FleetNode fleet;
+
+#include "StoreForward.h"
+// the samples for one exporter go through a store-and-forward
+// queue, so the samples taken while the exporter is not reachable
+// are sent later (the other exporter only gets live samples)
+#define EXPORT_NONE   0
+#define EXPORT_MQTT   1
+#define EXPORT_INFLUX 2
+const int store_forward_target = EXPORT_MQTT;
+// replay at most 32 samples per second after an outage
+const uint16_t store_forward_batch = 32;
+const uint32_t store_forward_interval_ms = 1000;
+StoreForward store_forward;
+
+#include "AlertRules.h"
+#include "AlertWebhook.h"
+// alert rules, evaluated with every sample:
+// {name, type, metric, threshold, hysteresis, hold-off in ms}
+// above/below: value, rate: change per minute, stale: seconds
+const alert_rule_t alert_rules[] = {
+  {"server room hot",  ALERT_ABOVE, SERIES_TEMPERATURE, 30.0F, 1.0F, 60000},
+  {"humidity high",    ALERT_ABOVE, SERIES_HUMIDITY,    70.0F, 5.0F, 300000},
+  {"humidity spike",   ALERT_RATE,  SERIES_HUMIDITY,    5.0F,  2.0F, 0},
+  {"sensor stale",     ALERT_STALE, SERIES_PRESSURE,    60.0F, 0.0F, 0}
+};
+// every state change of a rule is POSTed to the webhook
+// (an empty host disables the webhook)
+const char* webhook_host = "";
+const uint16_t webhook_port = 8081;
+const char* webhook_path = "/alerts";
+const char* webhook_device = "atom-env";
+AlertRules alerts;
+WiFiClient webhook_wifi_client;
+AlertWebhook webhook;
+
+#include "SampleBus.h"
+// every new sample is published once on the bus, each sink
+// gets it from its own queue (see setup() for the sinks)
+SampleBus bus;
+// the SHT30 converts while the QMP6988 is read, the sample is
+// completed in a later loop() when the conversion time is over
+bool sht30_measuring = false;
+env_sample_t measure_sample;
+// in the periodic mode the SHT30 measures on its own,
+// each sample takes the latest fetched result
+bool sht30_fresh = false;
+// a forced conversion of the QMP6988 runs
+bool qmp6988_measuring = false;
+// the read of the QMP6988 result is queued
+bool qmp6988_reading = false;
+// the sample is published when both sensors are done
+bool measure_pending = false;
+
+#include "RawStream.h"
+// binary stream of the raw sensor words over the USB serial port
+// for lab measurements (see ATOM-Host-Tools/raw_capture):
+// "stream [baud]" on the serial console starts it, "stop" ends it
+// the web server and the exporters are paused while streaming
+#define SERIAL_BAUD 115200
+bool raw_streaming = false;
+uint32_t raw_stream_baud = RAW_STREAM_DEFAULT_BAUD;
+uint16_t raw_seq = 0;
+uint16_t raw_info_countdown = 0;
+raw_sample_t raw_pending;
+char serial_line[32];
+uint8_t serial_line_len = 0;
+
 // GET 
 #define GET_unknown 0
 #define GET_index_page  1
 #define GET_favicon  2
 #define GET_logo  3
 #define GET_script  4
+#define GET_history  5
+#define GET_update  6
+#define GET_series  7
+#define GET_export  8
+#define GET_config  9
+#define GET_mqtt  10
+#define GET_fleet  11
+#define GET_alerts  12
+#define GET_bus  13
+#define GET_altitude  14
+#define GET_i2c  15
+#define GET_health  16
 int html_get_request;
+// the request line of the actual GET request (incl. the query string)
+String html_request_line;
 
 #include "index.h"
 #include "electric_logo.h"
@@ -79,6 +267,33 @@ int html_get_request;
 // forward declarations:
 void I2Cscan();
 boolean connect_Wifi();
+unsigned long get_request_param(const char* name, unsigned long default_value);
+String get_request_value(const char* name);
+void series_emit(void* context, uint32_t time_ms, float value);
+void apply_acquisition_config();
+size_t store_forward_export(const env_sample_t* samples, size_t n, bool live);
+int parse_acquisition_config(acquisition_config_t* config);
+bool bus_serial(void* context, const env_sample_t* sample);
+bool bus_average(void* context, const env_sample_t* sample);
+bool bus_alerts(void* context, const env_sample_t* sample);
+bool bus_store_forward(void* context, const env_sample_t* sample);
+bool bus_mqtt(void* context, const env_sample_t* sample);
+bool bus_influx(void* context, const env_sample_t* sample);
+bool bus_coap(void* context, const env_sample_t* sample);
+bool bus_modbus(void* context, const env_sample_t* sample);
+bool bus_fleet(void* context, const env_sample_t* sample);
+void serial_command();
+void raw_stream_loop();
+bool apply_sht30_mode();
+bool configure_qmp6988();
+void check_sensor_health();
+void start_sht30();
+void start_pressure();
+void publish_measurement(bool sht30_valid);
+void read_pressure();
+void pressure_done(void* context, float pressure);
+void sht30_done(void* context, byte ret);
+void compensation_bench();
 
 void setup() {
   // start the ATOM device with Serial and Display (one LED)
@@ -86,7 +301,8 @@ void setup() {
   M5.begin(true, false, true);
   // Wire.begin() must be called after M5.begin()
   // Atom Matrix I2C GPIO Pin is 26 and 32
-  Wire.begin(26, 32);         
+  // the pins are kept for the recovery of the bus
+  wire_bus.begin(26, 32, I2C_CLOCK);
   delay(50); 
   // set LED to red
   M5.dis.fillpix(LED_ERROR); 
@@ -103,41 +319,102 @@ void setup() {
   connect_Wifi();
   // Start TCP/IP-Server
   server.begin();     
+  // the MQTT connection is established in loop()
+  mqtt.begin(&mqtt_wifi_client, &mqtt_config);
+  // the clock is set in the background as soon as WiFi is up
+  time_sync_begin(ntp_server);
+  influx.begin(influx_host, influx_port, influx_measurement, influx_tags, influx_max_age_ms);
+  coap.begin(COAP_DEFAULT_PORT, coap_confirmable);
+  modbus.begin();
+  fleet.begin(fleet_aggregator);
+  if((store_forward_target == EXPORT_MQTT && mqtt.enabled()) ||
+     (store_forward_target == EXPORT_INFLUX && influx.enabled()))
+    store_forward.begin(store_forward_export, store_forward_batch, store_forward_interval_ms);
+  alerts.begin(alert_rules, sizeof(alert_rules) / sizeof(alert_rules[0]), millis());
+  webhook.begin(&webhook_wifi_client, webhook_host, webhook_port, webhook_path, webhook_device);
+  // sinks of the samples with queue depth and overflow policy:
+  // sinks that need every sample keep a few of them,
+  // sinks that only show the actual values take the newest one
+  bus.subscribe("serial", bus_serial, NULL, 1, BUS_COALESCE_LATEST);
+  bus.subscribe("average", bus_average, NULL, 4, BUS_DROP_OLDEST);
+  bus.subscribe("alerts", bus_alerts, NULL, 4, BUS_DROP_OLDEST);
+  if(store_forward_target != EXPORT_NONE)
+    bus.subscribe("store_forward", bus_store_forward, NULL, 8, BUS_DROP_OLDEST);
+  if(store_forward_target != EXPORT_MQTT && mqtt.enabled())
+    bus.subscribe("mqtt", bus_mqtt, NULL, 8, BUS_DROP_OLDEST);
+  if(store_forward_target != EXPORT_INFLUX && influx.enabled())
+    bus.subscribe("influx", bus_influx, NULL, 8, BUS_DROP_OLDEST);
+  bus.subscribe("coap", bus_coap, NULL, 1, BUS_COALESCE_LATEST);
+  bus.subscribe("modbus", bus_modbus, NULL, 1, BUS_COALESCE_LATEST);
+  bus.subscribe("fleet", bus_fleet, NULL, 1, BUS_COALESCE_LATEST);
   
 
-  if(qmp6988.init()==1){
+  altitude_table.begin(ALTITUDE_SEA_LEVEL);
+  vertical_speed.begin();
+  sht30_health.begin(&sensor_health_config, millis());
+  qmp6988_health.begin(&sensor_health_config, millis());
+  // without the calibration the reads fail until
+  // the health check initializes the sensor again
+  qmp6988_ready = qmp6988.init(&i2c_queue) == 1;
+  if(qmp6988_ready){
     Serial.println("[OK] QMP6988 ready");
   } else {
     Serial.println("[ERR] QMP6988 not ready");
   }
-  // high precission mode
-  qmp6988.setFilter(QMP6988_FILTERCOEFF_32);
-  qmp6988.setOversamplingP(QMP6988_OVERSAMPLING_32X);
-  qmp6988.setOversamplingT(QMP6988_OVERSAMPLING_4X);
+  // load the stored acquisition settings (default: high precission mode)
+  acq_config.begin();
+  apply_acquisition_config();
   next_millis = millis() + 1000;
 }
 
 void loop() {
+  // commands on the serial console
+  serial_command();
+  // lab mode: nothing else than the raw sensor stream
+  if(raw_streaming){
+    raw_stream_loop();
+    return;
+  }
   // get actual time in miliseconds
   unsigned long current_millis = millis();
   // check if next measure interval is reached
   if(current_millis > next_millis){
     Serial.println("Measure");
-    next_millis = current_millis + 3000;
+    next_millis = current_millis + acq_config.active.period_ms;
     M5.dis.fillpix(LED_MEASURE); 
-    if (sht30.get() != 0) {
-      return;
-    }
-    Serial.println(qmp6988.calcPressure());
-    Serial.println(sht30.cTemp);
-    Serial.println(sht30.humidity);
-    // calculate running average
-    qmp_Pressure = ((qmp_Pressure*(n_average-1)) + qmp6988.calcPressure())/n_average;
-    sht30_Temperature = ((sht30_Temperature*(n_average-1)) + sht30.cTemp)/n_average;
-    sht30_Humidity = ((sht30_Humidity*(n_average-1)) + sht30.humidity)/n_average;
-    if(n_average < 10) 
-      n_average++;
+    measure_sample.time_ms = current_millis;
+    measure_pending = true;
+    sht30_health.startSample();
+    qmp6988_health.startSample();
+    if (sht30.mode() == SHT3X_MODE_SINGLE_SHOT)
+      start_sht30();
+    start_pressure();
+  }
+  // the forced QMP6988 conversion is done
+  if(qmp6988_measuring && qmp6988.ready()){
+    qmp6988_measuring = false;
+    read_pressure();
+  }
+  // the SHT30 result is ready
+  if(sht30.poll() && sht30.requestRead(sht30_done, NULL) != 0)
+    sht30_done(NULL, 1);
+  // run the queued transfers, the callbacks complete the sample
+  i2c_queue.process(I2C_BUDGET_US);
+  // a failed read recovers the bus and is repeated at once
+  check_sensor_health();
+  // both sensors are done
+  if(measure_pending && !sht30_measuring && !qmp6988_measuring && !qmp6988_reading){
+    measure_pending = false;
+    // no new periodic result since the last sample (the SHT30
+    // clock is a bit slower): the last good result is used again,
+    // without any result the SHT30 values of the sample are missing
+    publish_measurement(sht30_fresh || (sht30.mode() != SHT3X_MODE_SINGLE_SHOT && !sht30_health.stale(millis())));
+    sht30_fresh = false;
   }
+  // deliver the queued samples to the sinks
+  bus.dispatch();
+  // a sensor that does not deliver values anymore
+  alerts.tick(millis());
   // check if WIFI is still connected
   // if the WIFI is not connected (anymore)
   // a reconnect is triggert
@@ -149,6 +426,8 @@ void loop() {
     Serial.println("[ERR] Lost WiFi connection, reconnecting...");
     if(connect_Wifi()){
       Serial.println("[OK] WiFi reconnected");
+      // join the multicast group again
+      fleet.begin(fleet_aggregator);
     } else {
       Serial.println("[ERR] unable to reconnect");
     }
@@ -159,11 +438,30 @@ void loop() {
   if(wifi_Status == WL_CONNECTED){
     // set LED to green
     M5.dis.fillpix(LED_OK); 
+    // send queued MQTT messages and keep the connection alive
+    mqtt.loop();
+    // send the InfluxDB lines that are waiting too long
+    influx.loop();
+    // answer CoAP requests
+    coap.loop();
+    // answer Modbus requests
+    modbus.loop();
+    // receive the samples of the other monitors
+    fleet.loop();
+    // send the samples that were queued during an outage
+    store_forward.loop();
+    // deliver the state changes of the alert rules
+    webhook.loop(&alerts);
   }
 
+  // send the next part of a running CSV export
+  csv_export.poll();
+
   // check for incoming clients
   WiFiClient client = server.available(); 
   if (client) {  
+    // true if the connection is kept open by the CSV export
+    boolean client_handed_over = false;
     // force a disconnect after 1 second
     unsigned long timeout_millis = millis()+1000;
     // set LED to blue
@@ -221,9 +519,277 @@ void loop() {
                 client.println("HTTP/1.1 200 OK");
                 client.println("Content-type:application/javascript");
                 client.println();
-                client.printf("var temperatureValue = %3.2f;\n", sht30_Temperature);
-                client.printf("var humidityValue = %3.2f;", sht30_Humidity);
-                client.printf("var pressureValue = %3.2f;", qmp_Pressure/100.0F);
+                // the values of a sensor without a good read
+                // for some periods are not served any longer
+                if(sht30_health.stale(millis())){
+                  client.print("var temperatureValue = null;\n");
+                  client.print("var humidityValue = null;");
+                } else {
+                  client.printf("var temperatureValue = %3.2f;\n", sht30_Temperature);
+                  client.printf("var humidityValue = %3.2f;", sht30_Humidity);
+                }
+                if(qmp6988_health.stale(millis())){
+                  client.print("var pressureValue = null;");
+                } else {
+                  client.printf("var pressureValue = %3.2f;", qmp_Pressure/100.0F);
+                }
+                break;
+              }
+
+              case GET_history:
+              case GET_update: {
+                // complete history or only the samples since a given seq
+                uint32_t from_seq = 0;
+                if(html_get_request == GET_update)
+                  from_seq = get_request_param("seq", 0);
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/octet-stream");
+                client.println("Cache-Control: no-store");
+                client.printf("Content-Length: %u\r\n", (unsigned int)history.binarySize(from_seq));
+                client.println();
+                history.writeBinary(&client, from_seq, millis());
+                break;
+              }
+
+              case GET_series: {
+                // downsampled series of one metric as JSON
+                int metric = lttb_metric(get_request_value("metric").c_str());
+                unsigned long points = get_request_param("points", 100);
+                uint32_t from_ms = get_request_param("from", 0);
+                uint32_t to_ms = get_request_param("to", millis());
+                if(metric == SERIES_UNKNOWN || points < 1 || points > SERIES_MAX_POINTS || to_ms < from_ms){
+                  client.println("HTTP/1.1 400 Bad Request");
+                  client.println("Content-type:text/plain");
+                  client.println();
+                  client.print("usage: /api/series?metric=temperature|humidity|pressure&from=ms&to=ms&points=n");
+                  break;
+                }
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"metric\":\"%s\",\"from\":%u,\"to\":%u,\"points\":[",
+                              get_request_value("metric").c_str(), from_ms, to_ms);
+                // first seq after "to" is the end of the window
+                uint32_t end_seq = (to_ms == 0xFFFFFFFF) ? history.nextSeq() : history.findSeq(to_ms + 1);
+                int n_emitted = 0;
+                void* context[2] = {&client, &n_emitted};
+                lttb_downsample(&history, metric, history.findSeq(from_ms), end_seq,
+                                points, series_emit, context);
+                client.print("]}");
+                break;
+              }
+
+              case GET_config: {
+                // read or change the acquisition settings
+                acquisition_config_t config = acq_config.active;
+                int changed = parse_acquisition_config(&config);
+                if(changed < 0){
+                  client.println("HTTP/1.1 400 Bad Request");
+                  client.println("Content-type:text/plain");
+                  client.println();
+                  client.print("invalid acquisition settings");
+                  break;
+                }
+                if(changed > 0){
+                  // all settings are taken over at once
+                  acq_config.active = config;
+                  apply_acquisition_config();
+                  if(!acq_config.save())
+                    Serial.println("[ERR] unable to store acquisition settings");
+                }
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"period_ms\":%u,\"average\":%u,\"oversampling_p\":%i,\"oversampling_t\":%i,\"filter\":%i,"
+                              "\"pressure_mode\":\"%s\",\"conversion_us\":%u,"
+                              "\"sht30_mode\":\"%s\",\"sht30_repeatability\":\"%s\"}",
+                              (unsigned int)acq_config.active.period_ms, acq_config.active.n_average,
+                              AcquisitionConfig::oversamplingRatio(acq_config.active.oversampling_p),
+                              AcquisitionConfig::oversamplingRatio(acq_config.active.oversampling_t),
+                              AcquisitionConfig::filterRatio(acq_config.active.filter),
+                              acq_config.active.pressure_forced ? "forced" : "normal",
+                              (unsigned int)QMP6988::conversionTime(acq_config.active.oversampling_p,
+                                                                    acq_config.active.oversampling_t),
+                              AcquisitionConfig::sht30ModeName(acq_config.active.sht30_mode),
+                              AcquisitionConfig::repeatabilityName(acq_config.active.sht30_repeatability));
+                break;
+              }
+
+              case GET_mqtt: {
+                // MQTT statistics, the rates are averaged since boot
+                float uptime_s = millis() / 1000.0F;
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"connected\":%s,\"queued\":%u,\"messages\":%u,\"acked\":%u,\"dropped\":%u,"
+                              "\"samples\":%u,\"bytes\":%u,\"connects\":%u,\"messages_per_s\":%.3f,\"bytes_per_sample\":%.1f}",
+                              mqtt.isConnected() ? "true" : "false", mqtt.queued(),
+                              (unsigned int)mqtt.stats.messages, (unsigned int)mqtt.stats.acked,
+                              (unsigned int)mqtt.stats.dropped, (unsigned int)mqtt.stats.samples,
+                              (unsigned int)mqtt.stats.bytes, (unsigned int)mqtt.stats.connects,
+                              mqtt.stats.messages / uptime_s,
+                              mqtt.stats.samples > 0 ? (float)mqtt.stats.bytes / mqtt.stats.samples : 0.0F);
+                break;
+              }
+
+              case GET_fleet: {
+                // last values of all monitors in the network
+                char peer_json[256];
+                uint32_t now_ms = millis();
+                int n_peers = 0;
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"node\":\"%08x\",\"aggregator\":%s,\"rejected\":%u,\"peers\":[",
+                              (unsigned int)fleet.nodeId(), fleet.isAggregator() ? "true" : "false",
+                              (unsigned int)fleet.peers.rejected);
+                for(int i = 0; i < fleet.peers.size(); i++){
+                  size_t len = fleet.peers.formatJson(i, peer_json, sizeof(peer_json), now_ms);
+                  if(len == 0)
+                    continue;
+                  if(n_peers++ > 0)
+                    client.print(",");
+                  client.write((const uint8_t*)peer_json, len);
+                }
+                client.print("]}");
+                break;
+              }
+
+              case GET_alerts: {
+                // state of the alert rules and of the webhook delivery
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.print("{\"rules\":[");
+                for(uint8_t i = 0; i < alerts.size(); i++){
+                  const alert_rule_t* rule = alerts.rule(i);
+                  client.printf("%s{\"name\":\"%s\",\"type\":\"%s\",\"threshold\":%.2f,\"firing\":%s}",
+                                i > 0 ? "," : "", rule->name, alert_type_name(rule->type), rule->threshold,
+                                alerts.isFiring(i) ? "true" : "false");
+                }
+                client.printf("],\"pending\":%u,\"dropped\":%u,\"posts\":%u,\"delivered\":%u,\"failed\":%u}",
+                              alerts.pending(), (unsigned int)alerts.dropped, (unsigned int)webhook.stats.posts,
+                              (unsigned int)webhook.stats.events, (unsigned int)webhook.stats.failed);
+                break;
+              }
+
+              case GET_bus: {
+                // queues of the sample bus
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"published\":%u,\"sinks\":[", (unsigned int)bus.published);
+                for(uint8_t i = 0; i < bus.size(); i++){
+                  const bus_subscriber_t* sub = bus.subscriber(i);
+                  client.printf("%s{\"name\":\"%s\",\"policy\":\"%s\",\"depth\":%u,\"queued\":%u,\"max_fill\":%u,"
+                                "\"delivered\":%u,\"dropped\":%u,\"coalesced\":%u,\"refused\":%u}",
+                                i > 0 ? "," : "", sub->name, bus_policy_name(sub->policy), sub->depth, sub->count,
+                                sub->stats.max_fill, (unsigned int)sub->stats.delivered, (unsigned int)sub->stats.dropped,
+                                (unsigned int)sub->stats.coalesced, (unsigned int)sub->stats.refused);
+                }
+                client.print("]}");
+                break;
+              }
+
+              case GET_i2c: {
+                // transfers of the I2C queue, the time on the bus
+                // is measured and computed from the bus clocks
+                const i2c_queue_stats_t* s = &i2c_queue.stats;
+                uint32_t samples = bus.published > 0 ? bus.published : 1;
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"clock\":%u,\"submitted\":%u,\"blocking\":%u,\"transfers\":%u,\"merged\":%u,"
+                              "\"bytes\":%u,\"errors\":%u,\"refused\":%u,\"max_fill\":%u,\"busy_us\":%u,\"bus_us\":%u,",
+                              I2C_CLOCK, (unsigned int)s->submitted, (unsigned int)s->blocking, (unsigned int)s->transfers,
+                              (unsigned int)s->merged, (unsigned int)s->bytes, (unsigned int)s->errors,
+                              (unsigned int)s->refused, s->max_fill, (unsigned int)s->busy_us,
+                              (unsigned int)i2c_queue.busTime(I2C_CLOCK));
+                client.printf("\"samples\":%u,\"busy_us_per_sample\":%.1f,\"bytes_per_sample\":%.1f}",
+                              (unsigned int)bus.published, (float)s->busy_us / samples, (float)s->bytes / samples);
+                break;
+              }
+
+              case GET_health: {
+                // state of the sensors and the recoveries of the I2C bus
+                unsigned long now = millis();
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                client.printf("{\"bus\":{\"recoveries\":%u,\"recovery_failures\":%u,\"recovery_us\":%u},\"sensors\":[",
+                              (unsigned int)wire_bus.recoveries, (unsigned int)wire_bus.recovery_failures,
+                              (unsigned int)i2c_recovery_us);
+                SensorHealth* sensors[2] = { &sht30_health, &qmp6988_health };
+                const char* names[2] = { "sht30", "qmp6988" };
+                uint16_t errors[2] = { sht30_errors, qmp6988_errors };
+                for(int i = 0; i < 2; i++){
+                  const health_stats_t* s = &sensors[i]->stats;
+                  client.printf("%s{\"name\":\"%s\",\"state\":\"%s\",\"stale\":%s,\"age_ms\":%u,"
+                                "\"consecutive_failures\":%u,\"errors\":%u,\"reads\":%u,\"failures\":%u,"
+                                "\"recoveries\":%u,\"recovery_failures\":%u,\"outages\":%u,"
+                                "\"outage_ms\":%u,\"max_outage_ms\":%u}",
+                                i > 0 ? "," : "", names[i], health_state_name(sensors[i]->state()),
+                                sensors[i]->stale(now) ? "true" : "false", (unsigned int)sensors[i]->age(now),
+                                sensors[i]->consecutiveFailures(), errors[i], (unsigned int)s->reads,
+                                (unsigned int)s->failures, (unsigned int)s->recoveries,
+                                (unsigned int)s->recovery_failures, (unsigned int)s->outages,
+                                (unsigned int)s->outage_ms, (unsigned int)s->max_outage_ms);
+                }
+                client.print("]}");
+                break;
+              }
+
+              case GET_altitude: {
+                // altitude of the last sample, ?sea_level=Pa sets the QNH
+                unsigned long sea_level = get_request_param("sea_level", 0);
+                if(sea_level != 0){
+                  if(sea_level < SEA_LEVEL_MIN || sea_level > SEA_LEVEL_MAX){
+                    client.println("HTTP/1.1 400 Bad Request");
+                    client.println("Content-type:text/plain");
+                    client.println();
+                    client.printf("usage: /api/altitude?sea_level=%u...%u (Pa)", SEA_LEVEL_MIN, SEA_LEVEL_MAX);
+                    break;
+                  }
+                  altitude_table.begin((float)sea_level);
+                  // the filter would see a jump of the altitude
+                  vertical_speed.reset();
+                }
+                client.println("HTTP/1.1 200 OK");
+                client.println("Content-type:application/json");
+                client.println("Cache-Control: no-store");
+                client.println();
+                // the altitude is kept from the last good pressure read
+                if(env_value_valid(measure_sample.pressure))
+                  client.printf("{\"pressure\":%.1f,", measure_sample.pressure);
+                else
+                  client.print("{\"pressure\":null,");
+                client.printf("\"sea_level\":%.0f,\"altitude\":%.2f,"
+                              "\"filtered_altitude\":%.2f,\"vertical_speed\":%.3f}",
+                              altitude_table.seaLevel(), baro_Altitude,
+                              vertical_speed.altitude(), vertical_speed.speed());
+                break;
+              }
+
+              case GET_export: {
+                if(csv_export.active()){
+                  client.println("HTTP/1.1 503 Service Unavailable");
+                  client.println("Content-type:text/plain");
+                  client.println();
+                  client.print("export already running");
+                  break;
+                }
+                // the export continues in loop() chunk by chunk
+                csv_export.begin(client, &history, get_request_param("from", 0),
+                                 get_request_param("to", 0xFFFFFFFF));
+                client_handed_over = true;
                 break;
               }
               
@@ -235,7 +801,8 @@ void loop() {
                 break;
             }
             // The HTTP response ends with another blank line:
-            client.println();
+            if(!client_handed_over)
+              client.println();
             // break out of the while loop:
             break;
           } else {    // if a newline is found
@@ -243,6 +810,7 @@ void loop() {
             // detect the specific GET requests:
             if(currentLine.startsWith("GET /")){
               html_get_request = GET_unknown;
+              html_request_line = currentLine;
               // if no specific target is requested
               if(currentLine.startsWith("GET / ")){
                 html_get_request = GET_index_page;
@@ -259,6 +827,54 @@ void loop() {
               if(currentLine.startsWith("GET /data.js")){
                 html_get_request = GET_script;
               }
+              // if the binary history for the charts is requested
+              if(currentLine.startsWith("GET /history.bin")){
+                html_get_request = GET_history;
+              }
+              // if only the new samples are requested
+              if(currentLine.startsWith("GET /update.bin")){
+                html_get_request = GET_update;
+              }
+              // if a downsampled series is requested
+              if(currentLine.startsWith("GET /api/series")){
+                html_get_request = GET_series;
+              }
+              // if the CSV export is requested
+              if(currentLine.startsWith("GET /export.csv")){
+                html_get_request = GET_export;
+              }
+              // if the acquisition settings are read or changed
+              if(currentLine.startsWith("GET /api/config")){
+                html_get_request = GET_config;
+              }
+              // if the MQTT statistics are requested
+              if(currentLine.startsWith("GET /api/mqtt")){
+                html_get_request = GET_mqtt;
+              }
+              // if the values of all monitors are requested
+              if(currentLine.startsWith("GET /api/fleet")){
+                html_get_request = GET_fleet;
+              }
+              // if the state of the alert rules is requested
+              if(currentLine.startsWith("GET /api/alerts")){
+                html_get_request = GET_alerts;
+              }
+              // if the state of the sample bus is requested
+              if(currentLine.startsWith("GET /api/bus")){
+                html_get_request = GET_bus;
+              }
+              // if the statistics of the I2C queue are requested
+              if(currentLine.startsWith("GET /api/i2c")){
+                html_get_request = GET_i2c;
+              }
+              // if the state of the sensors is requested
+              if(currentLine.startsWith("GET /api/health")){
+                html_get_request = GET_health;
+              }
+              // if the altitude is requested (or the QNH is set)
+              if(currentLine.startsWith("GET /api/altitude")){
+                html_get_request = GET_altitude;
+              }
             }
             currentLine = "";
           }
@@ -270,8 +886,10 @@ void loop() {
       }
     }
     // close the connection:
-    client.stop();
-    Serial.println("Client Disconnected.");
+    if(!client_handed_over){
+      client.stop();
+      Serial.println("Client Disconnected.");
+    }
   }
 }
 
@@ -307,6 +925,632 @@ void I2Cscan(){
   Serial.printf("\n%i devices found\n\n", nDevices);
  }
 
+// =============================================================
+// get_request_value()
+// returns the value of a query parameter of the actual
+// GET request (e.g. "GET /update.bin?seq=42 HTTP/1.1")
+// or an empty string if the parameter is not present
+// =============================================================
+String get_request_value(const char* name){
+  int query = html_request_line.indexOf('?');
+  int end = html_request_line.indexOf(' ', 4);
+  if(end < 0)
+    end = html_request_line.length();
+  if(query < 0 || query > end)
+    return "";
+  String key = String(name) + "=";
+  int pos = query;
+  while(pos >= 0 && pos < end){
+    // a parameter starts after '?' or '&'
+    if(html_request_line.substring(pos+1).startsWith(key)){
+      int value_end = html_request_line.indexOf('&', pos+1);
+      if(value_end < 0 || value_end > end)
+        value_end = end;
+      return html_request_line.substring(pos+1+key.length(), value_end);
+    }
+    pos = html_request_line.indexOf('&', pos+1);
+  }
+  return "";
+}
+
+// =============================================================
+// get_request_param()
+// returns the numeric value of a query parameter
+// or default_value if the parameter is not present
+// =============================================================
+unsigned long get_request_param(const char* name, unsigned long default_value){
+  String value = get_request_value(name);
+  if(value.length() == 0)
+    return default_value;
+  return strtoul(value.c_str(), NULL, 10);
+}
+
+// =============================================================
+// series_emit()
+// writes one point of /api/series as [time_ms,value]
+// context: {WiFiClient*, int* number of points written}
+// =============================================================
+void series_emit(void* context, uint32_t time_ms, float value){
+  WiFiClient* client = (WiFiClient*)((void**)context)[0];
+  int* n_emitted = (int*)((void**)context)[1];
+  client->printf("%s[%u,%.2f]", (*n_emitted > 0) ? "," : "", time_ms, value);
+  (*n_emitted)++;
+}
+
+// =============================================================
+// apply_acquisition_config()
+// transfer the active acquisition settings to the sensor
+// and restart the running average
+// =============================================================
+void apply_acquisition_config(){
+  if(!configure_qmp6988())
+    qmp6988_errors++;
+  qmp6988_measuring = false;
+  measure_pending = false;
+  apply_sht30_mode();
+  sht30_health.setStaleTime(SENSOR_STALE_PERIODS * acq_config.active.period_ms);
+  qmp6988_health.setStaleTime(SENSOR_STALE_PERIODS * acq_config.active.period_ms);
+  if(n_average > acq_config.active.n_average)
+    n_average = acq_config.active.n_average;
+  if(n_pressure_average > acq_config.active.n_average)
+    n_pressure_average = acq_config.active.n_average;
+  next_millis = millis() + acq_config.active.period_ms;
+  // a value is valid until the next measurement
+  coap.setMaxAge(acq_config.active.period_ms / 1000 + 1);
+  Serial.printf("[OK] acquisition: %u ms, average %u, P %ix, T %ix, filter %i, %s, SHT30 %s %s\n",
+                (unsigned int)acq_config.active.period_ms, acq_config.active.n_average,
+                AcquisitionConfig::oversamplingRatio(acq_config.active.oversampling_p),
+                AcquisitionConfig::oversamplingRatio(acq_config.active.oversampling_t),
+                AcquisitionConfig::filterRatio(acq_config.active.filter),
+                acq_config.active.pressure_forced ? "forced" : "normal",
+                AcquisitionConfig::sht30ModeName(acq_config.active.sht30_mode),
+                AcquisitionConfig::repeatabilityName(acq_config.active.sht30_repeatability));
+}
+
+// =============================================================
+// configure_qmp6988()
+// transfer the active settings to the QMP6988
+// =============================================================
+bool configure_qmp6988(){
+  // in the forced mode the QMP6988 sleeps between the samples
+  return qmp6988.configure(acq_config.active.pressure_forced ? QMP6988_SLEEP_MODE : QMP6988_NORMAL_MODE,
+                           acq_config.active.oversampling_p, acq_config.active.oversampling_t,
+                           acq_config.active.filter) == 1;
+}
+
+// =============================================================
+// apply_sht30_mode()
+// start the configured periodic mode of the SHT30
+// or return to single shot measurements
+// =============================================================
+bool apply_sht30_mode(){
+  sht30_measuring = false;
+  sht30_fresh = false;
+  if(sht30.startPeriodic(acq_config.active.sht30_mode, acq_config.active.sht30_repeatability) != 0){
+    sht30_errors++;
+    Serial.println("[ERR] unable to set the SHT30 mode");
+    return false;
+  }
+  return true;
+}
+
+// =============================================================
+// check_sensor_health()
+// a failed read gets a recovery of the bus (SCL clock-out, STOP,
+// new start of Wire) and a new init of the sensor, the read is
+// repeated for the running sample,
+// a failed sensor gets a new init every few seconds
+// =============================================================
+void check_sensor_health(){
+  unsigned long now = millis();
+  bool sht30_recover = sht30_health.needsRecovery(now);
+  bool qmp6988_recover = qmp6988_health.needsRecovery(now);
+  if(!sht30_recover && !qmp6988_recover)
+    return;
+  uint32_t start_us = micros();
+  // the transfers that are still queued complete first
+  i2c_queue.flush();
+  bool released = i2c_queue.recover();
+  bool sht30_ok = true;
+  bool qmp6988_ok = true;
+  if(sht30_recover){
+    // the reset ends a periodic mode, the configured one is started again
+    sht30_ok = released && sht30.reset() == 0 && apply_sht30_mode();
+    sht30_health.recovered(sht30_ok, millis());
+  }
+  if(qmp6988_recover){
+    // the init resets the sensor and reads the calibration again
+    qmp6988_ready = released && qmp6988.init(&i2c_queue) == 1;
+    qmp6988_ok = qmp6988_ready && configure_qmp6988();
+    qmp6988_health.recovered(qmp6988_ok, millis());
+  }
+  i2c_recovery_us = micros() - start_us;
+  Serial.printf("[%s] I2C recovery in %u us: bus %s, SHT30 %s, QMP6988 %s\n",
+                released && sht30_ok && qmp6988_ok ? "OK" : "ERR", (unsigned int)i2c_recovery_us,
+                released ? "free" : "held",
+                sht30_recover ? (sht30_ok ? "ready" : "failed") : health_state_name(sht30_health.state()),
+                qmp6988_recover ? (qmp6988_ok ? "ready" : "failed") : health_state_name(qmp6988_health.state()));
+  if(!measure_pending)
+    return;
+  // a periodic SHT30 delivers its next result with the next sample
+  if(sht30_recover && sht30_ok && sht30.mode() == SHT3X_MODE_SINGLE_SHOT)
+    start_sht30();
+  if(qmp6988_recover && qmp6988_ok)
+    start_pressure();
+}
+
+// =============================================================
+// start_sht30()
+// start a single shot measurement of the SHT30,
+// sht30_done() gets the result
+// =============================================================
+void start_sht30(){
+  if(sht30.start(acq_config.active.sht30_repeatability) != 0){
+    sht30_measuring = false;
+    sht30_errors++;
+    sht30_health.failure(millis());
+    return;
+  }
+  sht30_measuring = true;
+}
+
+// =============================================================
+// start_pressure()
+// in the forced mode both sensors convert at the same time,
+// after a new init the first conversion of the normal mode
+// is waited for as well
+// =============================================================
+void start_pressure(){
+  if(acq_config.active.pressure_forced){
+    // without a new conversion the registers hold an old result
+    if(qmp6988.startForced())
+      qmp6988_measuring = true;
+    else
+      pressure_done(NULL, 0.0F);
+  } else if(!qmp6988.ready()){
+    qmp6988_measuring = true;
+  } else {
+    read_pressure();
+  }
+}
+
+// =============================================================
+// read_pressure()
+// queue the read of the last QMP6988 conversion,
+// pressure_done() stores the result
+// =============================================================
+void read_pressure(){
+  qmp6988_reading = true;
+  // without the calibration the result would be wrong
+  if(!qmp6988_ready || !qmp6988.requestPressure(pressure_done, NULL))
+    pressure_done(NULL, 0.0F);
+}
+
+void pressure_done(void* /* context */, float pressure){
+  qmp6988_reading = false;
+  // the driver reports a failed read as 0 Pa,
+  // the sample carries it as missing (NAN)
+  if(pressure == 0.0F){
+    measure_sample.pressure = NAN;
+    qmp6988_errors++;
+    qmp6988_health.failure(millis());
+  } else {
+    measure_sample.pressure = pressure;
+    qmp6988_health.success(millis());
+  }
+}
+
+// =============================================================
+// sht30_done()
+// result of the queued SHT30 read
+// =============================================================
+void sht30_done(void* /* context */, byte ret){
+  if(sht30_measuring){
+    sht30_measuring = false;
+    if(ret != 0){
+      sht30_errors++;
+      sht30_health.failure(millis());
+    } else {
+      sht30_fresh = true;
+      sht30_health.success(millis());
+    }
+  } else if(ret == 0){
+    sht30_fresh = true;
+    sht30_health.success(millis());
+  } else if(ret != SHT3X_NO_DATA){
+    // no new periodic result yet is not an error
+    sht30_errors++;
+    sht30_health.failure(millis());
+  }
+}
+
+// =============================================================
+// publish_measurement()
+// complete the sample with the SHT30 result (missing if there
+// is no valid one), store it and hand it over to the sinks
+// =============================================================
+void publish_measurement(bool sht30_valid){
+  if(sht30_valid){
+    measure_sample.temperature = sht30.cTemp;
+    measure_sample.humidity = sht30.humidity;
+    altitude_Temperature = sht30.cTemp;
+  } else {
+    measure_sample.temperature = NAN;
+    measure_sample.humidity = NAN;
+  }
+  // altitude with the air temperature of the SHT30,
+  // table lookup instead of QMP6988::calcAltitude()
+  if(env_value_valid(measure_sample.pressure)){
+    baro_Altitude = altitude_table.altitude(measure_sample.pressure, altitude_Temperature);
+    vertical_speed.update(baro_Altitude, measure_sample.time_ms);
+  }
+  // store the raw values for the charts
+  // (the history numbers the samples)
+  measure_sample.seq = history.add(measure_sample.temperature, measure_sample.humidity,
+                                   measure_sample.pressure, measure_sample.time_ms);
+  // hand the sample over to all other sinks
+  bus.publish(&measure_sample);
+}
+
+// =============================================================
+// store_forward_export()
+// exporter behind the store-and-forward queue
+// returns the number of samples that were sent,
+// 0 if the samples can not be sent now
+// =============================================================
+size_t store_forward_export(const env_sample_t* samples, size_t n, bool live){
+  if(WiFi.status() != WL_CONNECTED)
+    return 0;
+  if(store_forward_target == EXPORT_MQTT){
+    // the rest stays in the store-and-forward queue,
+    // the (much smaller) MQTT queue is filled up to the half
+    size_t capacity = mqtt.replayCapacity();
+    if(n > capacity)
+      n = capacity;
+    for(size_t i = 0; i < n; i++)
+      mqtt.publish(&samples[i], live);
+    return n;
+  }
+  if(store_forward_target == EXPORT_INFLUX){
+    // older samples need a valid timestamp
+    if(!influx.enabled() || (!live && !time_synced()))
+      return 0;
+    for(size_t i = 0; i < n; i++)
+      influx.add(&samples[i]);
+    if(!live)
+      influx.flush();
+    return n;
+  }
+  return 0;
+}
+
+// =============================================================
+// sample bus sinks
+// called by bus.dispatch() with the samples in their order
+// return false to keep the sample for the next dispatch()
+// =============================================================
+bool bus_serial(void* /* context */, const env_sample_t* sample){
+  Serial.println(sample->pressure);
+  Serial.println(sample->temperature);
+  Serial.println(sample->humidity);
+  return true;
+}
+
+// running average for the web page
+bool bus_average(void* /* context */, const env_sample_t* sample){
+  if(env_value_valid(sample->pressure)){
+    qmp_Pressure = ((qmp_Pressure*(n_pressure_average-1)) + sample->pressure)/n_pressure_average;
+    if(n_pressure_average < acq_config.active.n_average)
+      n_pressure_average++;
+  }
+  // temperature and humidity come from the same read
+  if(env_value_valid(sample->temperature)){
+    sht30_Temperature = ((sht30_Temperature*(n_average-1)) + sample->temperature)/n_average;
+    sht30_Humidity = ((sht30_Humidity*(n_average-1)) + sample->humidity)/n_average;
+    if(n_average < acq_config.active.n_average)
+      n_average++;
+  }
+  return true;
+}
+
+bool bus_alerts(void* /* context */, const env_sample_t* sample){
+  alerts.evaluate(sample);
+  return true;
+}
+
+bool bus_store_forward(void* /* context */, const env_sample_t* sample){
+  store_forward.add(sample);
+  return true;
+}
+
+bool bus_mqtt(void* /* context */, const env_sample_t* sample){
+  mqtt.publish(sample);
+  return true;
+}
+
+bool bus_influx(void* /* context */, const env_sample_t* sample){
+  influx.add(sample);
+  return true;
+}
+
+bool bus_coap(void* /* context */, const env_sample_t* sample){
+  coap.notify(sample);
+  return true;
+}
+
+bool bus_modbus(void* /* context */, const env_sample_t* sample){
+  modbus.update(sample, sht30_errors, qmp6988_errors);
+  return true;
+}
+
+bool bus_fleet(void* /* context */, const env_sample_t* sample){
+  fleet.publish(sample);
+  return true;
+}
+
+// =============================================================
+// serial_command()
+// reads the serial console line by line:
+//   stream [baud]  start the raw sensor stream (default 921600)
+//   stop           back to the normal mode at 115200 baud
+// =============================================================
+void serial_command(){
+  while(Serial.available()){
+    char c = Serial.read();
+    if(c != '\n' && c != '\r'){
+      if(serial_line_len < sizeof(serial_line) - 1)
+        serial_line[serial_line_len++] = c;
+      continue;
+    }
+    serial_line[serial_line_len] = 0;
+    serial_line_len = 0;
+    // "stream" is a whole token, only followed by the optional baud rate
+    if(!raw_streaming && strncmp(serial_line, "stream", 6) == 0 &&
+       (serial_line[6] == 0 || serial_line[6] == ' ')){
+      unsigned long baud = strtoul(&serial_line[6], NULL, 10);
+      raw_stream_baud = baud > 0 ? baud : RAW_STREAM_DEFAULT_BAUD;
+      Serial.printf("[OK] raw stream at %u baud\n", (unsigned int)raw_stream_baud);
+      Serial.flush();
+      Serial.updateBaudRate(raw_stream_baud);
+      raw_streaming = true;
+      raw_info_countdown = 0;
+      sht30_measuring = false;
+      // the stream reads the QMP6988 in the normal mode
+      if(acq_config.active.pressure_forced)
+        qmp6988.setpPowermode(QMP6988_NORMAL_MODE);
+    } else if(!raw_streaming && strcmp(serial_line, "bench") == 0){
+      compensation_bench();
+    } else if(raw_streaming && strcmp(serial_line, "stop") == 0){
+      Serial.flush();
+      Serial.updateBaudRate(SERIAL_BAUD);
+      raw_streaming = false;
+      // the normal measurements start again with a new average
+      n_average = 1;
+      n_pressure_average = 1;
+      // the stream uses single shot measurements
+      // and the QMP6988 in the normal mode
+      apply_acquisition_config();
+      Serial.println("[OK] raw stream stopped");
+    }
+  }
+}
+
+// =============================================================
+// compensation_bench()
+// cycles per QMP6988 compensation of the integer and the float
+// implementation and their largest difference, with the
+// calibration of the sensor and raw words around the actual ones
+// (see ATOM-Host-Tools/qmp6988_bench for the full range)
+// =============================================================
+#define BENCH_COUNT 2000
+volatile float bench_sink;
+
+template <class C>
+float bench_cycles(const typename C::coefficients_t* k, uint32_t p_read, uint32_t t_read){
+  float t, p, sum = 0.0F;
+  uint32_t start = ESP.getCycleCount();
+  for(int i = 0; i < BENCH_COUNT; i++){
+    C::compensate(k, p_read + i * 64, t_read + (i & 63) * 256, &t, &p);
+    sum += p;
+  }
+  uint32_t cycles = ESP.getCycleCount() - start;
+  bench_sink = sum;
+  return (float)cycles / BENCH_COUNT;
+}
+
+void compensation_bench(){
+  uint32_t p_read, t_read;
+  if(!qmp6988.readRaw(&p_read, &t_read)){
+    Serial.println("[ERR] QMP6988 not readable");
+    return;
+  }
+  qmp6988_cali_data_t cali;
+  qmp6988_ik_data_t ik;
+  qmp6988_fk_data_t fk;
+  qmp6988_cali_decode(qmp6988.calibrationData(), &cali);
+  QMP6988IntegerCompensation::init(&cali, &ik);
+  QMP6988FloatCompensation::init(&cali, &fk);
+  // raw words from below to above the actual ones
+  p_read -= BENCH_COUNT / 2 * 64;
+  t_read -= 32 * 256;
+  float max_dp = 0.0F, max_dt = 0.0F;
+  for(int i = 0; i < BENCH_COUNT; i++){
+    float ti, pi, tf, pf;
+    QMP6988IntegerCompensation::compensate(&ik, p_read + i * 64, t_read + (i & 63) * 256, &ti, &pi);
+    QMP6988FloatCompensation::compensate(&fk, p_read + i * 64, t_read + (i & 63) * 256, &tf, &pf);
+    if(fabsf(pf - pi) > max_dp)
+      max_dp = fabsf(pf - pi);
+    if(fabsf(tf - ti) > max_dt)
+      max_dt = fabsf(tf - ti);
+  }
+  float int_cycles = bench_cycles<QMP6988IntegerCompensation>(&ik, p_read, t_read);
+  float float_cycles = bench_cycles<QMP6988FloatCompensation>(&fk, p_read, t_read);
+  Serial.printf("[OK] compensation: integer %.1f cycles, float %.1f cycles, "
+                "max difference %.3f Pa %.4f C, active: %s\n",
+                int_cycles, float_cycles, max_dp, max_dt, QMP6988Compensation::name());
+  // altitude: the reference formula against the table
+  float sum = 0.0F;
+  uint32_t start = ESP.getCycleCount();
+  for(int i = 0; i < BENCH_COUNT; i++)
+    sum += qmp6988.calcAltitude(90000.0F + i * 8.0F, 20.0F);
+  uint32_t pow_cycles = ESP.getCycleCount() - start;
+  start = ESP.getCycleCount();
+  for(int i = 0; i < BENCH_COUNT; i++)
+    sum += altitude_table.altitude(90000.0F + i * 8.0F, 20.0F);
+  uint32_t table_cycles = ESP.getCycleCount() - start;
+  bench_sink = sum;
+  Serial.printf("[OK] altitude: pow %.1f cycles, table %.1f cycles\n",
+                (float)pow_cycles / BENCH_COUNT, (float)table_cycles / BENCH_COUNT);
+}
+
+// =============================================================
+// raw_stream_loop()
+// one raw reading of both sensors as binary packet,
+// plus an info packet with the QMP6988 calibration data
+// at the start and every RAW_INFO_INTERVAL packets
+// the QMP6988 is read while the SHT30 converts, the packet
+// is sent in the first call after the conversion time
+// =============================================================
+void raw_stream_loop(){
+  uint8_t frame[RAW_MAX_FRAME];
+  if(sht30_measuring){
+    if(!sht30.poll())
+      return;
+    sht30_measuring = false;
+    if(sht30.read() == 0){
+      raw_pending.flags |= RAW_FLAG_SHT30;
+      raw_pending.sht30_temperature = sht30.rawTemperature;
+      raw_pending.sht30_humidity = sht30.rawHumidity;
+    } else {
+      sht30_errors++;
+    }
+    raw_pending.seq = raw_seq++;
+    Serial.write(frame, raw_frame_sample(&raw_pending, frame));
+    return;
+  }
+  if(raw_info_countdown == 0){
+    raw_info_t info;
+    info.seq = raw_seq++;
+    info.time_us = micros();
+    info.baud = raw_stream_baud;
+    info.oversampling_p = acq_config.active.oversampling_p;
+    info.oversampling_t = acq_config.active.oversampling_t;
+    info.filter = acq_config.active.filter;
+    memcpy(info.calibration, qmp6988.calibrationData(), RAW_CALI_SIZE);
+    Serial.write(frame, raw_frame_info(&info, frame));
+    raw_info_countdown = RAW_INFO_INTERVAL;
+  }
+  raw_info_countdown--;
+
+  raw_pending.flags = 0;
+  raw_pending.time_us = micros();
+  raw_pending.sht30_temperature = 0;
+  raw_pending.sht30_humidity = 0;
+  raw_pending.qmp6988_pressure = 0;
+  raw_pending.qmp6988_temperature = 0;
+  if(sht30.start() == 0)
+    sht30_measuring = true;
+  else
+    sht30_errors++;
+  if(qmp6988.readRaw(&raw_pending.qmp6988_pressure, &raw_pending.qmp6988_temperature))
+    raw_pending.flags |= RAW_FLAG_QMP6988;
+  else
+    qmp6988_errors++;
+  // without a running SHT30 conversion the packet is complete
+  if(!sht30_measuring){
+    raw_pending.seq = raw_seq++;
+    Serial.write(frame, raw_frame_sample(&raw_pending, frame));
+  }
+}
+
+// =============================================================
+// parse_acquisition_config()
+// update config with the parameters of a /api/config request:
+//   profile=low_noise|fast  start from a predefined profile
+//   period=ms  average=n  oversampling_p=1..64
+//   oversampling_t=1..64  filter=0..32
+//   pressure_mode=normal|forced  (forced: filter=0|2)
+//   sht30_mode=single|0.5|1|2|4|10|art
+//   sht30_repeatability=high|medium|low
+// returns the number of changed settings (0: read only)
+// or -1 if a parameter or the resulting settings are invalid
+// =============================================================
+int parse_acquisition_config(acquisition_config_t* config){
+  int changed = 0;
+  String value = get_request_value("profile");
+  if(value.length() > 0){
+    if(!AcquisitionConfig::profile(AcquisitionConfig::profileNumber(value.c_str()), config))
+      return -1;
+    changed++;
+  }
+  value = get_request_value("period");
+  if(value.length() > 0){
+    config->period_ms = strtoul(value.c_str(), NULL, 10);
+    changed++;
+  }
+  value = get_request_value("average");
+  if(value.length() > 0){
+    unsigned long n = strtoul(value.c_str(), NULL, 10);
+    if(n > ACQ_AVERAGE_MAX)
+      return -1;
+    config->n_average = n;
+    changed++;
+  }
+  value = get_request_value("oversampling_p");
+  if(value.length() > 0){
+    int code = AcquisitionConfig::oversamplingCode(value.toInt());
+    if(code < 0)
+      return -1;
+    config->oversampling_p = code;
+    changed++;
+  }
+  value = get_request_value("oversampling_t");
+  if(value.length() > 0){
+    int code = AcquisitionConfig::oversamplingCode(value.toInt());
+    if(code < 0)
+      return -1;
+    config->oversampling_t = code;
+    changed++;
+  }
+  value = get_request_value("filter");
+  if(value.length() > 0){
+    int code = AcquisitionConfig::filterCode(value.toInt());
+    if(code < 0)
+      return -1;
+    config->filter = code;
+    changed++;
+  }
+  value = get_request_value("pressure_mode");
+  if(value.length() > 0){
+    if(value == "normal")
+      config->pressure_forced = 0;
+    else if(value == "forced")
+      config->pressure_forced = 1;
+    else
+      return -1;
+    changed++;
+  }
+  value = get_request_value("sht30_mode");
+  if(value.length() > 0){
+    int code = AcquisitionConfig::sht30ModeCode(value.c_str());
+    if(code < 0)
+      return -1;
+    config->sht30_mode = code;
+    changed++;
+  }
+  value = get_request_value("sht30_repeatability");
+  if(value.length() > 0){
+    int code = AcquisitionConfig::repeatabilityCode(value.c_str());
+    if(code < 0)
+      return -1;
+    config->sht30_repeatability = code;
+    changed++;
+  }
+  if(!AcquisitionConfig::valid(config))
+    return -1;
+  return changed;
+}
+
 // =============================================================
 // connect_Wifi()
 // connect to configured Wifi Access point